@@ -988,6 +988,11 @@ class RTP_UDP : public RTP_Session
     virtual PBoolean ReadData(RTP_DataFrame & frame, PBoolean loop);
     virtual PBoolean Internal_ReadData(RTP_DataFrame & frame, PBoolean loop);
 
+    /**Check if the encoding has data frames that ReadData() will return
+       without reading the data socket (e.g. recovered from redundancy).
+      */
+    virtual bool HasPendingData();
+
     /** Write a data frame to the RTP channel.
       */
     virtual PBoolean WriteData(RTP_DataFrame & frame);
@@ -1175,6 +1180,26 @@ class RTP_Encoding
     virtual RTP_Session::SendReceiveStatus OnReadTimeout(RTP_DataFrame & frame);
     virtual PBoolean ReadData(RTP_DataFrame & frame, PBoolean loop);
     virtual int WaitForPDU(PUDPSocket & dataSocket, PUDPSocket & controlSocket, const PTimeInterval &);
+    virtual bool HasPendingData() { return false; }
+
+    /**Error recovery statistics of the encoding.
+      */
+    struct ErrorRecoveryStatistics {
+      ErrorRecoveryStatistics();
+
+      unsigned m_packetsReceived;   ///< Received packets
+      unsigned m_packetsLost;       ///< Missing packets before the recovery
+      unsigned m_lossRate;          ///< Estimated loss rate (1/1000)
+      int      m_redundancyLevel;   ///< Adaptive redundancy level, -1 for static one
+      unsigned m_levelRaised;       ///< Times the level was raised
+      unsigned m_levelLowered;      ///< Times the level was lowered
+      unsigned m_repairSpan;        ///< Received packets that can repair a lost one (2*FEC span*entries), 0 w/o FEC
+    };
+
+    /**Get the error recovery statistics.
+       Returns false if the encoding has no error recovery.
+      */
+    virtual bool GetErrorRecoveryStatistics(ErrorRecoveryStatistics & /*statistics*/) { return false; }
 
     PMutex      mutex;
     unsigned    refCount;
@@ -59,6 +59,7 @@ class SDPFaxMediaDescription : public SDPMediaDescription
     virtual PString GetSDPPortList() const;
     virtual bool PrintOn(ostream & str, const PString & connectString) const;
     virtual void SetAttribute(const PString & attr, const PString & value);
+    virtual bool PostDecode();
     virtual void ProcessMediaOptions(SDPMediaFormat & sdpFormat, const OpalMediaFormat & mediaFormat);
 
   protected:
@@ -1919,6 +1919,11 @@ PBoolean RTP_UDP::Internal_ReadData(RTP_DataFrame & frame, PBoolean loop)
   return true;
 }
 
+bool RTP_UDP::HasPendingData()
+{
+  return EncodingLock(*this)->HasPendingData();
+}
+
 int RTP_UDP::WaitForPDU(PUDPSocket & dataSocket, PUDPSocket & controlSocket, const PTimeInterval & timeout)
 {
   return EncodingLock(*this)->WaitForPDU(dataSocket, controlSocket, timeout);
@@ -2312,6 +2317,18 @@ RTP_Encoding::~RTP_Encoding()
 }
 
 
+RTP_Encoding::ErrorRecoveryStatistics::ErrorRecoveryStatistics()
+  : m_packetsReceived(0)
+  , m_packetsLost(0)
+  , m_lossRate(0)
+  , m_redundancyLevel(-1)
+  , m_levelRaised(0)
+  , m_levelLowered(0)
+  , m_repairSpan(0)
+{
+}
+
+
 void RTP_Encoding::OnStart(RTP_Session & _rtpSession)
 {
   //rtpSession = &_rtpSession;
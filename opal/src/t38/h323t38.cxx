@@ -176,8 +176,14 @@ PBoolean H323_T38Capability::OnReceivedPDU(const H245_DataApplicationCapability
   const H245_DataApplicationCapability_application_t38fax & fax = cap.m_application;
   const H245_DataProtocolCapability & proto = fax.m_t38FaxProtocol;
 
-  if (proto.GetTag() == H245_DataProtocolCapability::e_udp)
+  if (proto.GetTag() == H245_DataProtocolCapability::e_udp) {
     mode = e_UDP;
+
+    const H245_T38FaxProfile & profile = fax.m_t38FaxProfile;
+    if (profile.HasOptionalField(H245_T38FaxProfile::e_t38FaxUdpOptions))
+      GetWritableMediaFormat().SetOptionEnum("T38FaxUdpEC",
+                        profile.m_t38FaxUdpOptions.m_t38FaxUdpEC.GetTag() == H245_T38FaxUdpOptions_t38FaxUdpEC::e_t38UDPFEC ? 0 : 1);
+  }
   else {
     const H245_T38FaxProfile & profile = fax.m_t38FaxProfile;
     if (profile.m_t38FaxTcpOptions.m_t38TCPBidirectionalMode)
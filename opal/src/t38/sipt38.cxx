@@ -139,6 +139,23 @@ void SDPFaxMediaDescription::SetAttribute(const PString & attr, const PString &
   return SDPMediaDescription::SetAttribute(attr, value);
 }
 
+bool SDPFaxMediaDescription::PostDecode()
+{
+  // the error recovery scheme of the remote is used to select our one
+  if (t38Attributes.Contains("T38FaxUdpEC")) {
+    for (SDPMediaFormatList::iterator format = formats.begin(); format != formats.end(); ++format) {
+      OpalMediaFormat & mediaFormat = format->GetWritableMediaFormat();
+
+      if (mediaFormat.GetMediaType() == OpalMediaType::Fax() &&
+          !mediaFormat.SetOptionValue("T38FaxUdpEC", t38Attributes["T38FaxUdpEC"])) {
+        PTRACE(2, "SDPFax\tIgnored T38FaxUdpEC:" << t38Attributes["T38FaxUdpEC"] << " for " << mediaFormat);
+      }
+    }
+  }
+
+  return SDPMediaDescription::PostDecode();
+}
+
 void SDPFaxMediaDescription::ProcessMediaOptions(SDPMediaFormat & /*sdpFormat*/, const OpalMediaFormat & mediaFormat)
 {
   if (mediaFormat.GetMediaType() == OpalMediaType::Fax()) {
@@ -66,6 +66,8 @@ const OpalMediaFormat & GetOpalT38()
         static const char * const RateMan[] = { "localTCF", "transferredTCF" };
         AddOption(new OpalMediaOptionEnum("T38FaxRateManagement", false, RateMan, PARRAYSIZE(RateMan), OpalMediaOption::EqualMerge, 1));
         AddOption(new OpalMediaOptionInteger("T38FaxVersion", false, OpalMediaOption::MinMerge, 0, 0, 1));
+        static const char * const UdpEC[] = { "t38UDPFEC", "t38UDPRedundancy" };
+        AddOption(new OpalMediaOptionEnum("T38FaxUdpEC", false, UdpEC, PARRAYSIZE(UdpEC), OpalMediaOption::NoMerge, 1));
       }
   } const T38;
   return T38;
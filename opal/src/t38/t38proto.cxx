@@ -77,10 +77,46 @@ class OpalFaxMediaStream : public OpalNullMediaStream
 
 /////////////////////////////////////////////////////////////////////////////
 
+#define FEC_HISTORY_SIZE      64                        // power of 2 and divisor of 65536
+#define FEC_HISTORY_MASK      (FEC_HISTORY_SIZE - 1)
+#define FEC_MAX_SPAN_ENTRIES  (FEC_HISTORY_SIZE / 4)    // max span*entries for sending
+
+#define ADAPT_WINDOW          32                        // received+lost packets per loss estimation
+#define ADAPT_TARGET_PPM      1000                      // max residual loss after redundancy (ppm)
+
+static void XorIFP(PBYTEArray & parity, const PBYTEArray & ifp)
+{
+  PINDEX len = ifp.GetSize();
+
+  if (parity.GetSize() < len)
+    parity.SetSize(len);  // new bytes are zeros
+
+  BYTE * pParity = parity.GetPointer();
+  const BYTE * pIfp = ifp;
+
+  for (PINDEX i = 0 ; i < len ; i++)
+    pParity[i] ^= pIfp[i];
+}
+
+
 class T38PseudoRTP_Handler : public RTP_Encoding
 {
   public:
     T38PseudoRTP_Handler()
+      : m_fecSpan(0)
+      , m_fecEntries(0)
+      , m_sentCount(0)
+      , m_adaptiveMin(-1)
+      , m_adaptiveMax(-1)
+      , m_adaptiveLevel(-1)
+      , m_lossRate(0)
+      , m_windowReceived(0)
+      , m_windowLost(0)
+      , m_totalReceived(0)
+      , m_totalLost(0)
+      , m_levelRaised(0)
+      , m_levelLowered(0)
+      , m_repairSpan(0)
     {
       PStringToString options;
 
@@ -88,29 +124,77 @@ class T38PseudoRTP_Handler : public RTP_Encoding
       options.SetAt("T38-UDPTL-Redundancy-Interval", "0");        // re-send redundancy ifp packets only with next ifp
       options.SetAt("T38-UDPTL-Keep-Alive-Interval", "0");        // no send keep-alive packets
       options.SetAt("T38-UDPTL-Optimise-On-Retransmit", "false"); // not optimise udptl packets on retransmit
+      options.SetAt("T38-UDPTL-FEC", "0");                        // use secondary ifp packets for error recovery
+      options.SetAt("T38-UDPTL-Redundancy-Adaptive", "");         // not adapt redundancy to observed loss
 
       ApplyStringOptions(options);
     }
 
 
+    ~T38PseudoRTP_Handler()
+    {
+      PTRACE_IF(3, m_adaptiveMax >= 0, "T38_UDPTL\tAdaptive redundancy:"
+                " received " << m_totalReceived <<
+                " lost " << m_totalLost <<
+                " loss rate " << m_lossRate << "/1000"
+                " level " << m_adaptiveLevel <<
+                " raised " << m_levelRaised <<
+                " lowered " << m_levelLowered);
+    }
+
+
     void OnStart(RTP_Session & _rtpUDP)
     {
       RTP_Encoding::OnStart(_rtpUDP);
 
       rtpUDP->SetJitterBufferSize(0, 0);
+      rtpUDP->SetIgnoreOutOfOrderPackets(false);  // pass the late FEC repairs and reordered packets
       m_consecutiveBadPackets  = 0;
       m_oneGoodPacket          = false;
       m_expectedSequenceNumber = 0;
       m_secondaryPacket        = -1;
 
+      for (PINDEX i = 0 ; i < FEC_HISTORY_SIZE ; i++) {
+        m_receivedIFP[i].m_valid = false;
+        m_receivedIFP[i].m_fec.clear();
+      }
+
+      m_haveLost = false;
+
+      PWaitAndSignal mutex(m_writeMutex);
+
+      m_lossRate       = 0;
+      m_windowReceived = 0;
+      m_windowLost     = 0;
+      m_totalReceived  = 0;
+      m_totalLost      = 0;
+      m_levelRaised    = 0;
+      m_levelLowered   = 0;
+      m_repairSpan     = 0;
+      m_adaptiveLevel  = m_adaptiveMax;  // protect till the loss is known
+
       m_sentPacketRedundancy.clear();
       m_sentPacket = T38_UDPTLPacket();
-      m_sentPacket.m_error_recovery.SetTag(T38_UDPTLPacket_error_recovery::e_secondary_ifp_packets);
+      SetErrorRecoveryTag();
       m_sentPacket.m_seq_number = (unsigned)-1;
+      m_sentCount = 0;
       rtpUDP->SetNextSentSequenceNumber(0);
     }
 
 
+    void SetErrorRecoveryTag()
+    {
+      unsigned tag = m_fecSpan > 0
+                     ? T38_UDPTLPacket_error_recovery::e_fec_info
+                     : T38_UDPTLPacket_error_recovery::e_secondary_ifp_packets;
+
+      if (m_sentPacket.m_error_recovery.GetTag() != tag) {
+        m_sentPacket.m_error_recovery.SetTag(tag);
+        m_sentPacketRedundancy.clear();  // the secondary ifp packets are lost
+      }
+    }
+
+
     void ApplyStringOptions(const PStringToString & stringOptions)
     {
       for (PINDEX i = 0 ; i < stringOptions.GetSize() ; i++) {
@@ -178,6 +262,48 @@ class T38PseudoRTP_Handler : public RTP_Encoding
 
           PTRACE(3, "T38_UDPTL\tUse optimise on retransmit - " << (m_optimiseOnRetransmit ? "true" : "false"));
         }
+        else
+        if (key == "T38-UDPTL-FEC") {
+          PStringArray pair = stringOptions.GetDataAt(i).Tokenise(":", FALSE);
+          PWaitAndSignal mutex(m_writeMutex);
+
+          m_fecSpan = pair.GetSize() > 0 ? pair[0].AsUnsigned() : 0;
+          m_fecEntries = pair.GetSize() > 1 ? pair[1].AsUnsigned() : 1;
+
+          if (m_fecSpan == 0 || m_fecEntries == 0) {
+            m_fecSpan = m_fecEntries = 0;
+            PTRACE(3, "T38_UDPTL\tUse secondary IFP packets for error recovery");
+          } else {
+            if (m_fecSpan > FEC_MAX_SPAN_ENTRIES)
+              m_fecSpan = FEC_MAX_SPAN_ENTRIES;
+
+            if (m_fecEntries > FEC_MAX_SPAN_ENTRIES/m_fecSpan)
+              m_fecEntries = FEC_MAX_SPAN_ENTRIES/m_fecSpan;
+
+            PTRACE(3, "T38_UDPTL\tUse FEC for error recovery, span " << m_fecSpan << " entries " << m_fecEntries);
+          }
+
+          SetErrorRecoveryTag();
+          m_sentCount = 0;  // the packets sent before are not in the FEC history
+        }
+        else
+        if (key == "T38-UDPTL-Redundancy-Adaptive") {
+          PStringArray pair = stringOptions.GetDataAt(i).Tokenise(":", FALSE);
+          PWaitAndSignal mutex(m_writeMutex);
+
+          if (pair.GetSize() == 2 && pair[0].AsInteger() >= 0 && pair[0].AsInteger() <= pair[1].AsInteger()) {
+            m_adaptiveMin = (int)pair[0].AsInteger();
+            m_adaptiveMax = (int)pair[1].AsInteger();
+            PTRACE(3, "T38_UDPTL\tUse adaptive redundancy " << m_adaptiveMin << ".." << m_adaptiveMax);
+          } else {
+            PTRACE_IF(2, !stringOptions.GetDataAt(i).IsEmpty(),
+                      "T38_UDPTL\tIgnored adaptive redundancy \"" << stringOptions.GetDataAt(i) << "\"");
+            m_adaptiveMin = m_adaptiveMax = -1;
+            PTRACE(3, "T38_UDPTL\tUse static redundancy");
+          }
+
+          m_adaptiveLevel = m_adaptiveMax;
+        }
         else {
           PTRACE(4, "T38_UDPTL\tIgnored option " << key << " = \"" << stringOptions.GetDataAt(i) << "\"");
         }
@@ -233,8 +359,6 @@ class T38PseudoRTP_Handler : public RTP_Encoding
             secondary[0].SetValue(m_sentPacket.m_primary_ifp_packet.GetValue());
             m_sentPacket.m_primary_ifp_packet = T38_UDPTLPacket_primary_ifp_packet();
           }
-        } else {
-          PTRACE(3, "T38_UDPTL\tNot implemented yet " << recovery.GetTagName());
         }
       }
 
@@ -251,6 +375,9 @@ class T38PseudoRTP_Handler : public RTP_Encoding
         }
       }
 
+      if (m_adaptiveLevel >= 0 && redundancy > m_adaptiveLevel)
+        redundancy = m_adaptiveLevel;
+
       if (redundancy > 0 || !m_sentPacketRedundancy.empty())
         m_sentPacketRedundancy.insert(m_sentPacketRedundancy.begin(), redundancy + 1);
 
@@ -259,6 +386,9 @@ class T38PseudoRTP_Handler : public RTP_Encoding
       m_sentPacket.m_seq_number = frame.GetSequenceNumber();
       m_sentPacket.m_primary_ifp_packet.SetValue(frame.GetPayloadPtr(), plLen);
 
+      if (m_fecSpan > 0)
+        SetSentFecInfo();
+
       bool ok = WriteUDPTL();
 
       DecrementSentPacketRedundancy(true);
@@ -267,6 +397,49 @@ class T38PseudoRTP_Handler : public RTP_Encoding
     }
 
 
+    void SetSentFecInfo()
+    {
+      unsigned seq = m_sentPacket.m_seq_number;
+
+      PBYTEArray & sentIFP = m_sentIFP[seq & FEC_HISTORY_MASK];
+
+      sentIFP = m_sentPacket.m_primary_ifp_packet.GetValue();
+      sentIFP.MakeUnique();  // do not share the buffer reused by the next packet
+
+      // wind up the FEC on the first packets
+
+      unsigned span = m_fecSpan;
+      unsigned entries = m_fecEntries;
+
+      if (m_sentCount < span*entries) {
+        entries = m_sentCount/span;
+
+        if (entries == 0)
+          span = 0;
+
+        m_sentCount++;
+      }
+
+      // the entry m is the parity of the packets
+      // seq+m-span*entries, ..., seq+m-2*entries, seq+m-entries
+
+      T38_UDPTLPacket_error_recovery_fec_info &fec = m_sentPacket.m_error_recovery;
+
+      fec.m_fec_npackets = span;
+      fec.m_fec_data.SetSize(entries);
+
+      for (unsigned m = 0 ; m < entries ; m++) {
+        PBYTEArray parity;
+        unsigned limit = seq + m;
+
+        for (unsigned i = limit - span*entries ; i != limit ; i += entries)
+          XorIFP(parity, m_sentIFP[i & FEC_HISTORY_MASK]);
+
+        fec.m_fec_data[m].SetValue(parity);
+      }
+    }
+
+
     void OnWriteDataIdle()
     {
       PWaitAndSignal mutex(m_writeMutex);
@@ -283,11 +456,88 @@ class T38PseudoRTP_Handler : public RTP_Encoding
 
       if (m_sentPacketRedundancy.empty() || m_redundancyInterval <= 0)
         timer = m_keepAliveInterval;
+      else
+      if (m_adaptiveLevel >= 0 && m_adaptiveLevel < m_adaptiveMax)
+        // resend less often on the less lossy links
+        timer = m_redundancyInterval * m_adaptiveMax / (m_adaptiveLevel > 0 ? m_adaptiveLevel : 1);
       else
         timer = m_redundancyInterval;
     }
 
 
+    void UpdateLossRate(int missing)
+    {
+      if (missing < 0)
+        return;   // repeated or late packet
+
+      if (missing > ADAPT_WINDOW)
+        missing = ADAPT_WINDOW;   // probably the remote restarted the sequence numbers
+
+      // the adaptive range can be changed by ApplyStringOptions() at any time
+
+      PWaitAndSignal mutex(m_writeMutex);
+
+      m_totalReceived++;
+      m_totalLost += missing;
+
+      if (m_adaptiveMax < 0)
+        return;
+
+      m_windowReceived++;
+      m_windowLost += missing;
+
+      unsigned count = m_windowReceived + m_windowLost;
+
+      if (count < ADAPT_WINDOW)
+        return;
+
+      // raise the loss rate at once and lower it slowly
+
+      unsigned rate = m_windowLost * 1000 / count;
+
+      m_lossRate = rate > m_lossRate ? rate : (3*m_lossRate + rate)/4;
+      m_windowReceived = m_windowLost = 0;
+
+      // find the level with residual loss rate^(level+1) not above the target
+
+      int level = 0;
+
+      for (unsigned residual = m_lossRate*1000 ; residual > ADAPT_TARGET_PPM && level < m_adaptiveMax ; level++)
+        residual = residual * m_lossRate / 1000;
+
+      if (level < m_adaptiveMin)
+        level = m_adaptiveMin;
+
+      if (level == m_adaptiveLevel)
+        return;
+
+      PTRACE(3, "T38_UDPTL\tLoss rate " << m_lossRate << "/1000, redundancy level " << m_adaptiveLevel << " -> " << level);
+
+      if (level > m_adaptiveLevel)
+        m_levelRaised++;
+      else
+        m_levelLowered++;
+
+      m_adaptiveLevel = level;
+    }
+
+
+    bool GetErrorRecoveryStatistics(ErrorRecoveryStatistics & statistics)
+    {
+      PWaitAndSignal mutex(m_writeMutex);
+
+      statistics.m_packetsReceived = m_totalReceived;
+      statistics.m_packetsLost     = m_totalLost;
+      statistics.m_lossRate        = m_lossRate;
+      statistics.m_redundancyLevel = m_adaptiveMax >= 0 ? m_adaptiveLevel : -1;
+      statistics.m_levelRaised     = m_levelRaised;
+      statistics.m_levelLowered    = m_levelLowered;
+      statistics.m_repairSpan      = m_repairSpan;
+
+      return true;
+    }
+
+
     void DecrementSentPacketRedundancy(bool stripRedundancy)
     {
       int iMax = (int)m_sentPacketRedundancy.size() - 1;
@@ -307,8 +557,6 @@ class T38PseudoRTP_Handler : public RTP_Encoding
         if (recovery.GetTag() == T38_UDPTLPacket_error_recovery::e_secondary_ifp_packets) {
           T38_UDPTLPacket_error_recovery_secondary_ifp_packets &secondary = recovery;
           secondary.SetSize(iMax > 0 ? iMax : 0);
-        } else {
-          PTRACE(3, "T38_UDPTL\tNot implemented yet " << recovery.GetTagName());
         }
       }
     }
@@ -344,6 +592,12 @@ class T38PseudoRTP_Handler : public RTP_Encoding
     }
 
 
+    bool HasPendingData()
+    {
+      return m_secondaryPacket >= 0;
+    }
+
+
     RTP_Session::SendReceiveStatus OnReadTimeout(RTP_DataFrame & frame)
     {
       // Override so do not do sender reports (RTP only) and push
@@ -353,20 +607,148 @@ class T38PseudoRTP_Handler : public RTP_Encoding
     }
 
 
-    void SetFrameFromIFP(RTP_DataFrame & frame, const PASN_OctetString & ifp, unsigned sequenceNumber)
+    void SetFrameFromIFP(RTP_DataFrame & frame, const BYTE * ifp, PINDEX ifpLen, unsigned sequenceNumber)
     {
-      frame.SetPayloadSize(ifp.GetDataLength());
-      memcpy(frame.GetPayloadPtr(), (const BYTE *)ifp, ifp.GetDataLength());
+      frame.SetPayloadSize(ifpLen);
+      memcpy(frame.GetPayloadPtr(), ifp, ifpLen);
       frame.SetSequenceNumber((WORD)(sequenceNumber & 0xffff));
       if (m_secondaryPacket <= 0)
         m_expectedSequenceNumber = sequenceNumber+1;
     }
 
+    void SetFrameFromIFP(RTP_DataFrame & frame, const PASN_OctetString & ifp, unsigned sequenceNumber)
+    {
+      SetFrameFromIFP(frame, ifp, ifp.GetDataLength(), sequenceNumber);
+    }
+
+
+    int OnReceivedFecInfo(int missing)
+    {
+      unsigned seq = m_receivedPacket.m_seq_number;
+      ReceivedIFP & received = m_receivedIFP[seq & FEC_HISTORY_MASK];
+
+      received.m_valid = true;
+      received.m_delivered = true;  // the primary is passed by the caller
+      received.m_sequenceNumber = seq & 0xffff;
+      received.m_ifp = m_receivedPacket.m_primary_ifp_packet.GetValue();
+      received.m_ifp.MakeUnique();  // do not share the buffer reused by the next packet
+
+      const T38_UDPTLPacket_error_recovery_fec_info & fec = m_receivedPacket.m_error_recovery;
+      unsigned span = fec.m_fec_npackets;
+      unsigned entries = fec.m_fec_data.GetSize();
+
+      received.m_fec.clear();
+
+      if (span > 0 && entries > 0 && span < FEC_HISTORY_SIZE && span*entries < FEC_HISTORY_SIZE) {
+        received.m_fecSpan = span;
+
+        // the receiver waits for the repairs of lost packets from the later ones,
+        // a repair can enable the repair of an older packet, so allow twice the span
+        unsigned repairSpan = 2*span*entries < FEC_HISTORY_SIZE ? 2*span*entries : FEC_HISTORY_SIZE - 1;
+
+        if (m_repairSpan != repairSpan) {
+          PWaitAndSignal mutex(m_writeMutex);
+          m_repairSpan = repairSpan;
+        }
+
+        for (unsigned m = 0 ; m < entries ; m++) {
+          received.m_fec.push_back(fec.m_fec_data[m].GetValue());
+          received.m_fec.back().MakeUnique();
+        }
+      }
+
+      // the packets lost before can be repaired by the FEC of the later ones
+
+      if (missing == 0 && (!m_haveLost || ((seq - m_lastLost) & 0xffff) >= FEC_HISTORY_SIZE))
+        return 0;
+
+      // repair the lost packets until nothing can be repaired
+
+      int late = 0;
+
+      for (bool repaired = true ; repaired ;) {
+        repaired = false;
+
+        for (unsigned l = seq - FEC_HISTORY_SIZE + 1 ; l != seq + 1 ; l++) {
+          const ReceivedIFP & parity = m_receivedIFP[l & FEC_HISTORY_MASK];
+
+          if (!parity.Is(l) || parity.m_fec.empty())
+            continue;
+
+          entries = parity.m_fec.size();
+          span = parity.m_fecSpan;
+
+          for (unsigned m = 0 ; m < entries ; m++) {
+            unsigned limit = l + m;
+            unsigned first = limit - span*entries;
+
+            if (seq - first >= FEC_HISTORY_SIZE)
+              continue;
+
+            unsigned lost = 0;
+            int numLost = 0;
+
+            for (unsigned i = first ; i != limit ; i += entries) {
+              if (!m_receivedIFP[i & FEC_HISTORY_MASK].Is(i)) {
+                lost = i;
+                numLost++;
+              }
+            }
+
+            if (numLost != 1)
+              continue;
+
+            PBYTEArray ifp(parity.m_fec[m], parity.m_fec[m].GetSize());
+
+            for (unsigned i = first ; i != limit ; i += entries) {
+              if (i != lost)
+                XorIFP(ifp, m_receivedIFP[i & FEC_HISTORY_MASK].m_ifp);
+            }
+
+            ReceivedIFP & recovered = m_receivedIFP[lost & FEC_HISTORY_MASK];
+
+            recovered.m_valid = true;
+            recovered.m_delivered = false;
+            recovered.m_sequenceNumber = lost & 0xffff;
+            recovered.m_ifp = ifp;
+            recovered.m_fec.clear();
+            repaired = true;
+
+            if (late < (int)(seq - lost) - missing)
+              late = (int)(seq - lost) - missing;
+
+            PTRACE(4, "T38_UDPTL\tUsing FEC data to reconstruct missing packet at SN=" << recovered.m_sequenceNumber);
+          }
+        }
+      }
+
+      return late;
+    }
+
+
     RTP_Session::SendReceiveStatus ReadDataPDU(RTP_DataFrame & frame)
     {
-      if (m_secondaryPacket >= 0) {
+      while (m_secondaryPacket >= 0) {
         if (m_secondaryPacket == 0)
           SetFrameFromIFP(frame, m_receivedPacket.m_primary_ifp_packet, m_receivedPacket.m_seq_number);
+        else
+        if (m_receivedPacket.m_error_recovery.GetTag() == T38_UDPTLPacket_error_recovery::e_fec_info) {
+          unsigned sequenceNumber = m_receivedPacket.m_seq_number - m_secondaryPacket;
+          ReceivedIFP & received = m_receivedIFP[sequenceNumber & FEC_HISTORY_MASK];
+
+          if (!received.Is(sequenceNumber) || received.m_delivered) {
+            if (!received.Is(sequenceNumber)) {
+              // not repaired yet
+              m_lastLost = sequenceNumber & 0xffff;
+              m_haveLost = true;
+            }
+            --m_secondaryPacket;
+            continue;
+          }
+
+          received.m_delivered = true;
+          SetFrameFromIFP(frame, received.m_ifp, received.m_ifp.GetSize(), sequenceNumber);
+        }
         else {
           T38_UDPTLPacket_error_recovery_secondary_ifp_packets & secondaryPackets = m_receivedPacket.m_error_recovery;
           SetFrameFromIFP(frame, secondaryPackets[m_secondaryPacket-1], m_receivedPacket.m_seq_number - m_secondaryPacket);
@@ -411,7 +793,31 @@ class T38PseudoRTP_Handler : public RTP_Encoding
 
       PTRACE(5, "T38_UDPTL\tDecoded UDPTL packet:\n  " << setprecision(2) << m_receivedPacket);
 
-      int missing = m_receivedPacket.m_seq_number - m_expectedSequenceNumber;
+      int missing = (short)(WORD)(m_receivedPacket.m_seq_number - m_expectedSequenceNumber); // 16 bit, wraps
+      UpdateLossRate(missing);
+      if (m_receivedPacket.m_error_recovery.GetTag() == T38_UDPTLPacket_error_recovery::e_fec_info) {
+        if (missing < 0) {
+          // The first, reordered or repeated packet
+          const ReceivedIFP & received = m_receivedIFP[m_receivedPacket.m_seq_number & FEC_HISTORY_MASK];
+
+          if (received.Is(m_receivedPacket.m_seq_number) && received.m_delivered) {
+            PTRACE(4, "T38_UDPTL\tIgnored already passed packet at SN=" << m_receivedPacket.m_seq_number);
+            return RTP_Session::e_IgnorePacket;
+          }
+
+          missing = 0;
+        }
+
+        // Pass the repaired ones before the primary, the packets missing
+        // before this one are passed late (out of order)
+        int secondary = missing + OnReceivedFecInfo(missing);
+
+        if (secondary > 0) {
+          m_secondaryPacket = secondary < FEC_HISTORY_SIZE ? secondary : FEC_HISTORY_SIZE - 1;
+          return ReadDataPDU(frame);
+        }
+      }
+      else
       if (missing > 0 && m_receivedPacket.m_error_recovery.GetTag() == T38_UDPTLPacket_error_recovery::e_secondary_ifp_packets) {
         // Packets are missing and we have redundency in the UDPTL packets
         T38_UDPTLPacket_error_recovery_secondary_ifp_packets & secondaryPackets = m_receivedPacket.m_error_recovery;
@@ -440,12 +846,43 @@ class T38PseudoRTP_Handler : public RTP_Encoding
     unsigned        m_expectedSequenceNumber;
     int             m_secondaryPacket;
 
+    struct ReceivedIFP {
+      ReceivedIFP() : m_valid(false), m_delivered(false), m_sequenceNumber(0), m_fecSpan(0) { }
+      bool Is(unsigned sequenceNumber) const { return m_valid && m_sequenceNumber == (sequenceNumber & 0xffff); }
+
+      bool                    m_valid;            // received or repaired
+      bool                    m_delivered;        // passed up
+      unsigned                m_sequenceNumber;
+      PBYTEArray              m_ifp;
+      unsigned                m_fecSpan;
+      std::vector<PBYTEArray> m_fec;              // FEC entries of the packet
+    };
+    ReceivedIFP     m_receivedIFP[FEC_HISTORY_SIZE];
+    bool            m_haveLost;                   // m_lastLost is valid
+    unsigned        m_lastLost;                   // the last not repaired packet
+
     std::map<int, int>  m_redundancy;
     PTimeInterval       m_redundancyInterval;
     PTimeInterval       m_keepAliveInterval;
     bool                m_optimiseOnRetransmit;
     std::vector<int>    m_sentPacketRedundancy;
     T38_UDPTLPacket     m_sentPacket;
+    unsigned            m_fecSpan;
+    unsigned            m_fecEntries;
+    unsigned            m_sentCount;          // for wind up of FEC
+    PBYTEArray          m_sentIFP[FEC_HISTORY_SIZE];
+
+    int                 m_adaptiveMin;        // -1 for static redundancy
+    int                 m_adaptiveMax;
+    int                 m_adaptiveLevel;      // caps the redundancy, guarded by m_writeMutex
+    unsigned            m_lossRate;           // per 1000 received+lost packets
+    unsigned            m_windowReceived;
+    unsigned            m_windowLost;
+    DWORD               m_totalReceived;
+    DWORD               m_totalLost;
+    DWORD               m_levelRaised;
+    DWORD               m_levelLowered;
+    unsigned            m_repairSpan;         // packets that can repair a lost one, written under m_writeMutex
     PMutex              m_writeMutex;
 };
 
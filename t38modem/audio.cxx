@@ -86,6 +86,7 @@
 #include "t30tone.h"
 #include "tone_gen.h"
 #include "audio.h"
+#include "stats.h"
 
 #define new PNEW
 
@@ -94,6 +95,8 @@ typedef	PInt16                    SIMPLE_TYPE;
 #define BYTES_PER_SIMPLE          sizeof(SIMPLE_TYPE)
 #define SIMPLES_PER_SEC           8000
 #define BYTES_PER_MSEC            ((SIMPLES_PER_SEC*BYTES_PER_SIMPLE)/1000)
+#define AUDIO_THRESHOLD           (1024 * BYTES_PER_SIMPLE)
+#define AUDIO_FRAME               (BYTES_PER_MSEC*20)
 ///////////////////////////////////////////////////////////////
 class FakeReadThread : public PThread
 {
@@ -208,22 +211,33 @@ static ToneGenerator::ToneType dt2tt(EngineBase::DataType dataType)
 ///////////////////////////////////////////////////////////////
 AudioEngine::AudioEngine(const PString &_name)
   : EngineBase(_name + " AudioEngine")
+  , stats(ModemStats::Get(_name))
   , callbackParam(cbpReset)
   , sendAudio(NULL)
   , recvAudio(NULL)
+  , sendAudioFrames(AUDIO_THRESHOLD)
+  , recvAudioFrames(AUDIO_THRESHOLD)
   , pToneIn(NULL)
   , pToneOut(NULL)
   , t30ToneDetect(NULL)
 {
   PTRACE(2, name << " AudioEngine");
+
+  /*
+   * Preallocate the audio buffers for the threshold and a frame above it,
+   * so the data phases reuse them and never allocate on the media path.
+   */
+  PINDEX count = AUDIO_THRESHOLD + AUDIO_FRAME;
+
+  sendAudioFrames.PutBegin(count);
+  count = AUDIO_THRESHOLD + AUDIO_FRAME;
+  recvAudioFrames.PutBegin(count);
 }
 
 AudioEngine::~AudioEngine()
 {
   PTRACE(2, name << " ~AudioEngine");
 
-  delete sendAudio;
-  delete recvAudio;
   delete pToneIn;
   delete pToneOut;
   delete t30ToneDetect;
@@ -247,13 +261,13 @@ void AudioEngine::OnResetModemState()
     if (hOwnerOut != NULL) {
       sendAudio->PutEof();
     } else {
-      delete sendAudio;
+      sendAudio->Clean();
       sendAudio = NULL;
     }
   }
 
   if (recvAudio) {
-    delete recvAudio;
+    recvAudio->Clean();
     recvAudio = NULL;
   }
 
@@ -316,7 +330,7 @@ PBoolean AudioEngine::Read(HOWNEROUT hOwner, void * buffer, PINDEX amount)
   if (hOwnerOut != hOwner || !IsModemOpen())
     return FALSE;
 
-  {
+  if (firstOut) {
     PWaitAndSignal mutexWait(Mutex);
 
     if (hOwnerOut != hOwner || !IsModemOpen())
@@ -350,7 +364,7 @@ PBoolean AudioEngine::Read(HOWNEROUT hOwner, void * buffer, PINDEX amount)
 
     if (count < 0) {
       count = 0;
-      delete sendAudio;
+      sendAudio->Clean();
       sendAudio = NULL;
       ModemCallbackWithUnlock(callbackParam);
 
@@ -365,8 +379,10 @@ PBoolean AudioEngine::Read(HOWNEROUT hOwner, void * buffer, PINDEX amount)
       }
     }
 
-    if (amount > count)
+    if (amount > count) {
       memset((BYTE *)buffer + count, 0, amount - count);
+      ModemStats::Add(stats.audioBytesOutSilence, amount - count);
+    }
   } else {
     if (pToneOut)
       pToneOut->Read(buffer, amount);
@@ -374,6 +390,8 @@ PBoolean AudioEngine::Read(HOWNEROUT hOwner, void * buffer, PINDEX amount)
       memset(buffer, 0, amount);
   }
 
+  ModemStats::Add(stats.audioBytesOut, amount);
+
   return TRUE;
 }
 
@@ -404,10 +422,8 @@ PBoolean AudioEngine::SendStart(DataType PTRACE_PARAM(_dataType), int PTRACE_PAR
 
   PWaitAndSignal mutexWait(Mutex);
 
-  if (sendAudio)
-    delete sendAudio;
-
-  sendAudio = new DataStream(1024 * BYTES_PER_SIMPLE);
+  sendAudio = &sendAudioFrames;
+  sendAudio->Clean();
 
   PTRACE(3, name << " SendStart _dataType=" << _dataType
                  << " param=" << param);
@@ -510,6 +526,8 @@ PBoolean AudioEngine::Write(HOWNERIN hOwner, const void * buffer, PINDEX len)
     }
 
     if (buffer) {
+      ModemStats::Add(stats.audioBytesIn, len);
+
       if (recvAudio && !recvAudio->isFull()) {
         recvAudio->PutData(buffer, len);
         ModemCallbackWithUnlock(callbackParam);
@@ -518,27 +536,31 @@ PBoolean AudioEngine::Write(HOWNERIN hOwner, const void * buffer, PINDEX len)
           return FALSE;
       }
 
-      if (t30ToneDetect && t30ToneDetect->Write(buffer, len)) {
-        OnUserInput('c');
+      if (t30ToneDetect) {
+        const char *tones = t30ToneDetect->Write(buffer, len);
 
-        if (hOwnerIn != hOwner || !IsModemOpen())
-          return FALSE;
+        if (*tones) {
+          OnUserInput(tones);
+
+          if (hOwnerIn != hOwner || !IsModemOpen())
+            return FALSE;
+        }
       }
     } else {
       if (recvAudio && !recvAudio->isFull()) {
         for (PINDEX rest = len ; rest > 0 ;) {
-          BYTE buf[64*BYTES_PER_SIMPLE];
           PINDEX lenChank = rest;
+          BYTE *pBuf = recvAudio->PutBegin(lenChank);
 
-          if (lenChank > (PINDEX)sizeof(buf))
-            lenChank = (PINDEX)sizeof(buf);
+          if (lenChank <= 0)
+            break;
 
           if (pToneIn)
-            pToneIn->Read(buf, lenChank);
+            pToneIn->Read(pBuf, lenChank);
           else
-            memset(buf, 0, lenChank);
+            memset(pBuf, 0, lenChank);
 
-          recvAudio->PutData(buf, lenChank);
+          recvAudio->PutEnd(lenChank);
           rest -= lenChank;
         }
 
@@ -585,10 +607,8 @@ PBoolean AudioEngine::RecvWait(DataType /*_dataType*/, int /*param*/, int /*_cal
 
   PWaitAndSignal mutexWait(Mutex);
 
-  if (recvAudio)
-    delete recvAudio;
-
-  recvAudio = new DataStream(1024 * BYTES_PER_SIMPLE);
+  recvAudio = &recvAudioFrames;
+  recvAudio->Clean();
 
   done = TRUE;
 
@@ -634,7 +654,7 @@ void AudioEngine::RecvStop()
   PWaitAndSignal mutexWait(Mutex);
 
   if (recvAudio) {
-    delete recvAudio;
+    recvAudio->Clean();
     recvAudio = NULL;
   }
 }
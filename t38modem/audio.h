@@ -60,9 +60,9 @@
 #include "enginebase.h"
 
 ///////////////////////////////////////////////////////////////
-class DataStream;
 class ToneGenerator;
 class T30ToneDetect;
+struct ModemStats;
 ///////////////////////////////////////////////////////////////
 class AudioEngine : public EngineBase
 {
@@ -106,13 +106,18 @@ class AudioEngine : public EngineBase
     virtual void OnChangeEnableFakeIn();
     virtual void OnChangeEnableFakeOut();
 
+    ModemStats &stats;
+
     PAdaptiveDelay readDelay;
     PAdaptiveDelay writeDelay;
 
     int callbackParam;
 
-    DataStream *volatile sendAudio;
-    DataStream *volatile recvAudio;
+    DataStream *volatile sendAudio;	// &sendAudioFrames or NULL
+    DataStream *volatile recvAudio;	// &recvAudioFrames or NULL
+
+    DataStream sendAudioFrames;
+    DataStream recvAudioFrames;
 
     ToneGenerator *volatile pToneIn;
     ToneGenerator *volatile pToneOut;
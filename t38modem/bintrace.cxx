@@ -0,0 +1,517 @@
+/*
+ * bintrace.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: bintrace.cxx,v $
+ *
+ */
+
+#include <ptlib.h>
+#include "pmutils.h"
+#include "bintrace.h"
+
+#if PTRACING
+
+#ifdef BIN_TRACE
+  #include <pthread.h>
+#endif
+
+#define new PNEW
+
+///////////////////////////////////////////////////////////////
+static const char *const eventFormats[btNumberOfEvents] = {
+  /* btDropped                */ "BinTrace: dropped %d records",
+  /* btReadPacket             */ "T38ModemMediaStream::ReadPacket packet %d size=%d type=%d ts=%u",
+  /* btWritePacket            */ "T38ModemMediaStream::WritePacket  packet %d size=%d %d",
+  /* btWritePacketMismatched  */ "T38ModemMediaStream::WritePacket: ignored packet with mismatched payload type",
+  /* btWritePacketRepeated    */ "T38ModemMediaStream::WritePacket: Repeated packet %d (expected %d)",
+  /* btWritePacketFake        */ "T38ModemMediaStream::WritePacket: Fake packet %d (expected %d)",
+  /* btWritePacketIgnoredFake */ "T38ModemMediaStream::WritePacket: ignored fake packet",
+  /* btWritePacketHeld        */ "T38ModemMediaStream::WritePacket: Held packet %d (expected %d)",
+  /* btHandlePacket           */ "T38Engine::HandlePacket Received ifp tag=%d type=%d fields=%d",
+};
+
+static PString Format(const char *format, const int *a)
+{
+  return psprintf(format, a[0], a[1], a[2], a[3], a[4]);
+}
+///////////////////////////////////////////////////////////////
+/*
+ * File layout (host byte order):
+ *
+ *   BinTraceFileHeader
+ *   chunks: BinTraceChunk + payload padded to 8 bytes
+ *
+ *     ckEvents   the formats of the events (NUL terminated in id order)
+ *     ckThread   NUL terminated name of the thread of the ring
+ *     ckRecords  BinTraceRecord[] of the ring
+ */
+#define BIN_TRACE_MAGIC    "T38BTRAC"
+#define BIN_TRACE_VERSION  1
+
+struct BinTraceFileHeader
+{
+  char magic[8];
+  DWORD version;
+  DWORD recordSize;
+};
+
+struct BinTraceChunk
+{
+  enum {
+    ckEvents = 1,
+    ckThread,
+    ckRecords,
+  };
+
+  DWORD kind;
+  DWORD id;			// ring id
+  DWORD size;			// payload size w/o padding
+  DWORD reserved;
+};
+
+static PINDEX Padded(PINDEX size)
+{
+  return (size + 7) & ~7;
+}
+
+struct BinTraceRecord
+{
+  PInt64 time;			// microseconds since the epoch
+  DWORD event;
+  int args[BinTraceArgs::size];
+};
+///////////////////////////////////////////////////////////////
+volatile PBoolean BinTrace::started = FALSE;
+///////////////////////////////////////////////////////////////
+#ifdef BIN_TRACE
+
+static const PINDEX RING_SIZE = 1024 * sizeof(BinTraceRecord);	// a power of 2
+static const int FLUSH_PERIOD = 100;				// ms
+///////////////////////////////////////////////////////////////
+class BinTraceRing : public PObject
+{
+    PCLASSINFO(BinTraceRing, PObject);
+  public:
+    BinTraceRing(DWORD _id, const PString &_threadName)
+      : id(_id)
+      , threadName(_threadName)
+      , q(RING_SIZE)
+      , closed(FALSE)
+      , dropped(0)
+      , droppedReported(0)
+      , announced(FALSE)
+      , next(NULL)
+    {}
+
+    const DWORD id;
+    const PString threadName;
+    PBYTERingQ q;
+    Atomic<int> closed;		// the thread was terminated
+    volatile DWORD dropped;	// changed by the thread only
+    DWORD droppedReported;	// changed by the writer only
+    PBoolean announced;		// changed by the writer only
+    BinTraceRing *next;
+};
+///////////////////////////////////////////////////////////////
+class BinTraceWriter : public PThread
+{
+    PCLASSINFO(BinTraceWriter, PThread);
+  public:
+    BinTraceWriter()
+      : PThread(30000, NoAutoDeleteThread, NormalPriority, "BinTrace")
+      , stopping(FALSE)
+    {}
+
+    PBoolean Open(const PString &path);
+    void Stop();
+    BinTraceRing *NewRing(const PString &threadName);
+    void SignalHalfFull() { halfFullSyncPoint.Signal(); }
+
+  protected:
+    virtual void Main();
+
+  private:
+    void Flush();
+    void WriteChunk(DWORD kind, DWORD id, const void *pData, PINDEX size);
+
+    PFile file;
+    PSyncPoint halfFullSyncPoint;
+    volatile PBoolean stopping;
+    PMutex Mutex;		// locks rings and nextId
+    BinTraceRing *rings;
+    DWORD nextId;
+};
+
+static BinTraceWriter *writer = NULL;
+static pthread_key_t ringKey;
+///////////////////////////////////////////////////////////////
+static void OnThreadExit(void *ring)
+{
+  ((BinTraceRing *)ring)->closed = TRUE;
+}
+
+PBoolean BinTraceWriter::Open(const PString &path)
+{
+  rings = NULL;
+  nextId = 0;
+
+  if (!file.Open(path, PFile::WriteOnly, PFile::Create|PFile::Truncate)) {
+    myPTRACE(1, "BinTrace::Start " << path << " ERROR: " << file.GetErrorText());
+    return FALSE;
+  }
+
+  BinTraceFileHeader header;
+
+  memcpy(header.magic, BIN_TRACE_MAGIC, sizeof(header.magic));
+  header.version = BIN_TRACE_VERSION;
+  header.recordSize = sizeof(BinTraceRecord);
+
+  file.Write(&header, sizeof(header));
+
+  PBYTEArray formats;
+
+  for (int i = 0 ; i < btNumberOfEvents ; i++)
+    formats.Concatenate(PBYTEArray((const BYTE *)eventFormats[i], (PINDEX)strlen(eventFormats[i]) + 1));
+
+  WriteChunk(BinTraceChunk::ckEvents, 0, formats, formats.GetSize());
+
+  return TRUE;
+}
+
+BinTraceRing *BinTraceWriter::NewRing(const PString &threadName)
+{
+  PWaitAndSignal mutexWait(Mutex);
+
+  BinTraceRing *ring = new BinTraceRing(nextId++, threadName);
+
+  ring->next = rings;
+  rings = ring;
+
+  return ring;
+}
+
+void BinTraceWriter::Stop()
+{
+  stopping = TRUE;
+  halfFullSyncPoint.Signal();
+  WaitForTermination();
+}
+
+void BinTraceWriter::Main()
+{
+  for (;;) {
+    halfFullSyncPoint.Wait(FLUSH_PERIOD);
+
+    // check stopping before draining, so the last drain follows the stop
+    PBoolean stop = stopping;
+
+    Flush();
+
+    if (stop)
+      break;
+  }
+
+  file.Close();
+}
+
+void BinTraceWriter::WriteChunk(DWORD kind, DWORD id, const void *pData, PINDEX size)
+{
+  static const BYTE padding[8] = { 0 };
+  BinTraceChunk chunk;
+
+  chunk.kind = kind;
+  chunk.id = id;
+  chunk.size = size;
+  chunk.reserved = 0;
+
+  file.Write(&chunk, sizeof(chunk));
+  file.Write(pData, size);
+
+  if (Padded(size) > size)
+    file.Write(padding, Padded(size) - size);
+}
+
+void BinTraceWriter::Flush()
+{
+  PWaitAndSignal mutexWait(Mutex);
+
+  for (BinTraceRing **pRing = &rings ; *pRing ;) {
+    BinTraceRing *ring = *pRing;
+
+    // check closed before draining, so nothing is put after the last drain
+    PBoolean closed = ring->closed;
+
+    if (!ring->announced) {
+      WriteChunk(BinTraceChunk::ckThread, ring->id,
+                 (const char *)ring->threadName, ring->threadName.GetLength() + 1);
+      ring->announced = TRUE;
+    }
+
+    DWORD dropped = ring->dropped;
+
+    if (dropped != ring->droppedReported) {
+      BinTraceRecord record;
+
+      memset(&record, 0, sizeof(record));
+      record.time = PTime().GetTimestamp();
+      record.event = btDropped;
+      record.args[0] = int(dropped - ring->droppedReported);
+
+      WriteChunk(BinTraceChunk::ckRecords, ring->id, &record, sizeof(record));
+      ring->droppedReported = dropped;
+    }
+
+    for (;;) {
+      PINDEX count = RING_SIZE;
+      const BYTE *pData = ring->q.GetBegin(count);
+
+      if (count == 0)
+        break;
+
+      WriteChunk(BinTraceChunk::ckRecords, ring->id, pData, count);
+      ring->q.GetEnd(count);
+    }
+
+    if (closed) {
+      *pRing = ring->next;
+      delete ring;
+    } else {
+      pRing = &ring->next;
+    }
+  }
+}
+#endif // BIN_TRACE
+///////////////////////////////////////////////////////////////
+PBoolean BinTrace::Start(const PString &path)
+{
+#ifdef BIN_TRACE
+  if (writer)
+    return FALSE;
+
+  BinTraceWriter *newWriter = new BinTraceWriter();
+
+  if (!newWriter->Open(path) || pthread_key_create(&ringKey, OnThreadExit) != 0) {
+    delete newWriter;
+    return FALSE;
+  }
+
+  writer = newWriter;
+  writer->Resume();
+
+  myMemoryBarrier();		// the writer is ready before it's used
+  started = TRUE;
+
+  myPTRACE(1, "BinTrace::Start " << path);
+
+  return TRUE;
+#else
+  myPTRACE(1, "BinTrace::Start " << path << " ERROR: not supported");
+  return FALSE;
+#endif
+}
+
+void BinTrace::Stop()
+{
+#ifdef BIN_TRACE
+  if (!started)
+    return;
+
+  started = FALSE;
+  myMemoryBarrier();		// the new events go to myPTRACE()
+
+  // the writer and the rings are not deleted, the threads that are
+  // in Output() yet can still use them
+  writer->Stop();
+
+  myPTRACE(1, "BinTrace::Stop");
+#endif
+}
+
+void BinTrace::Output(unsigned level, BinTraceEvent event, const BinTraceArgs &args)
+{
+#ifdef BIN_TRACE
+  if (started) {
+    BinTraceRing *ring = (BinTraceRing *)pthread_getspecific(ringKey);
+
+    if (ring == NULL) {
+      PThread *thread = PThread::Current();
+
+      ring = writer->NewRing(thread ? thread->GetThreadName() : PString("Unknown"));
+      pthread_setspecific(ringKey, ring);
+    }
+
+    if (ring->q.GetFree() < (PINDEX)sizeof(BinTraceRecord)) {
+      ring->dropped++;
+      return;
+    }
+
+    BinTraceRecord record;
+
+    record.time = PTime().GetTimestamp();
+    record.event = event;
+    memcpy(record.args, args.a, sizeof(record.args));
+
+    ring->q.Put(&record, sizeof(record));
+
+    // do not wait the flush period if the thread is too fast
+    if (ring->q.GetCount() == RING_SIZE/2)
+      writer->SignalHalfFull();
+
+    return;
+  }
+#endif
+
+  myPTRACE(level, Format(eventFormats[event], args.a));
+}
+///////////////////////////////////////////////////////////////
+struct BinTraceDecodedRecord
+{
+  const BinTraceRecord *record;
+  DWORD id;
+  PINDEX seq;			// keeps the order of the records with equal time
+};
+
+static int CompareRecords(const void *p1, const void *p2)
+{
+  const BinTraceDecodedRecord *r1 = (const BinTraceDecodedRecord *)p1;
+  const BinTraceDecodedRecord *r2 = (const BinTraceDecodedRecord *)p2;
+
+  if (r1->record->time != r2->record->time)
+    return r1->record->time < r2->record->time ? -1 : 1;
+
+  return r1->seq < r2->seq ? -1 : (r1->seq > r2->seq ? 1 : 0);
+}
+
+PBoolean BinTrace::Decode(const PString &path, ostream &out)
+{
+  PFile file;
+
+  if (!file.Open(path, PFile::ReadOnly, PFile::MustExist)) {
+    out << path << ": " << file.GetErrorText() << endl;
+    return FALSE;
+  }
+
+  PBYTEArray data;
+  PINDEX size = (PINDEX)file.GetLength();
+
+  if (!file.Read(data.GetPointer(size), size) || file.GetLastReadCount() != size) {
+    out << path << ": " << file.GetErrorText() << endl;
+    return FALSE;
+  }
+
+  const BinTraceFileHeader *header = (const BinTraceFileHeader *)(const BYTE *)data;
+
+  if (size < (PINDEX)sizeof(BinTraceFileHeader)
+      || memcmp(header->magic, BIN_TRACE_MAGIC, sizeof(header->magic)) != 0
+      || header->version != BIN_TRACE_VERSION
+      || header->recordSize != sizeof(BinTraceRecord))
+  {
+    out << path << ": invalid binary trace file" << endl;
+    return FALSE;
+  }
+
+  PStringArray formats;
+  PStringArray threadNames;
+  PBYTEArray recordsBuf;
+  PINDEX numRecords = 0;
+
+  for (PINDEX offset = sizeof(BinTraceFileHeader) ; offset + (PINDEX)sizeof(BinTraceChunk) <= size ;) {
+    const BinTraceChunk *chunk = (const BinTraceChunk *)((const BYTE *)data + offset);
+    const BYTE *payload = (const BYTE *)(chunk + 1);
+    PINDEX len = chunk->size;
+
+    offset += sizeof(BinTraceChunk);
+
+    if (len < 0 || Padded(len) > size - offset)
+      break;				// truncated by the killed process
+
+    offset += Padded(len);
+
+    switch (chunk->kind) {
+      case BinTraceChunk::ckEvents:
+        for (PINDEX i = 0 ; i < len ;) {
+          PString format((const char *)payload + i);
+
+          formats.AppendString(format);
+          i += format.GetLength() + 1;
+        }
+        break;
+      case BinTraceChunk::ckThread:
+        if (threadNames.GetSize() <= (PINDEX)chunk->id)
+          threadNames.SetSize(chunk->id + 1);
+
+        threadNames[chunk->id] = PString((const char *)payload, len ? len - 1 : 0);
+        break;
+      case BinTraceChunk::ckRecords: {
+        PINDEX needed = (numRecords + len/(PINDEX)sizeof(BinTraceRecord)) * sizeof(BinTraceDecodedRecord);
+
+        // grow geometrically, there are a lot of small chunks
+        if (recordsBuf.GetSize() < needed)
+          recordsBuf.SetSize(PMAX(needed, 2*recordsBuf.GetSize()));
+
+        BinTraceDecodedRecord *decoded = (BinTraceDecodedRecord *)recordsBuf.GetPointer() + numRecords;
+
+        for (PINDEX i = 0 ; i + (PINDEX)sizeof(BinTraceRecord) <= len ; i += sizeof(BinTraceRecord)) {
+          decoded->record = (const BinTraceRecord *)(payload + i);
+          decoded->id = chunk->id;
+          decoded->seq = numRecords++;
+          decoded++;
+        }
+        break;
+      }
+    }
+  }
+
+  BinTraceDecodedRecord *records = (BinTraceDecodedRecord *)recordsBuf.GetPointer();
+
+  qsort(records, numRecords, sizeof(BinTraceDecodedRecord), CompareRecords);
+
+  for (PINDEX i = 0 ; i < numRecords ; i++) {
+    const BinTraceRecord &record = *records[i].record;
+    PTime time(time_t(record.time / 1000000), long(record.time % 1000000));
+    PString threadName;
+
+    if ((PINDEX)records[i].id < threadNames.GetSize())
+      threadName = threadNames[records[i].id];
+
+    out << time.AsString("yyyy/MM/dd hh:mm:ss.uuu") << '\t'
+        << setw(23) << threadName << "\t\t";
+
+    if (record.event < (DWORD)formats.GetSize())
+      out << Format(formats[record.event], record.args);
+    else
+      out << "Unknown event " << record.event;
+
+    out << '\n';
+  }
+
+  out << flush;
+
+  return TRUE;
+}
+///////////////////////////////////////////////////////////////
+
+#endif // PTRACING
+
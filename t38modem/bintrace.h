@@ -0,0 +1,132 @@
+/*
+ * bintrace.h
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: bintrace.h,v $
+ *
+ */
+
+#ifndef _BINTRACE_H
+#define _BINTRACE_H
+
+#if PTRACING && defined(P_PTHREADS)
+  #define BIN_TRACE
+#endif
+
+///////////////////////////////////////////////////////////////
+/*
+ * Events of the hot paths.
+ *
+ * Each event is an id and up to BinTraceArgs::size integer arguments.
+ * The text of the event is rendered by the printf format in the events
+ * table of bintrace.cxx.
+ */
+enum BinTraceEvent {
+  btDropped,			// records dropped by a full ring
+  btReadPacket,
+  btWritePacket,
+  btWritePacketMismatched,
+  btWritePacketRepeated,
+  btWritePacketFake,
+  btWritePacketIgnoredFake,
+  btWritePacketHeld,
+  btHandlePacket,
+  btNumberOfEvents
+};
+
+struct BinTraceArgs
+{
+  enum { size = 5 };
+
+  BinTraceArgs(int a0 = 0, int a1 = 0, int a2 = 0, int a3 = 0, int a4 = 0) {
+    a[0] = a0; a[1] = a1; a[2] = a2; a[3] = a3; a[4] = a4;
+  }
+
+  int a[size];
+};
+///////////////////////////////////////////////////////////////
+/*
+ * Binary tracing.
+ *
+ * If the binary trace was started then Output() puts the event with a
+ * time stamp to the lock-free ring of the current thread and a writer
+ * thread drains the rings to the file, so the traced threads never format
+ * text and never wait for the trace file. Otherwise Output() formats the
+ * event and outputs it by myPTRACE().
+ *
+ * Stop() drains all rings to the file and closes it, the later events
+ * are output by myPTRACE().
+ *
+ * Decode() renders the file to the text of PTRACE() output.
+ */
+class BinTrace
+{
+  public:
+  /**@name Operations */
+  //@{
+    static PBoolean Start(
+      const PString &path
+    );
+
+    static void Stop();
+
+    static PBoolean IsStarted() { return started; }
+
+    static void Output(
+      unsigned level,
+      BinTraceEvent event,
+      const BinTraceArgs &args
+    );
+
+    static PBoolean Decode(
+      const PString &path,
+      ostream &out
+    );
+  //@}
+
+  private:
+    static volatile PBoolean started;
+};
+///////////////////////////////////////////////////////////////
+#if PTRACING
+
+#ifdef MYPTRACE_LEVEL
+#define myBTRACE(level, event, args) do { \
+  if (myCanTrace(MYPTRACE_LEVEL)) BinTrace::Output(MYPTRACE_LEVEL, event, BinTraceArgs args); \
+} while(0)
+#else
+#define myBTRACE(level, event, args) do { \
+  if (myCanTrace(level)) BinTrace::Output(level, event, BinTraceArgs args); \
+} while(0)
+#endif // MYPTRACE_LEVEL
+
+#else
+
+#define myBTRACE(level, event, args)
+
+#endif // PTRACING
+///////////////////////////////////////////////////////////////
+
+#endif  // _BINTRACE_H
+
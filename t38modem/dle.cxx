@@ -69,6 +69,12 @@
 
 ///////////////////////////////////////////////////////////////
 
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) && \
+    (defined(__x86_64__) || defined(__i386__))
+  #include <immintrin.h>
+  #define DLE_X86
+#endif
+
 #define new PNEW
 
 ///////////////////////////////////////////////////////////////
@@ -89,6 +95,112 @@ static PBoolean initBitRevTable()
 }
 
 static const PBoolean ___InitBitRevTable = initBitRevTable();
+
+static void BitRevCopyTable(BYTE *pDst, const BYTE *pSrc, PINDEX count)
+{
+  for ( ; count > 0 ; count--)
+    *(pDst++) = BitRevTable[*(pSrc++)];
+}
+
+#ifdef DLE_X86
+__attribute__((target("sse2")))
+static void BitRevCopySse2(BYTE *pDst, const BYTE *pSrc, PINDEX count)
+{
+  const __m128i m1 = _mm_set1_epi8(0x55);
+  const __m128i m2 = _mm_set1_epi8(0x33);
+  const __m128i m4 = _mm_set1_epi8(0x0F);
+
+  for ( ; count >= 16 ; count -= 16, pSrc += 16, pDst += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)pSrc);
+
+    // swap adjacent bits, bit pairs and nibbles in each byte
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), m1), _mm_slli_epi16(_mm_and_si128(x, m1), 1));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), m2), _mm_slli_epi16(_mm_and_si128(x, m2), 2));
+    x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), m4), _mm_slli_epi16(_mm_and_si128(x, m4), 4));
+
+    _mm_storeu_si128((__m128i *)pDst, x);
+  }
+
+  BitRevCopyTable(pDst, pSrc, count);
+}
+
+__attribute__((target("ssse3")))
+static void BitRevCopySsse3(BYTE *pDst, const BYTE *pSrc, PINDEX count)
+{
+  // reversed low nibble to the high one and reversed high nibble to the low one
+  const __m128i revLo = _mm_setr_epi8(
+      0x00, (char)0x80, 0x40, (char)0xC0, 0x20, (char)0xA0, 0x60, (char)0xE0,
+      0x10, (char)0x90, 0x50, (char)0xD0, 0x30, (char)0xB0, 0x70, (char)0xF0);
+  const __m128i revHi = _mm_setr_epi8(
+      0x00, 0x08, 0x04, 0x0C, 0x02, 0x0A, 0x06, 0x0E,
+      0x01, 0x09, 0x05, 0x0D, 0x03, 0x0B, 0x07, 0x0F);
+  const __m128i m4 = _mm_set1_epi8(0x0F);
+
+  for ( ; count >= 16 ; count -= 16, pSrc += 16, pDst += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)pSrc);
+
+    x = _mm_or_si128(_mm_shuffle_epi8(revLo, _mm_and_si128(x, m4)),
+                     _mm_shuffle_epi8(revHi, _mm_and_si128(_mm_srli_epi16(x, 4), m4)));
+
+    _mm_storeu_si128((__m128i *)pDst, x);
+  }
+
+  BitRevCopyTable(pDst, pSrc, count);
+}
+
+static int HasSse2() { __builtin_cpu_init(); return __builtin_cpu_supports("sse2"); }
+static int HasSsse3() { __builtin_cpu_init(); return __builtin_cpu_supports("ssse3"); }
+#endif
+
+static const struct {
+  const char *name;
+  BitRevCopyFunc func;
+  int (*supported)();
+} BitRevCopyImpls[] = {
+  { "table", BitRevCopyTable, NULL },
+#ifdef DLE_X86
+  { "sse2",  BitRevCopySse2,  HasSse2 },
+  { "ssse3", BitRevCopySsse3, HasSsse3 },
+#endif
+};
+
+enum {
+  NUM_BITREVCOPY_IMPLS = sizeof(BitRevCopyImpls)/sizeof(BitRevCopyImpls[0]),
+};
+
+// the last one supported by the CPU
+static PINDEX SelectBitRevCopy()
+{
+  PINDEX i = NUM_BITREVCOPY_IMPLS - 1;
+
+  while (i > 0 && !BitRevCopyImpls[i].supported())
+    i--;
+
+  return i;
+}
+
+static const PINDEX BitRevCopySelected = SelectBitRevCopy();
+static const BitRevCopyFunc BitRevCopy = BitRevCopyImpls[BitRevCopySelected].func;
+
+const char *GetBitRevCopy(PINDEX i, BitRevCopyFunc &func)
+{
+  if (i < 0 || i >= NUM_BITREVCOPY_IMPLS) {
+    func = NULL;
+    return NULL;
+  }
+
+  if (BitRevCopyImpls[i].supported && !BitRevCopyImpls[i].supported())
+    func = NULL;
+  else
+    func = BitRevCopyImpls[i].func;
+
+  return BitRevCopyImpls[i].name;
+}
+
+const char *GetBitRevCopyName()
+{
+  return BitRevCopyImpls[BitRevCopySelected].name;
+}
 ///////////////////////////////////////////////////////////////
 enum {
   ETX = 0x03,
@@ -138,13 +250,13 @@ int DLEData::PutDleData(const void *pBuf, PINDEX count)
   
     if( cPut ) {
       if( bitRev ) {
-        BYTE tmp[1024];
+        const BYTE *pSrc = p;
         while( cPut ) {
-          PINDEX cTmp = cPut > 1024 ? 1024 : cPut;
-          for( PINDEX i = 0 ; i < cTmp ; i++ ) {
-            tmp[i] = BitRevTable[p[i]];
-          }
-          PutData(tmp, cTmp);
+          PINDEX cTmp = cPut;
+          BYTE *pDst = PutBegin(cTmp);
+          BitRevCopy(pDst, pSrc, cTmp);
+          PutEnd(cTmp);
+          pSrc += cTmp;
           cPut -= cTmp;
         }
       } else {
@@ -168,27 +280,43 @@ int DLEData::GetDleData(void *pBuf, PINDEX count)
 
   for (done = 0 ; (count - done) >= 4 ; done = int(p - (BYTE *)pBuf)) {
     PINDEX cGet = (count - done - 2) / 2;
-    BYTE tmp[1024];
-
-    if (cGet > (PINDEX)sizeof(tmp))
-      cGet = sizeof(tmp);
+    const BYTE *pGet = GetBegin(cGet);
 
-    switch( cGet = GetData(tmp, cGet) ) {
-      case -1:
+    if (!cGet) {
+      if (GetData(NULL, 0) < 0) {
         *p++ = DLE;
         *p++ = ETX;
         recvEtx = TRUE;
-        return int(p - (BYTE *)pBuf);
-      case 0:
-        return int(p - (BYTE *)pBuf);
-      default:
-        for( PINDEX i = 0 ; i < cGet ; i++ ) {
-          BYTE b = bitRev ? BitRevTable[tmp[i]] : tmp[i];
-          if( b == DLE )
-            *p++ = DLE;
-          *p++ = b;
-        }
+      }
+      return int(p - (BYTE *)pBuf);
     }
+
+    // copy the runs between DLE codes and shield the DLE codes
+    const BYTE dleGet = bitRev ? BitRevTable[DLE] : BYTE(DLE);
+    PINDEX cRest = cGet;
+
+    while( cRest > 0 ) {
+      const BYTE *pDle = (const BYTE *)memchr(pGet, dleGet, cRest);
+      PINDEX cCopy = pDle ? PINDEX(pDle - pGet) : cRest;
+
+      if( bitRev )
+        BitRevCopy(p, pGet, cCopy);
+      else
+        memcpy(p, pGet, cCopy);
+
+      p += cCopy;
+      pGet += cCopy;
+      cRest -= cCopy;
+
+      if( pDle ) {
+        *p++ = DLE;
+        *p++ = DLE;
+        pGet++;
+        cRest--;
+      }
+    }
+
+    GetEnd(cGet);
   }
   return done;
 }
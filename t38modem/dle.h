@@ -69,6 +69,20 @@ class DLEData : public DataStream
     PBoolean bitRev;
 };
 ///////////////////////////////////////////////////////////////
+/*
+ * Implementations of the bit reversing copy, selected at run time by the
+ * CPU features. The first one is the BitRevTable lookup and the others
+ * must give the same result (for tests and benchmarks).
+ *
+ * GetBitRevCopy(i) returns the name of the i-th implementation (NULL if
+ * there is no such one) and sets func to it or to NULL if the CPU does not
+ * support it. GetBitRevCopyName() returns the name of the selected one.
+ */
+typedef void (*BitRevCopyFunc)(BYTE *pDst, const BYTE *pSrc, PINDEX count);
+
+const char *GetBitRevCopy(PINDEX i, BitRevCopyFunc &func);
+const char *GetBitRevCopyName();
+///////////////////////////////////////////////////////////////
 
 #endif  // _DLE_H
 
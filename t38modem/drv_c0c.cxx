@@ -359,20 +359,19 @@ void OutC0C::Main()
   if (!PrepareEvents(EVENT_NUM, hEvents, overlaps))
     SignalStop();
 
-  PBYTEArray *buf = NULL;
-  PINDEX done = 0;
+  const BYTE *pBuf = NULL;
+  PINDEX count = 0;
   DWORD written = 0;
   BOOL waitingWrite = FALSE;
 
   for(;;) {
-    while (!buf) {
+    while (!count) {
       if (stop)
         break;
-      buf = Parent().FromOutPtyQ();
-      if (buf) {
-        done = 0;
+      count = P_MAX_INDEX;
+      pBuf = Parent().FromOutPtyQ(count);
+      if (count)
         break;
-      }
       WaitDataReady();
     }
 
@@ -380,7 +379,7 @@ void OutC0C::Main()
       break;
 
     if (!waitingWrite) {
-      if (!WriteFile(hC0C, (const BYTE *)*buf + done, buf->GetSize() - done, &written, &overlaps[EVENT_WRITE])) {
+      if (!WriteFile(hC0C, pBuf, count, &written, &overlaps[EVENT_WRITE])) {
         DWORD err = ::GetLastError();
         if (err != ERROR_IO_PENDING) {
           myPTRACE(1, "WriteFile() ERROR " << strError(err));
@@ -434,28 +433,23 @@ void OutC0C::Main()
     }
 
     if (!waitingWrite && written) {
-      PTRACE(6, "<-- " << PRTHEX(PBYTEArray((const BYTE *)*buf + done, written)));
-
-      done += written;
+      PTRACE(6, "<-- " << PRTHEX(PBYTEArray(pBuf, written)));
 
-      if (buf->GetSize() <= done) {
-        if (buf->GetSize() < done) {
-          myPTRACE(1, "<-- " << buf->GetSize() << "(size) < (done)" << done << " " << written);
-        }
-        delete buf;
-        buf = NULL;
+      if (count < (PINDEX)written) {
+        myPTRACE(1, "<-- " << count << "(size) < (done)" << written);
+        written = count;
       }
+
+      Parent().FromOutPtyQDone(written);
+      count = 0;
       written = 0;
     }
   }
 
   CancelIo(hC0C);
 
-  if (buf) {
-    if (buf->GetSize() != done)
-      myPTRACE(1, "<-- Not sent " << PRTHEX(PBYTEArray((const BYTE *)*buf + done, buf->GetSize() - done)));
-    delete buf;
-  }
+  if (count)
+    myPTRACE(1, "<-- Not sent " << PRTHEX(PBYTEArray(pBuf, count)));
 
   CloseEvents(EVENT_NUM, hEvents);
 
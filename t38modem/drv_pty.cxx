@@ -94,9 +94,40 @@
 #ifdef MODEM_DRIVER_Pty
 
 #include <sys/poll.h>
+#include <sys/uio.h>
+#include "reactor.h"
+#include "stats.h"
+
+#ifdef MODEM_REACTOR
+  #include <sys/epoll.h>
+#endif
 
 #define new PNEW
 
+///////////////////////////////////////////////////////////////
+static const PINDEX MAX_writeBatch = 1024;
+
+static int WritePty(int hPty, const BYTE * const pBuf[2], const PINDEX count[2])
+{
+  iovec iov[2];
+
+  iov[0].iov_base = (void *)pBuf[0];
+  iov[0].iov_len = count[0];
+  iov[1].iov_base = (void *)pBuf[1];
+  iov[1].iov_len = count[1];
+
+  return ::writev(hPty, iov, count[1] ? 2 : 1);
+}
+
+#if PTRACING
+static PString CallsPerKiB(PUInt64 calls, PUInt64 bytes)
+{
+  if (!bytes)
+    return PString();
+
+  return psprintf(" (%.2f per KiB)", (double)(PInt64)calls * 1024 / (double)(PInt64)bytes);
+}
+#endif
 ///////////////////////////////////////////////////////////////
 class UniPty : public ModemThreadChild
 {
@@ -126,6 +157,27 @@ class OutPty : public UniPty
     virtual void Main();
 };
 ///////////////////////////////////////////////////////////////
+#ifdef MODEM_REACTOR
+class ReactorPty : public UniPty
+{
+    PCLASSINFO(ReactorPty, UniPty);
+  public:
+    ReactorPty(PseudoModemPty &_parent, int _hPty, ModemReactor &_reactor);
+    ~ReactorPty();
+    PBoolean Start();
+    void Stop();
+    virtual void SignalDataReady() { task.Schedule(); }
+  protected:
+    virtual void Main() {}
+    PDECLARE_NOTIFIER(ModemReactorTask, ReactorPty, OnReactorTask);
+
+    ModemReactorTask task;
+    PBoolean readable;
+    PBoolean writable;
+    int armed;
+};
+#endif // MODEM_REACTOR
+///////////////////////////////////////////////////////////////
 UniPty::UniPty(PseudoModemPty &_parent, int _hPty)
   : ModemThreadChild(_parent),
     hPty(_hPty)
@@ -161,6 +213,7 @@ void InPty::Main()
         break;
 
       len = ::read(hPty, cbuf, sizeof(cbuf));
+      ModemStats::Add(Parent().Stats().ptyReadCalls);
 
       if (len < 0) {
         int err = errno;
@@ -175,6 +228,7 @@ void InPty::Main()
       }
 
       if (len > 0) {
+        ModemStats::Add(Parent().Stats().ptyReadBytes, len);
         Parent().ToInPtyQ(cbuf, len);
         if (stop)
           break;
@@ -195,8 +249,9 @@ void OutPty::Main()
   RenameCurrentThread(Parent().ptyName() + "(o)");
   myPTRACE(1, "<-- Started");
 
-  PBYTEArray *buf = NULL;
-  PINDEX done = 0;
+  const BYTE *pBuf[2];
+  PINDEX count[2];
+  PINDEX busy = 0;
 
   for (;;) {
     pollfd pollfd;
@@ -204,20 +259,43 @@ void OutPty::Main()
     pollfd.fd = hPty;
     pollfd.events = POLLOUT;
 
-    while (!buf) {
+    while (!busy) {
       if (stop)
         break;
-      buf = Parent().FromOutPtyQ();
-      if (buf) {
-        done = 0;
+      busy = Parent().FromOutPtyQ(pBuf, count);
+      if (busy)
         break;
-      }
       WaitDataReady();
     }
 
     if (stop)
       break;
 
+    if (Parent().writeDelay && busy < MAX_writeBatch) {
+      // collect the following chunks of a burst for one write
+      PTime end = PTime() + PTimeInterval(Parent().writeDelay);
+
+      for (;;) {
+        PTimeInterval rest = end - PTime();
+
+        if (rest <= 0)
+          break;
+
+        dataReadySyncPoint.Wait(rest);
+
+        if (stop)
+          break;
+
+        busy = Parent().FromOutPtyQ(pBuf, count);
+
+        if (busy >= MAX_writeBatch)
+          break;
+      }
+
+      if (stop)
+        break;
+    }
+
     ::poll(&pollfd, 1, 5000);
 
     if (pollfd.revents) {
@@ -226,7 +304,8 @@ void OutPty::Main()
       if (stop)
         break;
 
-      len = ::write(hPty, (const BYTE *)*buf + done, buf->GetSize() - done);
+      len = WritePty(hPty, pBuf, count);
+      ModemStats::Add(Parent().Stats().ptyWriteCalls);
 
       if (len < 0) {
         int err = errno;
@@ -235,26 +314,158 @@ void OutPty::Main()
         break;
       }
 
-      done += len;
-      if (buf->GetSize() <= done) {
-        if (buf->GetSize() < done) {
-          myPTRACE(1, "<-- " << buf->GetSize() << "(size) < (done)" << done << " " << len);
-        }
-        delete buf;
-        buf = NULL;
+      if (busy < len) {
+        myPTRACE(1, "<-- " << busy << "(size) < (done)" << len);
+        len = busy;
       }
+
+      ModemStats::Add(Parent().Stats().ptyWriteBytes, len);
+      Parent().FromOutPtyQDone(len);
+      busy = 0;
     }
   }
 
-  if (buf) {
-    if (buf->GetSize() != done)
-      myPTRACE(1, "<-- Not sent " << PRTHEX(PBYTEArray((const BYTE *)*buf + done, buf->GetSize() - done)));
-    delete buf;
+  if (busy) {
+    PBYTEArray notSent(pBuf[0], count[0]);
+
+    notSent.Concatenate(PBYTEArray(pBuf[1], count[1]));
+    myPTRACE(1, "<-- Not sent " << PRTHEX(notSent));
   }
 
   myPTRACE(1, "<-- Stopped" << GetThreadTimes(", CPU usage: "));
 }
 ///////////////////////////////////////////////////////////////
+#ifdef MODEM_REACTOR
+ReactorPty::ReactorPty(PseudoModemPty &_parent, int _hPty, ModemReactor &_reactor)
+  : UniPty(_parent, _hPty),
+    task(_reactor, PCREATE_NOTIFIER(OnReactorTask)),
+    readable(FALSE),
+    writable(TRUE),
+    armed(0)
+{
+}
+
+ReactorPty::~ReactorPty()
+{
+  task.Detach();
+
+  PINDEX count = P_MAX_INDEX;
+  const BYTE *pBuf = Parent().FromOutPtyQ(count);
+
+  if (count)
+    myPTRACE(1, "<-> Not sent " << PRTHEX(PBYTEArray(pBuf, count)));
+}
+
+PBoolean ReactorPty::Start()
+{
+  int flags = ::fcntl(hPty, F_GETFL);
+
+  if (flags < 0 || ::fcntl(hPty, F_SETFL, flags | O_NONBLOCK) < 0) {
+    int err = errno;
+    myPTRACE(1, "<-> fcntl " << Parent().ptyName() << " ERROR: " << strerror(err));
+    return FALSE;
+  }
+
+  if (!task.Attach(hPty))
+    return FALSE;
+
+  myPTRACE(1, "<-> Started in reactor for " << Parent().ptyName());
+
+  task.Schedule();
+
+  return TRUE;
+}
+
+void ReactorPty::Stop()
+{
+  SignalStop();
+  task.Detach();
+
+  myPTRACE(1, "<-> Stopped in reactor for " << Parent().ptyName());
+}
+
+void ReactorPty::OnReactorTask(ModemReactorTask &, INT events)
+{
+  if (stop)
+    return;
+
+  if (events) {
+    // EPOLLONESHOT disabled the pty
+    armed = 0;
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+      readable = TRUE;
+
+    if (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))
+      writable = TRUE;
+  }
+
+  PINDEX free;
+
+  while (readable && (free = Parent().GetInPtyQFree()) > 0) {
+    char cbuf[1024];
+    int len = ::read(hPty, cbuf, free < (PINDEX)sizeof(cbuf) ? free : (PINDEX)sizeof(cbuf));
+    ModemStats::Add(Parent().Stats().ptyReadCalls);
+
+    if (len < 0) {
+      int err = errno;
+
+      if (err == EAGAIN || err == EINTR) {
+        readable = (err == EINTR);
+        continue;
+      }
+
+      myPTRACE(1, "--> read " << Parent().ptyName() << " ERROR " << len << " " << strerror(err));
+      SignalStop();
+      return;
+    }
+
+    if (len == 0) {
+      SignalStop();
+      return;
+    }
+
+    ModemStats::Add(Parent().Stats().ptyReadBytes, len);
+    Parent().ToInPtyQ(cbuf, len);
+
+    if (stop)
+      return;
+  }
+
+  while (writable) {
+    const BYTE *pBuf[2];
+    PINDEX count[2];
+
+    if (!Parent().FromOutPtyQ(pBuf, count))
+      break;
+
+    int len = WritePty(hPty, pBuf, count);
+    ModemStats::Add(Parent().Stats().ptyWriteCalls);
+
+    if (len < 0) {
+      int err = errno;
+
+      if (err == EAGAIN || err == EINTR) {
+        writable = (err == EINTR);
+        continue;
+      }
+
+      myPTRACE(1, "<-- write " << Parent().ptyName() << " ERROR " << len << " " << strerror(err));
+      SignalStop();
+      return;
+    }
+
+    ModemStats::Add(Parent().Stats().ptyWriteBytes, len);
+    Parent().FromOutPtyQDone(len);
+  }
+
+  int want = (readable ? 0 : int(EPOLLIN)) | (writable ? 0 : int(EPOLLOUT));
+
+  if (want != armed && task.Arm(want))
+    armed = want;
+}
+#endif // MODEM_REACTOR
+///////////////////////////////////////////////////////////////
 #ifdef USE_LEGACY_PTY
 static const char *ttyPatternLegacy()
 {
@@ -312,20 +523,31 @@ static void ttyUnlinkUnix98(const char *ttypath)
 PseudoModemPty::PseudoModemPty(
     const PString &_tty,
     const PString &_route,
-#ifdef USE_UNIX98_PTY
     const PConfigArgs &args,
-#else
-    const PConfigArgs &/*args*/,
-#endif
     const PNotifier &_callbackEndPoint)
 
   : PseudoModemBody(_tty, _route, _callbackEndPoint),
     hPty(-1),
     inPty(NULL),
-    outPty(NULL)
+    outPty(NULL),
+    reactor(NULL),
+    reactorPty(NULL),
+    writeDelay(0)
 {
   valid = TRUE;
 
+  if (args.HasOption("pty-write-delay"))
+    writeDelay = args.GetOptionString("pty-write-delay").AsUnsigned();
+
+#ifdef MODEM_REACTOR
+  if (args.HasOption("pty-reactor")) {
+    reactor = ModemReactor::GetReactor(args.GetOptionString("pty-reactor").AsUnsigned());
+
+    if (reactor == NULL)
+      myPTRACE(1, "PseudoModemPty::PseudoModemPty can't use reactor for " << _tty);
+  }
+#endif
+
 #ifdef USE_LEGACY_PTY
   if (ttyCheckLegacy(_tty)) {
     if (_tty[0] != '/')
@@ -394,6 +616,10 @@ PString PseudoModemPty::ArgSpec()
 #ifdef USE_UNIX98_PTY
         "-pts-dir:"
 #endif
+#ifdef MODEM_REACTOR
+        "-pty-reactor:"
+#endif
+        "-pty-write-delay:"
         "";
 }
 
@@ -409,9 +635,23 @@ PStringArray PseudoModemPty::Description()
         "For Unix98 ptys the tty should match to the regexp\n"
         "  '" + PString(ttyPatternUnix98()) + "'\n"
         "(the first character '+' will be replaced by a base directory).\n"
+#endif
         "Options:\n"
+#ifdef USE_UNIX98_PTY
         "  --pts-dir dir         : Set a base directory for Unix98 scheme,\n"
         "                          default is empty.\n"
+#endif
+#ifdef MODEM_REACTOR
+        "  --pty-reactor num     : Serve all ptys and modem engines by num\n"
+        "                          worker threads (0 - by number of CPUs)\n"
+        "                          instead of three threads per pty.\n"
+#endif
+        "  --pty-write-delay ms  : Collect the output for up to ms milliseconds\n"
+        "                          before writing it to the pty (default 0).\n"
+        "                          It reduces the number of write calls on\n"
+        "                          data bursts, but delays the responses.\n"
+#ifdef MODEM_REACTOR
+        "                          Not used with --pty-reactor.\n"
 #endif
   ).Lines();
 
@@ -425,11 +665,31 @@ const PString &PseudoModemPty::ttyPath() const
 
 ModemThreadChild *PseudoModemPty::GetPtyNotifier()
 {
+#ifdef MODEM_REACTOR
+  if (reactorPty)
+    return reactorPty;
+#endif
+
   return outPty;
 }
 
 PBoolean PseudoModemPty::StartAll()
 {
+#ifdef MODEM_REACTOR
+  if (reactor) {
+    if (IsOpenPty()
+       && (reactorPty = new ReactorPty(*this, hPty, *reactor))
+       && (reactorPty->Start())
+       && (PseudoModemBody::StartAll())
+       ) {
+      return TRUE;
+    }
+    StopAll();
+    ClosePty();
+    return FALSE;
+  }
+#endif
+
   if (IsOpenPty()
      && (inPty = new InPty(*this, hPty))
      && (outPty = new OutPty(*this, hPty))
@@ -446,6 +706,14 @@ PBoolean PseudoModemPty::StartAll()
 
 void PseudoModemPty::StopAll()
 {
+#ifdef MODEM_REACTOR
+  if (reactorPty) {
+    reactorPty->Stop();
+    PWaitAndSignal mutexWait(Mutex);
+    delete reactorPty;
+    reactorPty = NULL;
+  }
+#endif
   if (inPty) {
     inPty->SignalStop();
     inPty->WaitForTermination();
@@ -460,6 +728,17 @@ void PseudoModemPty::StopAll()
     delete outPty;
     outPty = NULL;
   }
+
+#if PTRACING
+  const ModemStats &stats = Stats();
+
+  myPTRACE(1, "PseudoModemPty::StopAll " << ptyName()
+      << " read " << stats.ptyReadCalls << " calls, " << stats.ptyReadBytes << " bytes"
+      << CallsPerKiB(stats.ptyReadCalls, stats.ptyReadBytes)
+      << ", write " << stats.ptyWriteCalls << " calls, " << stats.ptyWriteBytes << " bytes"
+      << CallsPerKiB(stats.ptyWriteCalls, stats.ptyWriteBytes));
+#endif
+
   PseudoModemBody::StopAll();
 }
 
@@ -488,9 +767,8 @@ PBoolean PseudoModemPty::OpenPty()
         ClosePty();
         myPTRACE(1, "PseudoModemPty::OpenPty read ERROR " << len << " " << strerror(err));
       } else if (len > 0) {
-        PBYTEArray *buf = new PBYTEArray((const BYTE *)cbuf, len);
-        myPTRACE(3, "PseudoModemPty::OpenPty read " << PRTHEX(*buf));
-        ToInPtyQ(buf);
+        myPTRACE(3, "PseudoModemPty::OpenPty read " << PRTHEX(PBYTEArray((const BYTE *)cbuf, len)));
+        PutInPtyQ(cbuf, len);
       }
     }
     if (IsOpenPty()) {
@@ -64,6 +64,7 @@
 ///////////////////////////////////////////////////////////////
 class InPty;
 class OutPty;
+class ReactorPty;
 
 class PseudoModemPty : public PseudoModemBody
 {
@@ -93,6 +94,7 @@ class PseudoModemPty : public PseudoModemBody
   //@{
     const PString &ttyPath() const;
     ModemThreadChild *GetPtyNotifier();
+    ModemReactor *GetReactor() const { return reactor; }
     PBoolean StartAll();
     void StopAll();
     void MainLoop();
@@ -106,12 +108,17 @@ class PseudoModemPty : public PseudoModemBody
     int hPty;
     InPty *inPty;
     OutPty *outPty;
+    ModemReactor *reactor;
+    ReactorPty *reactorPty;
+
+    PINDEX writeDelay;		// ms to collect the output before writing it
 
     PString ptypath;
     PString ttypath;
 
     friend class InPty;
     friend class OutPty;
+    friend class ReactorPty;
 };
 ///////////////////////////////////////////////////////////////
 
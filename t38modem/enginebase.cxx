@@ -127,6 +127,7 @@ EngineBase::EngineBase(const PString &_name)
   , isFakeOwnerOut(FALSE)
   , isEnableFakeIn(FALSE)
   , isEnableFakeOut(FALSE)
+  , isModemOpen(FALSE)
 {
 }
 
@@ -158,6 +159,7 @@ PBoolean EngineBase::Attach(const PNotifier &callback)
   }
 
   modemCallback = callback;
+  isModemOpen = TRUE;
 
   OnAttach();
 
@@ -189,6 +191,7 @@ void EngineBase::Detach(const PNotifier &callback)
     return;
   }
 
+  isModemOpen = FALSE;
   modemCallback = NULL;
   modemClass = mcUndefined;
 
@@ -420,16 +423,16 @@ void EngineBase::UnlockModemCallback()
   MutexModem.Signal();
 }
 
-void EngineBase::ModemCallbackWithUnlock(INT extra)
+void EngineBase::ModemCallbackWithUnlock(INT extra, PMutex &mutex)
 {
-  Mutex.Signal();
+  mutex.Signal();
   MutexModemCallback.Wait();
 
   if (!modemCallback.IsNULL())
     modemCallback(*this, extra);
 
   MutexModemCallback.Signal();
-  Mutex.Wait();
+  mutex.Wait();
 }
 
 void EngineBase::WriteUserInput(const PString & value)
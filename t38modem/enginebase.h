@@ -71,6 +71,8 @@
 #ifndef _ENGINEBASE_H
 #define _ENGINEBASE_H
 
+#include "pmutils.h"
+
 ///////////////////////////////////////////////////////////////
 class DataStream;
 ///////////////////////////////////////////////////////////////
@@ -82,24 +84,67 @@ class ReferenceObject : public PObject
     ReferenceObject() : referenceCount(1) {}
 
     void AddReference() {
-      PWaitAndSignal mutex(referenceCountMutex);
-      ++referenceCount;
+      referenceCount.Increment();
     }
 
     static void DelPointer(ReferenceObject * object) {
-      PBoolean doDelele;
-
-      object->referenceCountMutex.Wait();
-      doDelele = (--object->referenceCount == 0);
-      object->referenceCountMutex.Signal();
-
-      if (doDelele)
+      // the decrement is a full barrier, so the last owner sees all changes
+      if (object->referenceCount.Decrement() == 0)
         delete object;
     }
 
   private:
-    PMutex referenceCountMutex;
-    unsigned referenceCount;
+    Atomic<int> referenceCount;
+};
+///////////////////////////////////////////////////////////////
+/*
+ * Owner of one reference to ReferenceObject.
+ *
+ * It takes over the reference returned by NewPtr...() functions and
+ * deletes it by ReferenceObject::DelPointer() on destruction or on
+ * assigning another pointer.
+ */
+template <class T> class ReferencePointer
+{
+  public:
+    ReferencePointer(T *_object = NULL) : object(_object) {}
+
+    ReferencePointer(const ReferencePointer &pointer) : object(pointer.object) {
+      if (object != NULL)
+        object->AddReference();
+    }
+
+    ~ReferencePointer() { Reset(NULL); }
+
+    ReferencePointer &operator=(T *_object) {
+      Reset(_object);
+      return *this;
+    }
+
+    ReferencePointer &operator=(const ReferencePointer &pointer) {
+      if (pointer.object != NULL)
+        pointer.object->AddReference();
+
+      Reset(pointer.object);
+      return *this;
+    }
+
+    T *operator->() const { return object; }
+    T &operator*() const { return *object; }
+    T *Get() const { return object; }
+    PBoolean IsNULL() const { return object == NULL; }
+
+  protected:
+    void Reset(T *_object) {
+      T *old = object;
+
+      object = _object;
+
+      if (old != NULL)
+        ReferenceObject::DelPointer(old);
+    }
+
+    T *object;
 };
 ///////////////////////////////////////////////////////////////
 class EngineBase : public ReferenceObject
@@ -200,7 +245,7 @@ class EngineBase : public ReferenceObject
   //@}
 
   protected:
-    PBoolean IsModemOpen() const { return !modemCallback.IsNULL(); }
+    PBoolean IsModemOpen() const { return isModemOpen; }
 
     virtual void OnAttach();
     virtual void OnDetach();
@@ -218,18 +263,21 @@ class EngineBase : public ReferenceObject
     const PString name;
     DataStream *volatile recvUserInput;
     ModemClass modemClass;
-    volatile HOWNERIN hOwnerIn;
-    volatile HOWNEROUT hOwnerOut;
-    PBoolean firstIn;
-    PBoolean firstOut;
+    Atomic<HOWNERIN> hOwnerIn;
+    Atomic<HOWNEROUT> hOwnerOut;
+    Atomic<int> firstIn;
+    Atomic<int> firstOut;
     PBoolean isFakeOwnerIn;
     PBoolean isFakeOwnerOut;
     PBoolean isEnableFakeIn;
     PBoolean isEnableFakeOut;
 
-    void ModemCallbackWithUnlock(INT extra);
+    // calls back the modem with unlocked mutex (Mutex by default)
+    void ModemCallbackWithUnlock(INT extra) { ModemCallbackWithUnlock(extra, Mutex); }
+    void ModemCallbackWithUnlock(INT extra, PMutex &mutex);
 
     PNotifier modemCallback;
+    Atomic<int> isModemOpen;
     PTimedMutex MutexModemCallback;
 
     PMutex MutexModem;
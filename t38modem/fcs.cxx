@@ -43,21 +43,70 @@
 
 #define new PNEW
 
+///////////////////////////////////////////////////////////////
+/*
+ * FcsTable[0] is the bytewise CRC-16/CCITT table, FcsTable[k][i] is the
+ * CRC of byte i followed by k zero bytes. It allows to process 8 bytes
+ * per iteration (slicing-by-8).
+ */
+static WORD FcsTable[8][256];
+
+enum {
+  FCS_GOOD = 0x1D0F,	// residue after processing a frame with valid FCS
+};
+
+static PBoolean initFcsTable()
+{
+  for (unsigned i = 0 ; i < 256 ; i++) {
+    unsigned crc = i << 8;
+
+    for (int j = 0 ; j < 8 ; j++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+
+    FcsTable[0][i] = WORD(crc);
+  }
+
+  for (unsigned i = 0 ; i < 256 ; i++) {
+    for (int k = 1 ; k < 8 ; k++) {
+      WORD crc = FcsTable[k - 1][i];
+      FcsTable[k][i] = WORD((crc << 8) ^ FcsTable[0][crc >> 8]);
+    }
+  }
+
+  return TRUE;
+}
+
+static const PBoolean ___InitFcsTable = initFcsTable();
 ///////////////////////////////////////////////////////////////
 void FCS::build(const void *_pBuf, PINDEX count)
 {
   const BYTE *pBuf = (const BYTE *)_pBuf;
+  WORD crc = WORD(fcs);
 
-  for (PINDEX i = 0 ; i < count ; i++) {
-    BYTE c = *(pBuf++);
-    for (BYTE m = 0x80 ; m ; m >>= 1) {
-	fcs <<= 1;
-        if (c & m)
-	  fcs ^= 0x10000;
-	if (fcs & 0x10000)
-          fcs ^= 0x11021;
-    }
+  for ( ; count >= 8 ; count -= 8, pBuf += 8) {
+    crc = WORD(FcsTable[7][pBuf[0] ^ (crc >> 8)] ^
+               FcsTable[6][pBuf[1] ^ (crc & 0xFF)] ^
+               FcsTable[5][pBuf[2]] ^
+               FcsTable[4][pBuf[3]] ^
+               FcsTable[3][pBuf[4]] ^
+               FcsTable[2][pBuf[5]] ^
+               FcsTable[1][pBuf[6]] ^
+               FcsTable[0][pBuf[7]]);
   }
+
+  for ( ; count > 0 ; count--)
+    crc = WORD((crc << 8) ^ FcsTable[0][(crc >> 8) ^ *(pBuf++)]);
+
+  fcs = crc;
+}
+
+PBoolean FCS::check(const void *pBuf, PINDEX count) const
+{
+  FCS residue = *this;
+
+  residue.build(pBuf, count);
+
+  return residue.fcs == FCS_GOOD;
 }
 ///////////////////////////////////////////////////////////////
 
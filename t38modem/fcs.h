@@ -47,6 +47,14 @@ class FCS
     void build(const void *pBuf, PINDEX count);
     operator WORD() const { return WORD(~fcs); }
 
+    /*
+     * Returns TRUE if the data built so far followed by pBuf[count] is
+     * ended by its valid FCS (2 bytes, the high byte first). So
+     * FCS().check(frame, len) checks a whole frame and fcs.check(Buf, 2)
+     * checks the received FCS Buf[2] of the data built by fcs.
+     */
+    PBoolean check(const void *pBuf, PINDEX count) const;
+
   protected:
 
     DWORD fcs;
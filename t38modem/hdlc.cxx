@@ -59,41 +59,135 @@
 #define new PNEW
 
 ///////////////////////////////////////////////////////////////
-void HDLC::pack(const void *_pBuf, PINDEX count, PBoolean flag)
+/*
+ * Bit stuffing tables.
+ *
+ * StuffTable[ones][byte] and UnstuffTable[ones][byte] keep the result of
+ * processing of 8 bits (MSB first) starting with ones consecutive 1 bits
+ * already passed. UnstuffTable does not detect flags, so it's used only
+ * if FlagTable says that there is no flag in the 15 bits window.
+ */
+struct StuffEntry
 {
-  WORD w = WORD((WORD)rawByte << 8);
-  const BYTE *pBuf = (const BYTE *)_pBuf;
+  WORD bits;	// output bits (LSB is the last one)
+  BYTE len;	// number of output bits
+  BYTE ones;	// number of consecutive 1 bits at the end
+};
 
-  for (PINDEX i = 0 ; i < count ; i++) {
-    w |= *(pBuf++) & 0xFF;
-    for (PINDEX j = 0 ; j < 8 ; j++) {
-      w <<= 1;
-
-      if (++rawByteLen == 8) {
-        rawByte = BYTE(w >> 8);
-        outData.PutData(&rawByte, 1);
-        rawByteLen = 0;
-      }
+enum {
+  MAX_UNSTUFF_ONES = 6,	// 6 and more ones are processed in the same way
+};
 
-      if (!flag) {
-        if (w & 0x100) {
-          if (++rawOnes == 5) {
-            w = WORD((w & 0xFF00) << 1 | (w & 0xFF));
+static StuffEntry StuffTable[5][256];
+static StuffEntry UnstuffTable[MAX_UNSTUFF_ONES + 1][256];
+static BYTE FlagTable[(1 << 15)/8];
 
-            if (++rawByteLen == 8) {
-              rawByte = BYTE(w >> 8);
-              outData.PutData(&rawByte, 1);
-              rawByteLen = 0;
-            }
-            rawOnes = 0;
+static PBoolean initStuffTables()
+{
+  for (unsigned ones = 0 ; ones < 5 ; ones++) {
+    for (unsigned i = 0 ; i < 256 ; i++) {
+      StuffEntry &e = StuffTable[ones][i];
+      unsigned bits = 0, len = 0, o = ones;
+
+      for (int j = 7 ; j >= 0 ; j--) {
+        bits = (bits << 1) | ((i >> j) & 1);
+        len++;
+
+        if ((i >> j) & 1) {
+          if (++o == 5) {
+            bits <<= 1;
+            len++;
+            o = 0;
           }
         }
         else
-          rawOnes = 0;
+          o = 0;
+      }
+
+      e.bits = WORD(bits);
+      e.len = BYTE(len);
+      e.ones = BYTE(o);
+    }
+  }
+
+  for (unsigned ones = 0 ; ones <= MAX_UNSTUFF_ONES ; ones++) {
+    for (unsigned i = 0 ; i < 256 ; i++) {
+      StuffEntry &e = UnstuffTable[ones][i];
+      unsigned bits = 0, len = 0, o = ones;
+
+      for (int j = 7 ; j >= 0 ; j--) {
+        if ((i >> j) & 1) {
+          bits = (bits << 1) | 1;
+          len++;
+          if (o < MAX_UNSTUFF_ONES)
+            o++;
+        } else {
+          if (o != 5) {
+            bits <<= 1;
+            len++;
+          }
+          o = 0;
+        }
+      }
+
+      e.bits = WORD(bits);
+      e.len = BYTE(len);
+      e.ones = BYTE(o);
+    }
+  }
+
+  for (unsigned w = 0 ; w < (1 << 15) ; w++) {
+    for (int j = 0 ; j < 8 ; j++) {
+      if (((w >> (7 - j)) & 0xFF) == 0x7E) {
+        FlagTable[w >> 3] |= BYTE(1 << (w & 7));
+        break;
       }
     }
   }
-  rawByte = BYTE(w >> 8);
+
+  return TRUE;
+}
+
+static const PBoolean ___InitStuffTables = initStuffTables();
+///////////////////////////////////////////////////////////////
+void HDLC::pack(const void *_pBuf, PINDEX count, PBoolean flag)
+{
+  DWORD w = rawByte;
+  const BYTE *pBuf = (const BYTE *)_pBuf;
+  BYTE Buf[256];
+  PINDEX len = 0;
+
+  for (PINDEX i = 0 ; i < count ; i++) {
+    BYTE b = *(pBuf++);
+
+    if (flag) {
+      w = (w << 8) | b;
+      rawByteLen += 8;
+    } else {
+      const StuffEntry &e = StuffTable[rawOnes][b];
+
+      w = (w << e.len) | e.bits;
+      rawByteLen += e.len;
+      rawOnes = e.ones;
+    }
+
+    while (rawByteLen >= 8) {
+      rawByteLen -= 8;
+      Buf[len++] = BYTE(w >> rawByteLen);
+    }
+
+    w &= 0xFF;
+
+    if (len > (PINDEX)sizeof(Buf) - 2) {
+      outData.PutData(Buf, len);
+      len = 0;
+    }
+  }
+
+  if (len)
+    outData.PutData(Buf, len);
+
+  rawByte = BYTE(w);
   if (flag)
     rawOnes = 0;
 }
@@ -134,6 +228,30 @@ PBoolean HDLC::skipFlag(BYTE b)
 PBoolean HDLC::unpack(BYTE b)
 {
   //myPTRACE(1, "unpack det " << hex << (WORD)b);
+  if (rawByteLen == 7) {
+    unsigned x = ((rawByte & 0x7F) << 8) | b;
+
+    if ((FlagTable[x >> 3] & (1 << (x & 7))) == 0) {
+      if (rawOnes > MAX_UNSTUFF_ONES)
+        rawOnes = MAX_UNSTUFF_ONES;
+
+      const StuffEntry &e = UnstuffTable[rawOnes][x >> 7];
+
+      hdlcChunk = (hdlcChunk << e.len) | e.bits;
+      hdlcChunkLen += e.len;
+      rawOnes = e.ones;
+
+      if (hdlcChunkLen >= 24) {
+        hdlcChunkLen -= 8;
+        BYTE b = BYTE(hdlcChunk >> hdlcChunkLen);
+        outData.PutData(&b, 1);
+      }
+
+      rawByte = BYTE(x);
+      return TRUE;
+    }
+  }
+
   WORD w = WORD(((WORD)rawByte << 8) | (b & 0xFF));
   PINDEX j = 8 - rawByteLen;
 
@@ -289,42 +407,56 @@ int HDLC::GetHdlcData(void *_pBuf, PINDEX count)
       return -1;
     return 0;
   } else {
-    BYTE b;
-    int res;
     len = 0;
 
-    for ( ; (res = inData->GetData(&b, 1)) != 0 ; ) {
-      if (res < 0) {
+    for (;;) {
+      // raw byte gives not more than one hdlc byte, so don't take more raw
+      // bytes than needed to fill the buffer
+      PINDEX inLen = count ? count : 1;
+      const BYTE *pIn = inData->GetBegin(inLen);
+
+      if (!inLen) {
+        if (inData->GetData(NULL, 0) >= 0)
+          break;
+
         outData.PutEof();
         inData = NULL;
         hdlcState = stEof;
         //myPTRACE(1, "hdlcState=stEof EOF");
       }
       else {
-        lastChar = b;
-        rawCount++;
-        switch (hdlcState) {
-        case stSync:
-          if (sync(b)) {
-            hdlcState = stSkipFlags;
-            //myPTRACE(1, "hdlcState=stSkipFlags " << hex << (int)b);
-          }
-          break;
-        case stSkipFlags:
-          if (skipFlag(b))
+        PINDEX i;
+
+        for (i = 0 ; i < inLen && hdlcState != stEof ; i++) {
+          BYTE b = pIn[i];
+
+          switch (hdlcState) {
+          case stSync:
+            if (sync(b)) {
+              hdlcState = stSkipFlags;
+              //myPTRACE(1, "hdlcState=stSkipFlags " << hex << (int)b);
+            }
+            break;
+          case stSkipFlags:
+            if (skipFlag(b))
+              break;
+            hdlcState = stData;
+            //myPTRACE(1, "hdlcState=stData " << hex << (int)b);
+          case stData:
+            if (!unpack(b)) {
+              outData.PutEof();
+              hdlcState = stEof;
+              //myPTRACE(1, "hdlcState=stEof " << hex << (int)b);
+            }
             break;
-          hdlcState = stData;
-          //myPTRACE(1, "hdlcState=stData " << hex << (int)b);
-        case stData:
-          if (!unpack(b)) {
-            outData.PutEof();
-            hdlcState = stEof;
-            //myPTRACE(1, "hdlcState=stEof " << hex << (int)b);
+          default:
+            myPTRACE(1, "HDLC::GetHdlcData(): unexpected hdlcState=" << hdlcState);
           }
-          break;
-        default:
-          myPTRACE(1, "HDLC::GetHdlcData(): unexpected hdlcState=" << hdlcState);
         }
+
+        lastChar = pIn[i - 1];
+        rawCount += i;
+        inData->GetEnd(i);
       }
 
       if (hdlcState == stEof || hdlcState == stData) {
@@ -365,7 +497,12 @@ PBoolean HDLC::isFcsOK()
     return FALSE;
   }
 
-  if ((WORD)hdlcChunk != fcs) {
+  BYTE Buf[2];
+
+  Buf[0] = BYTE(hdlcChunk >> 8);
+  Buf[1] = BYTE(hdlcChunk);
+
+  if (!fcs.check(Buf, sizeof(Buf))) {
     myPTRACE(1, "isFcsOK(): hdlcChunk(" << hex << (WORD)hdlcChunk << ") != fcs(" << (WORD)fcs << ")");
     return FALSE;
   }
@@ -0,0 +1,385 @@
+/*
+ * ifpcodec.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: ifpcodec.cxx,v $
+ *
+ */
+
+#include <ptlib.h>
+
+#ifdef USE_OPAL
+  #include <opal/buildopts.h>
+  #include <asn/t38.h>
+#else
+  #include <t38.h>
+#endif
+
+#include "ifpcodec.h"
+
+#define new PNEW
+
+///////////////////////////////////////////////////////////////
+/*
+ * The IFP packet is encoded by aligned PER (X.691) as:
+ *
+ *   1 bit   - data-field is present
+ *   1 bit   - type-of-msg choice (t30-indicator or data)
+ *   1 bit   - type-of-msg enumeration extension (0)
+ *   4 bits  - t30-indicator (0..15) or data (0..8)
+ *
+ * and, if data-field is present, after aligning
+ *
+ *   8 bits  - number of fields (0..127)
+ *
+ * and for each field
+ *
+ *   1 bit   - field-data is present
+ *   1 bit   - field-type enumeration extension (0, corrigendum only)
+ *   3 bits  - field-type (0..7)
+ *
+ * and, if field-data is present, after aligning
+ *
+ *   16 bits - length of field-data minus 1
+ *   N bytes - field-data
+ */
+#ifdef OPTIMIZE_CORRIGENDUM_IFP
+  #define FIELD_TYPE_EXTENDABLE TRUE
+#else
+  #define FIELD_TYPE_EXTENDABLE FALSE
+#endif
+
+enum {
+  maxIndicator = 15,
+  maxData = 8,
+  maxFieldType = 7,
+  maxFieldData = 65535,
+};
+///////////////////////////////////////////////////////////////
+class IFPWriter
+{
+  public:
+    IFPWriter(BYTE *_pBuf, PINDEX _size)
+      : pBuf(_pBuf), size(_size), byteOffset(0), bitOffset(8), ok(TRUE) {}
+
+    void Bits(unsigned value, unsigned nBits) {		// nBits <= 8
+      while (nBits) {
+        if (bitOffset == 8) {
+          if (byteOffset >= size) {
+            ok = FALSE;
+            return;
+          }
+          pBuf[byteOffset] = 0;
+        }
+
+        unsigned n = nBits < bitOffset ? nBits : bitOffset;
+
+        nBits -= n;
+        bitOffset -= n;
+        pBuf[byteOffset] |= BYTE(((value >> nBits) & ((1 << n) - 1)) << bitOffset);
+
+        if (bitOffset == 0) {
+          bitOffset = 8;
+          byteOffset++;
+        }
+      }
+    }
+
+    void Align() {
+      if (bitOffset != 8) {
+        bitOffset = 8;
+        byteOffset++;
+      }
+    }
+
+    void Block(const BYTE *pData, PINDEX len) {
+      Align();
+
+      if (len > size - byteOffset) {
+        ok = FALSE;
+        return;
+      }
+
+      memcpy(pBuf + byteOffset, pData, len);
+      byteOffset += len;
+    }
+
+    PINDEX Length() const { return ok ? byteOffset + (bitOffset != 8 ? 1 : 0) : 0; }
+
+  protected:
+    BYTE *pBuf;
+    PINDEX size;
+    PINDEX byteOffset;
+    unsigned bitOffset;
+    PBoolean ok;
+};
+///////////////////////////////////////////////////////////////
+class IFPReader
+{
+  public:
+    IFPReader(const BYTE *_pBuf, PINDEX _size)
+      : pBuf(_pBuf), size(_size), byteOffset(0), bitOffset(8) {}
+
+    PBoolean Bits(unsigned &value, unsigned nBits) {	// nBits <= 16
+      if (nBits > (size - byteOffset)*8 - (8 - bitOffset))
+        return FALSE;
+
+      value = 0;
+
+      while (nBits) {
+        unsigned n = nBits < bitOffset ? nBits : bitOffset;
+
+        nBits -= n;
+        bitOffset -= n;
+        value = (value << n) | ((pBuf[byteOffset] >> bitOffset) & ((1 << n) - 1));
+
+        if (bitOffset == 0) {
+          bitOffset = 8;
+          byteOffset++;
+        }
+      }
+
+      return TRUE;
+    }
+
+    void Align() {
+      if (bitOffset != 8) {
+        bitOffset = 8;
+        byteOffset++;
+      }
+    }
+
+    const BYTE *Block(PINDEX len) {
+      Align();
+
+      if (len > size - byteOffset)
+        return NULL;
+
+      const BYTE *pData = pBuf + byteOffset;
+
+      byteOffset += len;
+
+      return pData;
+    }
+
+  protected:
+    const BYTE *pBuf;
+    PINDEX size;
+    PINDEX byteOffset;
+    unsigned bitOffset;
+};
+///////////////////////////////////////////////////////////////
+PINDEX IFPCodec::Encode(const IFPFlat &ifp, BYTE *pBuf, PINDEX size)
+{
+  switch (ifp.tag) {
+    case T38_Type_of_msg::e_t30_indicator:
+      if (ifp.type > maxIndicator)
+        return 0;
+      break;
+    case T38_Type_of_msg::e_data:
+      if (ifp.type > maxData)
+        return 0;
+      break;
+    default:
+      return 0;
+  }
+
+  IFPWriter writer(pBuf, size);
+
+  writer.Bits(ifp.hasDataField ? 1 : 0, 1);
+  writer.Bits(ifp.tag, 1);
+  writer.Bits(0, 1);
+  writer.Bits(ifp.type, 4);
+
+  if (!ifp.hasDataField)
+    return writer.Length();
+
+  if (ifp.count < 0 || ifp.count > IFPFlat::maxFields)
+    return 0;
+
+  writer.Align();
+  writer.Bits(ifp.count, 8);
+
+  for (PINDEX i = 0 ; i < ifp.count ; i++) {
+    const IFPFlat::Field &field = ifp.fields[i];
+
+    if (field.type > maxFieldType)
+      return 0;
+
+    writer.Bits(field.pData != NULL ? 1 : 0, 1);
+
+    if (FIELD_TYPE_EXTENDABLE)
+      writer.Bits(0, 1);
+
+    writer.Bits(field.type, 3);
+
+    if (field.pData != NULL) {
+      if (field.len < 1 || field.len > maxFieldData)
+        return 0;
+
+      writer.Align();
+      writer.Bits((field.len - 1) >> 8, 8);
+      writer.Bits((field.len - 1) & 0xFF, 8);
+      writer.Block(field.pData, field.len);
+    }
+  }
+
+  return writer.Length();
+}
+
+PBoolean IFPCodec::Decode(IFPFlat &ifp, const BYTE *pBuf, PINDEX size)
+{
+  IFPReader reader(pBuf, size);
+  unsigned hasDataField, extended;
+
+  if (!reader.Bits(hasDataField, 1) ||
+      !reader.Bits(ifp.tag, 1) ||
+      !reader.Bits(extended, 1) || extended ||
+      !reader.Bits(ifp.type, 4))
+  {
+    return FALSE;
+  }
+
+  // the generic decoder clamps it to maxData
+  if (ifp.tag == T38_Type_of_msg::e_data && ifp.type > maxData)
+    return FALSE;
+
+  ifp.hasDataField = hasDataField;
+  ifp.count = 0;
+
+  if (!ifp.hasDataField)
+    return TRUE;
+
+  unsigned count;
+
+  reader.Align();
+
+  // the long length forms are not expected here
+  if (!reader.Bits(count, 8) || count > IFPFlat::maxFields)
+    return FALSE;
+
+  for (ifp.count = 0 ; ifp.count < PINDEX(count) ; ifp.count++) {
+    IFPFlat::Field &field = ifp.fields[ifp.count];
+    unsigned hasFieldData;
+
+    if (!reader.Bits(hasFieldData, 1))
+      return FALSE;
+
+    if (FIELD_TYPE_EXTENDABLE && (!reader.Bits(extended, 1) || extended))
+      return FALSE;
+
+    if (!reader.Bits(field.type, 3))
+      return FALSE;
+
+    if (hasFieldData) {
+      unsigned len;
+
+      reader.Align();
+
+      if (!reader.Bits(len, 16))
+        return FALSE;
+
+      field.len = len + 1;
+      field.pData = reader.Block(field.len);
+
+      if (field.pData == NULL)
+        return FALSE;
+    } else {
+      field.pData = NULL;
+      field.len = 0;
+    }
+  }
+
+  return TRUE;
+}
+
+PBoolean IFPCodec::Get(IFPFlat &flat, const T38_IFP &ifp)
+{
+  if (!ifp.m_type_of_msg.IsValid())
+    return FALSE;
+
+  flat.tag = ifp.m_type_of_msg.GetTag();
+  flat.type = ((const PASN_Enumeration &)ifp.m_type_of_msg.GetObject()).GetValue();
+  flat.hasDataField = ifp.HasOptionalField(T38_IFPPacket::e_data_field);
+  flat.count = 0;
+
+  if (!flat.hasDataField)
+    return TRUE;
+
+  PINDEX count = ifp.m_data_field.GetSize();
+
+  if (count > IFPFlat::maxFields)
+    return FALSE;
+
+  for (flat.count = 0 ; flat.count < count ; flat.count++) {
+    const T38_DATA_FIELD &Data_Field = ifp.m_data_field[flat.count];
+    IFPFlat::Field &field = flat.fields[flat.count];
+
+    field.type = Data_Field.m_field_type;
+
+    if (Data_Field.HasOptionalField(T38_Data_Field_subtype::e_field_data)) {
+      field.pData = Data_Field.m_field_data;
+      field.len = Data_Field.m_field_data.GetSize();
+    } else {
+      field.pData = NULL;
+      field.len = 0;
+    }
+  }
+
+  return TRUE;
+}
+
+void IFPCodec::Put(T38_IFP &ifp, const IFPFlat &flat)
+{
+  if (ifp.m_type_of_msg.GetTag() != flat.tag || !ifp.m_type_of_msg.IsValid())
+    ifp.m_type_of_msg.SetTag(flat.tag);
+
+  ((PASN_Enumeration &)ifp.m_type_of_msg.GetObject()).SetValue(flat.type);
+
+  if (!flat.hasDataField) {
+    ifp.RemoveOptionalField(T38_IFPPacket::e_data_field);
+    return;
+  }
+
+  ifp.IncludeOptionalField(T38_IFPPacket::e_data_field);
+
+  if (ifp.m_data_field.GetSize() != flat.count)
+    ifp.m_data_field.SetSize(flat.count);
+
+  for (PINDEX i = 0 ; i < flat.count ; i++) {
+    T38_DATA_FIELD &Data_Field = ifp.m_data_field[i];
+    const IFPFlat::Field &field = flat.fields[i];
+
+    Data_Field.m_field_type = field.type;
+
+    if (field.pData != NULL) {
+      Data_Field.IncludeOptionalField(T38_Data_Field_subtype::e_field_data);
+      Data_Field.m_field_data.SetValue(field.pData, field.len);
+    } else {
+      Data_Field.RemoveOptionalField(T38_Data_Field_subtype::e_field_data);
+    }
+  }
+}
+///////////////////////////////////////////////////////////////
+
@@ -0,0 +1,98 @@
+/*
+ * ifpcodec.h
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: ifpcodec.h,v $
+ *
+ */
+
+#ifndef _IFPCODEC_H
+#define _IFPCODEC_H
+
+#include "t38engine.h"
+
+///////////////////////////////////////////////////////////////
+/*
+ * Flat view of T.38 IFP packet.
+ *
+ * The field data are not copied, they point to the encoded packet
+ * or to the T38_IFP object the view was got from.
+ */
+struct IFPFlat
+{
+  enum { maxFields = 4 };
+
+  struct Field {
+    unsigned type;		// field_type
+    const BYTE *pData;		// field_data (NULL if absent)
+    PINDEX len;
+  };
+
+  unsigned tag;			// T38_Type_of_msg tag
+  unsigned type;		// t30_indicator or data
+  PBoolean hasDataField;
+  PINDEX count;
+  Field fields[maxFields];
+};
+///////////////////////////////////////////////////////////////
+/*
+ * Aligned PER codec for T38_IFP (pre-corrigendum or corrigendum
+ * variant selected by OPTIMIZE_CORRIGENDUM_IFP).
+ *
+ * It encodes/decodes exactly the same bits as the generic PASN code
+ * but refuses anything unusual (extensions, too many fields, too long
+ * lengths or broken packets), so the caller should fall back to the
+ * generic PASN code if it returns 0 or FALSE.
+ */
+class IFPCodec
+{
+  public:
+    /*
+     * Encodes ifp to pBuf[size].
+     * Returns the size of encoded packet or 0 if not encoded.
+     */
+    static PINDEX Encode(const IFPFlat &ifp, BYTE *pBuf, PINDEX size);
+
+    /*
+     * Decodes ifp from pBuf[size].
+     * Returns FALSE if not decoded.
+     */
+    static PBoolean Decode(IFPFlat &ifp, const BYTE *pBuf, PINDEX size);
+
+    /*
+     * Gets the flat view of ifp.
+     * Returns FALSE if it can't be flattened.
+     */
+    static PBoolean Get(IFPFlat &flat, const T38_IFP &ifp);
+
+    /*
+     * Puts the flat view to ifp. The already allocated fields of ifp
+     * are changed in place.
+     */
+    static void Put(T38_IFP &ifp, const IFPFlat &flat);
+};
+///////////////////////////////////////////////////////////////
+
+#endif  // _IFPCODEC_H
+
@@ -0,0 +1,229 @@
+/*
+ * ifpreorder.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: ifpreorder.cxx,v $
+ *
+ */
+
+#include <ptlib.h>
+
+#include "ifpreorder.h"
+
+#define new PNEW
+
+///////////////////////////////////////////////////////////////
+IFPReorder::IFPReorder(PMutex &_mutex)
+  : mutex(_mutex)
+  , holdTime(0)
+  , repairSpan(0)
+  , expected(0)
+  , numHeld(0)
+{
+  timer.SetNotifier(PCREATE_NOTIFIER(OnTimeout));
+}
+
+IFPReorder::~IFPReorder()
+{
+  timer.Stop();
+}
+
+void IFPReorder::Reset()
+{
+  timer.Stop(false);	// OnTimeout() waits for the mutex
+
+  for (int i = 0 ; i < windowSize ; i++)
+    held[i].valid = FALSE;
+
+  numHeld = 0;
+  expected = 0;
+}
+
+PBoolean IFPReorder::Put(WORD sequenceNumber, const BYTE *pData, PINDEX size)
+{
+  long seq = sequenceNumber + (expected & ~0xFFFFL);
+  long lost = seq - expected;
+
+  if (lost < -0x10000L/2) {
+    lost += 0x10000L;
+    seq += 0x10000L;
+  }
+  else
+  if (lost > 0x10000L/2) {
+    lost -= 0x10000L;
+    seq -= 0x10000L;
+  }
+
+  if (numHeld > 0 && lost != 0 && PTimer::Tick() >= deadline) {
+    // the hold time expired, do not wait for the missing packets anymore
+
+    PTRACE(4, "IFPReorder::Put: " << numHeld << " held packets expired, expected " << expected);
+
+    if (!Flush())
+      return FALSE;
+
+    lost = seq - expected;
+  }
+
+  if ((lost < 0 && lost > -10) || size == 0) {
+    OnIgnored(seq, expected, size);
+    return TRUE;
+  }
+
+  if (lost == 0) {
+    if (numHeld > 0) {
+      // the missing packet arrived out of order or was repaired by FEC
+      OnReordered(seq);
+    }
+
+    expected = seq + 1;
+
+    if (!OnIFP(seq, pData, size))
+      return FALSE;
+
+    return ReleaseHeld(expected);
+  }
+
+  if (lost > 0 && lost < windowSize && holdTime > 0) {
+    // hold the packet till the missing ones arrive or the hold time expires
+
+    HeldPacket &h = held[seq & (windowSize - 1)];
+
+    if (h.valid) {
+      OnIgnored(seq, expected, size);
+      return TRUE;
+    }
+
+    OnHeld(seq, expected);
+
+    h.valid = TRUE;
+    h.sequenceNumber = seq;
+    h.payload.SetSize(size);
+    memcpy(h.payload.GetPointer(), pData, size);
+
+    if (numHeld++ == 0)
+      StartTimer(PTimer::Tick());
+
+    if (repairSpan == 0 || lost <= long(repairSpan))
+      return TRUE;
+
+    // the repairs of the packets missing before (seq - repairSpan) should
+    // have been received before this packet
+
+    return ReleaseHeld(seq - repairSpan);
+  }
+
+  // the gap is too large to wait for it
+
+  if (!Flush())
+    return FALSE;
+
+  lost = seq - expected;
+
+  if (lost != 0) {
+    if (!OnLost(lost))
+      return FALSE;
+
+    PTRACE(3, "IFPReorder::Put: adjusting sequence number to " << seq);
+  }
+
+  expected = seq + 1;
+
+  return OnIFP(seq, pData, size);
+}
+
+PBoolean IFPReorder::ReleaseHeld(long limit)
+{
+  long was = expected;
+
+  while (numHeld > 0) {
+    HeldPacket &h = held[expected & (windowSize - 1)];
+
+    if (!h.valid) {
+      if (expected >= limit)
+        break;
+
+      // all held packets are in (expected, expected + windowSize)
+
+      long next = expected + 1;
+
+      while (!held[next & (windowSize - 1)].valid)
+        next++;
+
+      if (next > limit)
+        next = limit;
+
+      if (!OnLost(next - expected))
+        return FALSE;
+
+      PTRACE(3, "IFPReorder::ReleaseHeld: adjusting sequence number to " << next);
+
+      expected = next;
+      continue;
+    }
+
+    h.valid = FALSE;
+    numHeld--;
+    expected = h.sequenceNumber + 1;
+
+    if (!OnIFP(h.sequenceNumber, h.payload, h.payload.GetSize()))
+      return FALSE;
+  }
+
+  if (numHeld == 0)
+    timer.Stop(false);	// OnTimeout() waits for the mutex
+  else
+  if (expected != was)
+    StartTimer(PTimer::Tick());	// wait for the next gap
+
+  return TRUE;
+}
+
+void IFPReorder::StartTimer(const PTimeInterval &now)
+{
+  deadline = now + holdTime;
+  timer = holdTime;
+}
+
+void IFPReorder::OnTimeout(PTimer &, INT)
+{
+  PWaitAndSignal mutexWait(mutex);
+
+  if (numHeld == 0)
+    return;
+
+  PTimeInterval now = PTimer::Tick();
+
+  if (now < deadline) {
+    // restarted while waiting for the mutex
+    timer = deadline - now;
+    return;
+  }
+
+  PTRACE(4, "IFPReorder::OnTimeout: " << numHeld << " held packets expired, expected " << expected);
+
+  Flush();
+}
+///////////////////////////////////////////////////////////////
+
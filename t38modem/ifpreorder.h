@@ -0,0 +1,146 @@
+/*
+ * ifpreorder.h
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: ifpreorder.h,v $
+ *
+ */
+
+#ifndef _IFPREORDER_H
+#define _IFPREORDER_H
+
+///////////////////////////////////////////////////////////////
+/*
+ * Reorder window for the received IFP packets.
+ *
+ * The packets received after a gap are held till the missing ones
+ * arrive (reordered or repaired by FEC) or the hold time expires.
+ * The expired packets are released by the next received packet or by
+ * the timer if nothing is received.
+ *
+ * The mutex passed to the constructor should be locked by the caller of
+ * Reset(), Put() and Flush(), the timer locks it before releasing the
+ * packets.
+ */
+class IFPReorder : public PObject
+{
+    PCLASSINFO(IFPReorder, PObject);
+  public:
+    enum { windowSize = 64 };		// power of 2, covers the max FEC span*entries of OPAL
+
+    IFPReorder(PMutex &_mutex);
+    ~IFPReorder();
+
+    /*
+     * Forgets the held packets and the sequence number.
+     */
+    void Reset();
+
+    /*
+     * Sets the time to wait for the missing packets (0 - do not hold).
+     */
+    void SetHoldTime(const PTimeInterval &_holdTime) { holdTime = _holdTime; }
+    const PTimeInterval &GetHoldTime() const { return holdTime; }
+
+    /*
+     * Sets the number of the packets after the missing one that can
+     * repair it (0 - no FEC).
+     * The missing packet is not waited for after the later packets
+     * could not repair it.
+     */
+    void SetRepairSpan(unsigned _repairSpan) { repairSpan = _repairSpan; }
+    unsigned GetRepairSpan() const { return repairSpan; }
+
+    /*
+     * Handles the received packet (size 0 - fake one).
+     * Returns FALSE if OnIFP() or OnLost() returned FALSE.
+     */
+    PBoolean Put(WORD sequenceNumber, const BYTE *pData, PINDEX size);
+
+    /*
+     * Releases all held packets.
+     */
+    PBoolean Flush() { return ReleaseHeld(expected + windowSize); }
+
+    /*
+     * Stops the timer, the mutex should not be locked by the caller.
+     */
+    void Stop() { timer.Stop(); }
+
+    long GetExpected() const { return expected; }
+    int GetNumHeld() const { return numHeld; }
+
+  protected:
+    /*
+     * Called for the next packet in the sequence order.
+     */
+    virtual PBoolean OnIFP(long sequenceNumber, const BYTE *pData, PINDEX size) = 0;
+
+    /*
+     * Called for the missing packets before the next one.
+     */
+    virtual PBoolean OnLost(long lost) = 0;
+
+    /*
+     * Called for the repeated, late or fake packets.
+     */
+    virtual void OnIgnored(long /*sequenceNumber*/, long /*expected*/, PINDEX /*size*/) {}
+
+    /*
+     * Called for the packet held after a gap.
+     */
+    virtual void OnHeld(long /*sequenceNumber*/, long /*expected*/) {}
+
+    /*
+     * Called for the missing packet received while the later ones are held.
+     */
+    virtual void OnReordered(long /*sequenceNumber*/) {}
+
+  private:
+    PBoolean ReleaseHeld(long limit);
+    void StartTimer(const PTimeInterval &now);
+
+    PDECLARE_NOTIFIER(PTimer, IFPReorder, OnTimeout);
+
+    struct HeldPacket {
+      HeldPacket() : valid(FALSE), sequenceNumber(0) {}
+
+      PBoolean valid;
+      long sequenceNumber;
+      PBYTEArray payload;
+    };
+
+    PMutex &mutex;
+    PTimer timer;
+    PTimeInterval holdTime;
+    unsigned repairSpan;
+    long expected;
+    HeldPacket held[windowSize];	// received after the missing ones
+    int numHeld;
+    PTimeInterval deadline;		// to release the held packets
+};
+///////////////////////////////////////////////////////////////
+
+#endif  // _IFPREORDER_H
+
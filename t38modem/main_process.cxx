@@ -61,6 +61,8 @@
   #include <opal/buildopts.h>
 #endif
 
+#include "stats.h"
+#include "bintrace.h"
 #include "version.h"
 
 #ifdef USE_OPAL
@@ -109,9 +111,12 @@ class T38Modem : public PProcess
     T38Modem();
 
     void Main();
+    virtual bool OnInterrupt(bool terminating);
 
   protected:
     PBoolean Initialise();
+
+    volatile PBoolean interrupted;
 };
 
 PCREATE_PROCESS(T38Modem);
@@ -119,6 +124,7 @@ PCREATE_PROCESS(T38Modem);
 T38Modem::T38Modem()
   : PProcess("Vyacheslav Frolov", "T38Modem",
              MAJOR_VERSION, MINOR_VERSION, BUILD_TYPE, BUILD_NUMBER)
+  , interrupted(FALSE)
 {
 }
 
@@ -137,8 +143,21 @@ void T38Modem::Main()
     return;
   }
 
-  for (;;)
-    PThread::Sleep(5000);
+  while (!interrupted)
+    PThread::Sleep(200);
+
+  PTRACE(1, GetName() << " interrupted");
+
+#if PTRACING
+  BinTrace::Stop();
+#endif
+}
+
+bool T38Modem::OnInterrupt(bool)
+{
+  // called by the signal handler, Main() does the rest
+  interrupted = TRUE;
+  return true;
 }
 
 PBoolean T38Modem::Initialise()
@@ -159,7 +178,11 @@ PBoolean T38Modem::Initialise()
 #if PTRACING
              "t-trace."
              "o-output:"
+             "-bin-trace:"
+             "-bin-trace-decode:"
 #endif
+             "-stats-file:"
+             "-stats-dump:"
              "-save."
           , FALSE);
 
@@ -183,7 +206,12 @@ PBoolean T38Modem::Initialise()
 #if PTRACING
         "  -t --trace                : Enable trace, use multiple times for more detail.\n"
         "  -o --output file          : File for trace output, default is stderr.\n"
+        "     --bin-trace file       : File for binary trace output of the hot paths.\n"
+        "     --bin-trace-decode file: Print binary trace file as text and exit.\n"
 #endif
+        "     --stats-file file      : Publish statistics of the modems in the\n"
+        "                              memory mapped file.\n"
+        "     --stats-dump file      : Print statistics from the file and exit.\n"
         "     --save                 : Save arguments in configuration file and exit.\n"
         "  -v --version              : Display version.\n"
         "  -h --help                 : Display this help message.\n"
@@ -219,6 +247,18 @@ PBoolean T38Modem::Initialise()
   if (args.HasOption('v'))
     return FALSE;
 
+#if PTRACING
+  if (args.HasOption("bin-trace-decode")) {
+    BinTrace::Decode(args.GetOptionString("bin-trace-decode"), cout);
+    return FALSE;
+  }
+#endif
+
+  if (args.HasOption("stats-dump")) {
+    ModemStats::Dump(args.GetOptionString("stats-dump"), cout);
+    return FALSE;
+  }
+
   if (args.HasOption("save")) {
     args.Save("save");
     cout << "Arguments were saved in configuration file" << endl;
@@ -251,6 +291,22 @@ PBoolean T38Modem::Initialise()
   }
 #endif
 
+  if (args.HasOption("stats-file")) {
+    if (!ModemStats::OpenFile(args.GetOptionString("stats-file"))) {
+      cout << "Could not open statistics file " << args.GetOptionString("stats-file") << endl;
+      return FALSE;
+    }
+  }
+
+#if PTRACING
+  if (args.HasOption("bin-trace")) {
+    if (!BinTrace::Start(args.GetOptionString("bin-trace"))) {
+      cout << "Could not start binary trace to " << args.GetOptionString("bin-trace") << endl;
+      return FALSE;
+    }
+  }
+#endif
+
 #ifdef USE_OPAL
   MyManager *manager = new MyManager();
 
@@ -278,6 +278,23 @@ PStringArray MyH323EndPoint::Descriptions()
       "    Optimize UDPTL packets on resending in accordance with required redundancy\n"
       "    (exclude redundancy IFP packets sent redundancy times).\n"
       "    Default: true (optimize).\n"
+      "  OPAL-T38-UDPTL-FEC=span[:entries]\n"
+      "    Use FEC error recovery instead of secondary IFP packets. Each UDPTL packet\n"
+      "    carries entries parity packets, each of them is XOR of span preceding IFP\n"
+      "    packets (span*entries is limited to 16). The redundancy still sets how many\n"
+      "    times the last UDPTL packet is resent on idle. The FEC is advertised as\n"
+      "    t38UDPFEC error recovery and it is sent only if the remote advertised it\n"
+      "    too. The received FEC is used regardless of this option. The lost packets\n"
+      "    repaired by the FEC of the later ones are passed late, while the FEC is\n"
+      "    received the packets are held for them at least 500 ms (see\n"
+      "    OPAL-T38-Reorder-Hold-Time option).\n"
+      "    Default: 0 (use secondary IFP packets).\n"
+      "  OPAL-T38-UDPTL-Redundancy-Adaptive=[min:max]\n"
+      "    Adapt redundancy to the loss observed for received UDPTL packets. The\n"
+      "    redundancy for IFP packets is limited by level min..max, which is the\n"
+      "    lowest one keeping the estimated residual loss not above 0.1%. The\n"
+      "    redundancy interval is scaled by max/level. The level starts with max.\n"
+      "    Default: empty string (static redundancy).\n"
       "  OPAL-Bearer-Capability=S:C:R:P\n"
       "    Set bearer capability information element (Q.931) with\n"
       "      S - coding standard (0-3)\n"
@@ -588,8 +605,22 @@ PBoolean MyH323Connection::OnOpenMediaStream(OpalMediaStream & stream)
 
   RTP_Session *session = GetSession(stream.GetSessionID());
 
-  if (session)
-    RTP_Session::EncodingLock(*session)->ApplyStringOptions(GetStringOptions());
+  if (session) {
+    OpalConnection::StringOptions options = GetStringOptions();
+
+    if (stream.GetMediaFormat() == OpalT38 && options("T38-UDPTL-FEC").AsUnsigned() > 0) {
+      // send FEC only if the remote uses it too
+      OpalMediaFormatList mediaFormats = H323Connection::GetMediaFormats();
+      OpalMediaFormatList::const_iterator format = mediaFormats.FindFormat(OpalT38.GetName());
+
+      if (format == mediaFormats.end() || format->GetOptionEnum("T38FaxUdpEC", 1) != 0) {
+        PTRACE(3, "MyH323Connection::OnOpenMediaStream: remote does not use t38UDPFEC");
+        options.SetAt("T38-UDPTL-FEC", "0");
+      }
+    }
+
+    RTP_Session::EncodingLock(*session)->ApplyStringOptions(options);
+  }
 
   return H323Connection::OnOpenMediaStream(stream);
 }
@@ -668,6 +699,13 @@ void MyH323Connection::AdjustMediaFormats(
     mediaFormats.Reorder(order);
 
     PTRACE(4, "MyH323Connection::AdjustMediaFormats: reordered");
+
+    if (GetStringOptions()("T38-UDPTL-FEC").AsUnsigned() > 0) {
+      for (PINDEX i = 0 ; i < mediaFormats.GetSize() ; i++) {
+        if (mediaFormats[i] == OpalT38)
+          mediaFormats[i].SetOptionEnum("T38FaxUdpEC", 0);   // t38UDPFEC
+      }
+    }
   }
 
   PTRACE(4, "MyH323Connection::AdjustMediaFormats:\n" << setfill('\n') << mediaFormats << setfill(' '));
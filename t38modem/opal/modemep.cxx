@@ -145,6 +145,7 @@
 #include "../enginebase.h"
 #include "../pmodem.h"
 #include "../drivers.h"
+#include "../t38engine.h"
 #include "modemstrm.h"
 #include "modemep.h"
 #include "opalutils.h"
@@ -215,7 +216,7 @@ class ModemConnection : public OpalConnection
     const PNotifier requestMode;
 
     PseudoModem *pmodem;
-    EngineBase *userInputEngine;
+    ReferencePointer<EngineBase> userInputEngine;
     PseudoModemMode requestedMode;
     bool isPartyA;
 
@@ -257,6 +258,8 @@ PString ModemEndPoint::ArgSpec()
     "p-ptty:"
     "-force-fax-mode."
     "-no-force-t38-mode."
+    "-t38-reorder-hold-time:"
+    "-t38-direct-udptl."
   ;
 }
 
@@ -275,6 +278,10 @@ PStringArray ModemEndPoint::Descriptions()
       "                              default.\n"
       "  --no-force-t38-mode       : Use OPAL-No-Force-T38-Mode=true route option by\n"
       "                              default.\n"
+      "  --t38-reorder-hold-time ms: Use OPAL-T38-Reorder-Hold-Time=ms route option\n"
+      "                              by default.\n"
+      "  --t38-direct-udptl        : Use OPAL-T38-Direct-UDPTL=true route option by\n"
+      "                              default.\n"
       "Modem route options:\n"
       "  OPAL-Set-Up-Phase-Timeout=secs\n"
       "    Set timeout for outgoing call Set-Up phase to secs seconds.\n"
@@ -285,6 +292,18 @@ PStringArray ModemEndPoint::Descriptions()
       "    Enable or disable forcing fax mode (T.38 or G.711 pass-trough).\n"
       "  OPAL-No-Force-T38-Mode={true|false}\n"
       "    Not enable or not disable forcing T.38 mode.\n"
+      "  OPAL-T38-Reorder-Hold-Time=ms\n"
+      "    Hold received IFP packets up to ms milliseconds waiting for the missing\n"
+      "    ones to arrive out of order, instead of reporting them lost at once.\n"
+      "    The expired packets are released on receiving the next UDPTL packet\n"
+      "    or by a timer if nothing is received. 0 disables holding, but while FEC\n"
+      "    is received the packets are held at least 500 ms for the repairs.\n"
+      "    Default: 5.\n"
+      "  OPAL-T38-Direct-UDPTL={true|false}\n"
+      "    Enable or disable reading received UDPTL packets by the modem reactor\n"
+      "    directly from the session socket instead of by a media patch thread.\n"
+      "    Requires the modem reactor (see --pty-reactor option).\n"
+      "    Default: false (use media patch thread).\n"
       "Modem drivers:\n"
   ).Lines();
 
@@ -346,6 +365,12 @@ PBoolean ModemEndPoint::Initialise(const PConfigArgs & args)
   if (args.HasOption("no-force-t38-mode"))
     defaultStringOptions.SetAt("No-Force-T38-Mode", "true");
 
+  if (args.HasOption("t38-reorder-hold-time"))
+    defaultStringOptions.SetAt("T38-Reorder-Hold-Time", args.GetOptionString("t38-reorder-hold-time"));
+
+  if (args.HasOption("t38-direct-udptl"))
+    defaultStringOptions.SetAt("T38-Direct-UDPTL", "true");
+
   return TRUE;
 }
 
@@ -610,9 +635,6 @@ ModemConnection::~ModemConnection()
     }
   }
 
-  if (userInputEngine != NULL)
-    ReferenceObject::DelPointer(userInputEngine);
-
   phaseTimer.Stop();
 }
 
@@ -761,8 +783,11 @@ PBoolean ModemConnection::SetUpConnection()
 
   myPTRACE(1, "... Ok");
 
-  SetPhase(AlertingPhase);
-  OnAlerting();
+  // the modem can already answer the call (ATA just after RING)
+  if (GetPhase() < AlertingPhase) {
+    SetPhase(AlertingPhase);
+    OnAlerting();
+  }
 
   return TRUE;
 }
@@ -855,11 +880,11 @@ PBoolean ModemConnection::SendUserInputTone(char tone, unsigned PTRACE_PARAM(dur
   if (tone == ' ')
     return false;
 
-  if (userInputEngine == NULL) {
+  if (userInputEngine.IsNULL()) {
     if (pmodem != NULL)
       userInputEngine = pmodem->NewPtrUserInputEngine();
 
-    if (userInputEngine == NULL)
+    if (userInputEngine.IsNULL())
       return false;
   }
 
@@ -68,12 +68,21 @@
 #include <opal/buildopts.h>
 
 #include <asn/t38.h>
+#include <opal/connection.h>
 #include <opal/patch.h>
+#include <rtp/rtp.h>
 
 #include "../audio.h"
 #include "../t38engine.h"
+#include "../ifpcodec.h"
+#include "../stats.h"
+#include "../bintrace.h"
 #include "modemstrm.h"
 
+#ifdef MODEM_REACTOR
+  #include <sys/epoll.h>
+#endif
+
 #define new PNEW
 
 /////////////////////////////////////////////////////////////////////////////
@@ -87,12 +96,7 @@ AudioModemMediaStream::AudioModemMediaStream(
 {
   PTRACE(4, "AudioModemMediaStream::AudioModemMediaStream " << *this);
 
-  PAssert(audioEngine != NULL, "audioEngine is NULL");
-}
-
-AudioModemMediaStream::~AudioModemMediaStream()
-{
-  ReferenceObject::DelPointer(audioEngine);
+  PAssert(!audioEngine.IsNULL(), "audioEngine is NULL");
 }
 
 PBoolean AudioModemMediaStream::Open()
@@ -148,6 +152,54 @@ PBoolean AudioModemMediaStream::WriteData(const BYTE * data, PINDEX length, PIND
   return true;
 }
 /////////////////////////////////////////////////////////////////////////////
+// enough for any IFP packet prepared by T38Engine
+static const PINDEX MAX_IFP_SIZE = 256;
+
+void RTPPayloadPERStream::EncodeTo(const PASN_Object & obj, RTP_DataFrame & packet)
+{
+  // PER encoder ORs the bits, so the buffer should be cleared
+  packet.SetPayloadSize(MAX_IFP_SIZE);
+  BYTE *pPayload = packet.GetPayloadPtr();
+  memset(pPayload, 0, MAX_IFP_SIZE);
+
+  Attach(pPayload, MAX_IFP_SIZE);
+  ResetDecoder();
+  obj.Encode(*this);
+
+  // do not call CompleteEncoding(), it will reallocate the buffer
+  PINDEX size = byteOffset + (bitOffset != 8 ? 1 : 0);
+
+  if (theArray != (char *)pPayload) {
+    // the buffer was too small and the encoder allocated a new one
+    PTRACE(2, "RTPPayloadPERStream::EncodeTo " << size << " bytes > " << MAX_IFP_SIZE);
+    packet.SetPayloadSize(size);
+    memcpy(packet.GetPayloadPtr(), theArray, size);
+    Attach(NULL, 0);
+  }
+  else
+    packet.SetPayloadSize(size);
+}
+
+PBoolean RTPPayloadPERStream::DecodeFrom(PASN_Object & obj, const RTP_DataFrame & packet)
+{
+  return DecodeFrom(obj, packet.GetPayloadPtr(), packet.GetPayloadSize());
+}
+
+PBoolean RTPPayloadPERStream::DecodeFrom(PASN_Object & obj, const BYTE * data, PINDEX size)
+{
+  Attach(data, size);
+  ResetDecoder();
+
+  return obj.Decode(*this);
+}
+/////////////////////////////////////////////////////////////////////////////
+// default time to wait for the missing packets before they are reported lost
+static const unsigned DEFAULT_REORDER_HOLD_TIME = 5;
+
+// min time to wait for the missing packets if the remote sends FEC, the
+// repairs arrive with the later packets (see OPAL T38PseudoRTP_Handler)
+static const unsigned FEC_REORDER_HOLD_TIME = 500;
+
 T38ModemMediaStream::T38ModemMediaStream(
     OpalConnection & conn,
     unsigned sessionID,
@@ -155,17 +207,29 @@ T38ModemMediaStream::T38ModemMediaStream(
     T38Engine *engine)
   : OpalMediaStream(conn, OpalT38, sessionID, isSource)
   , t38engine(engine)
+  , ifp(NULL)
+  , reorder(*this)
+#ifdef MODEM_REACTOR
+  , directSession(NULL)
+  , directTask(NULL)
+#endif
 {
   PTRACE(4, "T38ModemMediaStream::T38ModemMediaStream " << *this);
 
-  PAssert(t38engine != NULL, "t38engine is NULL");
+  PAssert(!t38engine.IsNULL(), "t38engine is NULL");
+
+  ifp = t38engine->GetIFP();
 
   PTRACE(4, "T38ModemMediaStream::T38ModemMediaStream DataSize=" << GetDataSize());
 }
 
 T38ModemMediaStream::~T38ModemMediaStream()
 {
-  ReferenceObject::DelPointer(t38engine);
+#ifdef MODEM_REACTOR
+  StopDirect();
+#endif
+  reorder.Stop();
+  t38engine->PutIFP(ifp);
 }
 
 PBoolean T38ModemMediaStream::Open()
@@ -176,9 +240,28 @@ PBoolean T38ModemMediaStream::Open()
   PTRACE(3, "T38ModemMediaStream::Open " << *this);
 
   currentSequenceNumber = 0;
-#if PTRACING
   totallost = 0;
-#endif
+  totalrepeated = 0;
+  totalreordered = 0;
+
+  udptlStats = RTP_Encoding::ErrorRecoveryStatistics();
+  udptlStatsTime = 0;
+
+  if (IsSink()) {
+    const OpalConnection::StringOptions & options = connection.GetStringOptions();
+
+    reorderHoldTime = options.Contains("T38-Reorder-Hold-Time")
+                    ? options("T38-Reorder-Hold-Time").AsUnsigned()
+                    : DEFAULT_REORDER_HOLD_TIME;
+
+    PTRACE(3, "T38ModemMediaStream::Open reorder hold time " << reorderHoldTime);
+
+    PWaitAndSignal mutex(writeMutex);
+
+    reorder.Reset();
+    reorder.SetHoldTime(reorderHoldTime);
+    reorder.SetRepairSpan(0);
+  }
 
   if (IsSink())
     t38engine->OpenIn(EngineBase::HOWNERIN(this));
@@ -194,9 +277,23 @@ PBoolean T38ModemMediaStream::Close()
     PTRACE(3, "T38ModemMediaStream::Close " << *this);
 
     if (IsSink()) {
+#ifdef MODEM_REACTOR
+      StopDirect();
+#endif
+
+      {
+        PWaitAndSignal mutex(writeMutex);
+        reorder.Flush();
+        UpdateUdptlStats();
+      }
+
+      reorder.Stop();
+
       PTRACE(2, "T38ModemMediaStream::Close Send statistics:"
                 " sequence=" << currentSequenceNumber <<
-                " lost=" << totallost);
+                " lost=" << totallost <<
+                " repeated=" << totalrepeated <<
+                " reordered=" << totalreordered);
 
       t38engine->CloseIn(EngineBase::HOWNERIN(this));
     } else {
@@ -241,12 +338,147 @@ void T38ModemMediaStream::OnStartMediaPatch()
   }
 }
 
+PBoolean T38ModemMediaStream::RequiresPatchThread(OpalMediaStream * stream) const
+{
+#ifdef MODEM_REACTOR
+  if (GetDirectSession(stream) != NULL)
+    return FALSE;   // the source will be read by directTask (see SetPatch())
+#endif
+
+  return OpalMediaStream::RequiresPatchThread(stream);
+}
+
+PBoolean T38ModemMediaStream::SetPatch(OpalMediaPatch * patch)
+{
+#ifdef MODEM_REACTOR
+  StopDirect();
+#endif
+
+  if (!OpalMediaStream::SetPatch(patch))
+    return FALSE;
+
+#ifdef MODEM_REACTOR
+  // OPAL creates a passive patch if RequiresPatchThread() returned FALSE
+  if (patch != NULL && PIsDescendant(patch, OpalPassiveMediaPatch)) {
+    RTP_UDP * rtpUDP = GetDirectSession(&patch->GetSource());
+
+    if (rtpUDP != NULL)
+      return StartDirect(patch->GetSource(), *rtpUDP);
+  }
+#endif
+
+  return TRUE;
+}
+
+#ifdef MODEM_REACTOR
+RTP_UDP * T38ModemMediaStream::GetDirectSession(OpalMediaStream * stream) const
+{
+  if (!IsSink() || !connection.GetStringOptions().GetBoolean("T38-Direct-UDPTL"))
+    return NULL;
+
+  OpalRTPMediaStream * rtpStream = dynamic_cast<OpalRTPMediaStream *>(stream);
+
+  if (rtpStream == NULL)
+    return NULL;
+
+  RTP_UDP * rtpUDP = dynamic_cast<RTP_UDP *>(&rtpStream->GetRtpSession());
+
+  if (rtpUDP == NULL || !(rtpUDP->GetEncoding() *= "udptl"))
+    return NULL;
+
+  if (ModemReactor::GetReactor() == NULL) {
+    myPTRACE(1, "T38ModemMediaStream::GetDirectSession: can't use direct UDPTL"
+                " from " << *stream << " w/o modem reactor (see --pty-reactor)");
+    return NULL;
+  }
+
+  return rtpUDP;
+}
+
+PBoolean T38ModemMediaStream::StartDirect(OpalMediaStream & source, RTP_UDP & rtpUDP)
+{
+  ModemReactorTask * task = new ModemReactorTask(*ModemReactor::GetReactor(), PCREATE_NOTIFIER(OnDirectTask));
+
+  if (!task->Attach(rtpUDP.GetDataSocketHandle())) {
+    myPTRACE(1, "T38ModemMediaStream::StartDirect: can't attach UDPTL socket of " << source);
+    delete task;
+    return FALSE;
+  }
+
+  directSource = &source;
+  directSession = &rtpUDP;
+  directTask = task;
+
+  myPTRACE(3, "T38ModemMediaStream::StartDirect: direct UDPTL from " << source);
+
+  directTask->Schedule();   // read the packets queued before arming
+
+  return TRUE;
+}
+
+void T38ModemMediaStream::StopDirect()
+{
+  if (directTask == NULL)
+    return;
+
+  directTask->Detach();
+  delete directTask;
+  directTask = NULL;
+
+  directSession = NULL;
+  directSource.SetNULL();
+
+  myPTRACE(3, "T38ModemMediaStream::StopDirect: stopped direct UDPTL for " << *this);
+}
+
+void T38ModemMediaStream::OnDirectTask(ModemReactorTask & task, INT)
+{
+  if (!isOpen)
+    return;
+
+  for (;;) {
+    if (!directSession->HasPendingData()) {
+      switch (PSocket::Select(directSession->GetDataSocket(), directSession->GetControlSocket(), 0)) {
+        case -1:
+        case -2:
+        case -3:
+          break;
+        default:
+          // nothing to read (or an error that the next read will report)
+          task.Arm(EPOLLIN);
+          return;
+      }
+    }
+
+    // the same as OpalMediaPatch::Main() does for the patch thread, but
+    // ReadData() w/o loop empties the frame if it read a control packet only
+    if (directFrame.GetSize() < RTP_DataFrame::MinHeaderSize)
+      directFrame = RTP_DataFrame(0);
+
+    directFrame.SetPayloadSize(0);
+    directFrame.SetPayloadType(directSource->GetMediaFormat().GetPayloadType());
+
+    if (!directSession->ReadData(directFrame, FALSE)) {
+      myPTRACE(3, "T38ModemMediaStream::OnDirectTask: read shut down for " << *this);
+      return;
+    }
+
+    if (directFrame.GetSize() == 0 || directSource->IsPaused())
+      continue;   // control packet or ignored one
+
+    if (!WritePacket(directFrame)) {
+      myPTRACE(3, "T38ModemMediaStream::OnDirectTask: write failed for " << *this);
+      return;
+    }
+  }
+}
+#endif
+
 PBoolean T38ModemMediaStream::ReadPacket(RTP_DataFrame & packet)
 {
   if (!isOpen)
     return FALSE;
 
-  T38_IFP ifp;
   int res;
 
   packet.SetTimestamp(timestamp);
@@ -254,21 +486,31 @@ PBoolean T38ModemMediaStream::ReadPacket(RTP_DataFrame & packet)
 
   do {
     //PTRACE(4, "T38ModemMediaStream::ReadPacket ...");
-    res = t38engine->PreparePacket(EngineBase::HOWNEROUT(this), ifp);
+    res = t38engine->PreparePacket(EngineBase::HOWNEROUT(this), *ifp);
   } while (currentSequenceNumber == 0 && res < 0);
 
   packet[0] = 0x80;
   packet.SetPayloadType(mediaFormat.GetPayloadType());
 
   if (res > 0) {
-    PTRACE(4, "T38ModemMediaStream::ReadPacket ifp = " << setprecision(2) << ifp);
+    PTRACE(4, "T38ModemMediaStream::ReadPacket ifp = " << setprecision(2) << *ifp);
+
+    IFPFlat flat;
+    PINDEX size = 0;
+
+    if (IFPCodec::Get(flat, *ifp)) {
+      packet.SetPayloadSize(MAX_IFP_SIZE);
+      size = IFPCodec::Encode(flat, packet.GetPayloadPtr(), MAX_IFP_SIZE);
+    }
 
-    PASN_OctetString ifp_packet;
-    ifp_packet.EncodeSubType(ifp);
+    if (size > 0)
+      packet.SetPayloadSize(size);
+    else
+      perStream.EncodeTo(*ifp, packet);
 
-    packet.SetPayloadSize(ifp_packet.GetDataLength());
-    memcpy(packet.GetPayloadPtr(), ifp_packet.GetPointer(), ifp_packet.GetDataLength());
     packet.SetSequenceNumber(WORD(currentSequenceNumber++ & 0xFFFF));
+
+    ModemStats::Add(t38engine->Stats().ifpOut);
   }
   else
   if (res < 0) {
@@ -279,16 +521,17 @@ PBoolean T38ModemMediaStream::ReadPacket(RTP_DataFrame & packet)
 
     packet.SetPayloadSize(0);
     packet.SetSequenceNumber(WORD((currentSequenceNumber - 1) & 0xFFFF));
+
+    ModemStats::Add(t38engine->Stats().ifpOutRepeated);
   }
   else {
     return FALSE;
   }
 
-  PTRACE(5, "T38ModemMediaStream::ReadPacket"
-            " packet " << packet.GetSequenceNumber() <<
-            " size=" << packet.GetPayloadSize() <<
-            " type=" << packet.GetPayloadType() <<
-            " ts=" << packet.GetTimestamp());
+  myBTRACE(5, btReadPacket, (packet.GetSequenceNumber(),
+                             packet.GetPayloadSize(),
+                             packet.GetPayloadType(),
+                             packet.GetTimestamp()));
 
   return TRUE;
 }
@@ -298,71 +541,137 @@ PBoolean T38ModemMediaStream::WritePacket(RTP_DataFrame & packet)
   if (!isOpen)
     return FALSE;
 
-  PTRACE(5, "T38ModemMediaStream::WritePacket "
-            " packet " << packet.GetSequenceNumber() <<
-            " size=" << packet.GetPayloadSize() <<
-            " " << packet.GetPayloadType());
+  myBTRACE(5, btWritePacket, (packet.GetSequenceNumber(),
+                              packet.GetPayloadSize(),
+                              packet.GetPayloadType()));
 
   if (mediaFormat.GetPayloadType() != packet.GetPayloadType()) {
-    PTRACE(5, "T38ModemMediaStream::WritePacket: ignored packet with mismatched payload type");
+    myBTRACE(5, btWritePacketMismatched, ());
     return TRUE;
   }
 
-  long packedSequenceNumber = (packet.GetSequenceNumber() & 0xFFFF) + (currentSequenceNumber & ~0xFFFFL);
-  long lost = packedSequenceNumber - currentSequenceNumber;
+  PWaitAndSignal mutex(writeMutex);
 
-  if (lost < -0x10000L/2) {
-    lost += 0x10000L;
-    packedSequenceNumber += 0x10000L;
-  }
-  else
-  if (lost > 0x10000L/2) {
-    lost -= 0x10000L;
-    packedSequenceNumber -= 0x10000L;
+  PTimeInterval now = PTimer::Tick();
+
+  if (now >= udptlStatsTime) {
+    udptlStatsTime = now + 1000;
+    UpdateUdptlStats();
   }
 
-  if (lost < 0) {
-    PTRACE(lost == -1 ? 5 : 3,
-        "T38ModemMediaStream::WritePacket: " << (packet.GetPayloadSize() == 0 ? "Fake" : "Repeated") <<
-        " packet " << packedSequenceNumber << " (expected " << currentSequenceNumber << ")");
+  return reorder.Put(packet.GetSequenceNumber(), packet.GetPayloadPtr(), packet.GetPayloadSize());
+}
 
-    if (lost > -10)
-      return TRUE;
-  }
+PBoolean T38ModemMediaStream::HandleIFP(long sequenceNumber, const BYTE * data, PINDEX size)
+{
+  currentSequenceNumber = sequenceNumber + 1;
 
-  if (packet.GetPayloadSize() == 0) {
-    PTRACE(5, "T38ModemMediaStream::WritePacket: ignored fake packet");
+  IFPFlat flat;
+
+  if (IFPCodec::Decode(flat, data, size))
+    IFPCodec::Put(*ifp, flat);
+  else
+  if (!perStream.DecodeFrom(*ifp, data, size)) {
+    PTRACE(2, "T38ModemMediaStream::HandleIFP " T38_IFP_NAME " decode failure: "
+        << PRTHEX(PBYTEArray(data, size)) << "\n  ifp = "
+        << setprecision(2) << *ifp);
+    ModemStats::Add(t38engine->Stats().ifpInDecodeErrors);
     return TRUE;
   }
 
-  PASN_OctetString ifp_packet((const char *)packet.GetPayloadPtr(), packet.GetPayloadSize());
+  ModemStats::Add(t38engine->Stats().ifpIn);
 
-  T38_IFP ifp;
+  return t38engine->HandlePacket(EngineBase::HOWNERIN(this), *ifp);
+}
 
-  if (!ifp_packet.DecodeSubType(ifp)) {
-    PTRACE(2, "T38ModemMediaStream::WritePacket " T38_IFP_NAME " decode failure: "
-        << PRTHEX(PBYTEArray(ifp_packet)) << "\n  ifp = "
-        << setprecision(2) << ifp);
-    return TRUE;
-  }
+PBoolean T38ModemMediaStream::HandleLost(long lost)
+{
+  if (lost < 0 || lost > 10)
+    lost = 1;
 
-  if (lost != 0) {
-    if (lost < 0 || lost > 10)
-      lost = 1;
+  totallost += lost;
+  ModemStats::Add(t38engine->Stats().ifpInLost, lost);
 
-#if PTRACING
-    totallost += lost;
-#endif
+  return t38engine->HandlePacketLost(EngineBase::HOWNERIN(this), lost);
+}
+
+PBoolean T38ModemMediaStream::Reorder::OnIFP(long sequenceNumber, const BYTE * data, PINDEX size)
+{
+  return stream.HandleIFP(sequenceNumber, data, size);
+}
 
-    if (!t38engine->HandlePacketLost(EngineBase::HOWNERIN(this), lost))
-      return FALSE;
+PBoolean T38ModemMediaStream::Reorder::OnLost(long lost)
+{
+  return stream.HandleLost(lost);
+}
 
-    PTRACE(3, "T38ModemMediaStream::WritePacket: adjusting sequence number to " << packedSequenceNumber);
+void T38ModemMediaStream::Reorder::OnIgnored(long sequenceNumber, long expected, PINDEX size)
+{
+  if (size == 0) {
+    if (sequenceNumber < expected)
+      myBTRACE(expected - sequenceNumber == 1 ? 5 : 3, btWritePacketFake, (int(sequenceNumber), int(expected)));
+    else
+      myBTRACE(5, btWritePacketIgnoredFake, ());
+
+    ModemStats::Add(stream.t38engine->Stats().ifpInFake);
+  } else {
+    myBTRACE(expected - sequenceNumber == 1 ? 5 : 3, btWritePacketRepeated, (int(sequenceNumber), int(expected)));
+    stream.totalrepeated++;
+    ModemStats::Add(stream.t38engine->Stats().ifpInRepeated);
   }
+}
 
-  currentSequenceNumber = packedSequenceNumber + 1;
+void T38ModemMediaStream::Reorder::OnHeld(long sequenceNumber, long expected)
+{
+  myBTRACE(4, btWritePacketHeld, (int(sequenceNumber), int(expected)));
+}
+
+void T38ModemMediaStream::Reorder::OnReordered(long /*sequenceNumber*/)
+{
+  stream.totalreordered++;
+  ModemStats::Add(stream.t38engine->Stats().ifpInReordered);
+}
+
+void T38ModemMediaStream::UpdateUdptlStats()
+{
+  OpalMediaPatch * patch = GetPatch();
+
+  if (patch == NULL)
+    return;
+
+  OpalRTPMediaStream * rtpStream = dynamic_cast<OpalRTPMediaStream *>(&patch->GetSource());
+
+  if (rtpStream == NULL)
+    return;
 
-  return t38engine->HandlePacket(EngineBase::HOWNERIN(this), ifp);
+  RTP_Encoding::ErrorRecoveryStatistics last = udptlStats;
+
+  if (!RTP_Session::EncodingLock(rtpStream->GetRtpSession())->GetErrorRecoveryStatistics(udptlStats))
+    return;
+
+  if (udptlStats.m_packetsReceived < last.m_packetsReceived)
+    last = RTP_Encoding::ErrorRecoveryStatistics();   // the session was restarted
+
+  ModemStats & stats = t38engine->Stats();
+
+  ModemStats::Add(stats.udptlIn, udptlStats.m_packetsReceived - last.m_packetsReceived);
+  ModemStats::Add(stats.udptlInLost, udptlStats.m_packetsLost - last.m_packetsLost);
+  ModemStats::Add(stats.udptlRedundancyRaised, udptlStats.m_levelRaised - last.m_levelRaised);
+  ModemStats::Add(stats.udptlRedundancyLowered, udptlStats.m_levelLowered - last.m_levelLowered);
+  ModemStats::Set(stats.udptlLossRate, udptlStats.m_lossRate);
+
+  if (udptlStats.m_redundancyLevel >= 0)
+    ModemStats::Set(stats.udptlRedundancyLevel, udptlStats.m_redundancyLevel);
+
+  if (reorder.GetRepairSpan() != udptlStats.m_repairSpan) {
+    // wait for the FEC repairs even if the reorder window is disabled
+    reorder.SetRepairSpan(udptlStats.m_repairSpan);
+    reorder.SetHoldTime(udptlStats.m_repairSpan > 0 && reorderHoldTime < FEC_REORDER_HOLD_TIME
+                        ? PTimeInterval(FEC_REORDER_HOLD_TIME) : reorderHoldTime);
+
+    PTRACE(3, "T38ModemMediaStream::UpdateUdptlStats: FEC repair span " << udptlStats.m_repairSpan
+              << ", reorder hold time " << reorder.GetHoldTime().GetMilliSeconds());
+  }
 }
 /////////////////////////////////////////////////////////////////////////////
 
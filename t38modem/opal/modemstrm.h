@@ -49,6 +49,10 @@
 #define _MY_MODEM_MEDIA_STREAM_H
 
 #include <opal/mediastrm.h>
+#include <ptclib/asner.h>
+#include "../enginebase.h"
+#include "../reactor.h"
+#include "../ifpreorder.h"
 
 /////////////////////////////////////////////////////////////////////////////
 class AudioEngine;
@@ -67,8 +71,6 @@ class AudioModemMediaStream : public OpalMediaStream
       PBoolean isSource,                   ///<  Is a source stream
       AudioEngine *engine
     );
-
-    ~AudioModemMediaStream();
   //@}
 
   /**@name Overrides of OpalRawMediaStream class */
@@ -92,10 +94,40 @@ class AudioModemMediaStream : public OpalMediaStream
   //@}
 
   protected:
-    AudioEngine *audioEngine;
+    ReferencePointer<AudioEngine> audioEngine;
+};
+/////////////////////////////////////////////////////////////////////////////
+/**PER stream working in place on the payload of RTP frames.
+  */
+class RTPPayloadPERStream : public PPER_Stream
+{
+    PCLASSINFO(RTPPayloadPERStream, PPER_Stream);
+  public:
+    /**Encode obj to the payload of packet and set the payload size.
+      */
+    void EncodeTo(
+      const PASN_Object & obj,
+      RTP_DataFrame & packet
+    );
+
+    /**Decode obj from the payload of packet.
+      */
+    PBoolean DecodeFrom(
+      PASN_Object & obj,
+      const RTP_DataFrame & packet
+    );
+
+    /**Decode obj from the buffer.
+      */
+    PBoolean DecodeFrom(
+      PASN_Object & obj,
+      const BYTE * data,
+      PINDEX size
+    );
 };
 /////////////////////////////////////////////////////////////////////////////
 class T38Engine;
+class RTP_UDP;
 
 class T38ModemMediaStream : public OpalMediaStream
 {
@@ -130,14 +162,88 @@ class T38ModemMediaStream : public OpalMediaStream
     );
 
     virtual PBoolean IsSynchronous() const { return FALSE; }
+
+    /**Check if the sink stream can read the UDPTL session of the source
+       stream directly. If yes then returns FALSE, so no patch thread will
+       be started and SetPatch() will attach the session socket to the
+       modem reactor.
+      */
+    virtual PBoolean RequiresPatchThread(
+      OpalMediaStream * stream
+    ) const;
+
+    virtual PBoolean SetPatch(
+      OpalMediaPatch * patch
+    );
   //@}
 
   protected:
+#ifdef MODEM_REACTOR
+    RTP_UDP * GetDirectSession(OpalMediaStream * stream) const;
+    PBoolean StartDirect(OpalMediaStream & source, RTP_UDP & rtpUDP);
+    void StopDirect();
+    PDECLARE_NOTIFIER(ModemReactorTask, T38ModemMediaStream, OnDirectTask);
+#endif
+
+    /**Decode and handle the IFP packet with the sequence number.
+      */
+    PBoolean HandleIFP(
+      long sequenceNumber,
+      const BYTE * data,
+      PINDEX size
+    );
+
+    /**Report the lost IFP packets.
+      */
+    PBoolean HandleLost(
+      long lost
+    );
+
+    /**Add the error recovery statistics of the UDPTL session to the modem
+       statistics.
+      */
+    void UpdateUdptlStats();
+
     long currentSequenceNumber;
-#if PTRACING
-    int totallost;
+    long totallost;
+    long totalrepeated;
+    long totalreordered;
+    ReferencePointer<T38Engine> t38engine;
+    T38_IFP * ifp;
+    RTPPayloadPERStream perStream;
+
+    RTP_Encoding::ErrorRecoveryStatistics udptlStats;  // added to modem statistics
+    PTimeInterval udptlStatsTime;          // to add them next time
+    PMutex writeMutex;
+
+    /**Reorder window of the received IFP packets.
+      */
+    class Reorder : public IFPReorder
+    {
+        PCLASSINFO(Reorder, IFPReorder);
+      public:
+        Reorder(T38ModemMediaStream & _stream)
+          : IFPReorder(_stream.writeMutex), stream(_stream) {}
+
+      protected:
+        virtual PBoolean OnIFP(long sequenceNumber, const BYTE * data, PINDEX size);
+        virtual PBoolean OnLost(long lost);
+        virtual void OnIgnored(long sequenceNumber, long expected, PINDEX size);
+        virtual void OnHeld(long sequenceNumber, long expected);
+        virtual void OnReordered(long sequenceNumber);
+
+        T38ModemMediaStream & stream;
+    };
+
+    Reorder reorder;
+    PTimeInterval reorderHoldTime;         // to wait for the missing packets w/o FEC
+
+#ifdef MODEM_REACTOR
+    OpalMediaStreamPtr directSource;       // read by directTask instead of patch thread
+    RTP_UDP * directSession;
+    ModemReactorTask * directTask;
+    RTP_DataFrame directFrame;
 #endif
-    T38Engine * t38engine;
 };
 /////////////////////////////////////////////////////////////////////////////
 
@@ -70,6 +70,32 @@
 
 #define new PNEW
 
+///////////////////////////////////////////////////////////////
+/*
+ * PString::HashFunction() uses only 8 first characters, so the tokens
+ * like "ttyT38-123" are hashed to the same bucket
+ */
+class PseudoModemKey : public PString
+{
+    PCLASSINFO(PseudoModemKey, PString);
+  public:
+    PseudoModemKey(const PString &str) : PString(str) {}
+
+    virtual PObject *Clone() const { return new PseudoModemKey(*this); }
+    virtual PINDEX HashFunction() const;
+};
+
+PINDEX PseudoModemKey::HashFunction() const
+{
+  DWORD hash = 2166136261U;
+
+  for (const char *p = theArray ; p && *p ; p++)
+    hash = (hash ^ (BYTE)*p) * 16777619U;
+
+  return PINDEX(hash % 1021);
+}
+
+PDICTIONARY(_PseudoModemDict, PseudoModemKey, PseudoModem);
 ///////////////////////////////////////////////////////////////
 PLIST(_PseudoModemList, PseudoModem);
 
@@ -77,10 +103,12 @@ class PseudoModemList : protected _PseudoModemList
 {
     PCLASSINFO(PseudoModemList, _PseudoModemList);
   public:
+    PseudoModemList() { index.DisallowDeleteObjects(); }
+
     PINDEX Append(PseudoModem *modem);
     PseudoModem *Find(const PString &modemToken) const;
   protected:
-    PseudoModem *_Find(const PString &modemToken) const;
+    _PseudoModemDict index;
     PMutex Mutex;
 };
 
@@ -88,13 +116,14 @@ PINDEX PseudoModemList::Append(PseudoModem *modem)
 {
   PWaitAndSignal mutexWait(Mutex);
 
-  if (_Find(modem->modemToken())) {
+  if (index.Contains(modem->modemToken())) {
     myPTRACE(1, "PseudoModemList::Append can't add " << modem->ptyName() << " to modem list");
     delete modem;
     return P_MAX_INDEX;
   }
 
   PINDEX i = _PseudoModemList::Append(modem);
+  index.SetAt(modem->modemToken(), modem);
 
   myPTRACE(3, "PseudoModemList::Append " << modem->ptyName() << " (" << i << ") OK");
 
@@ -104,20 +133,125 @@ PINDEX PseudoModemList::Append(PseudoModem *modem)
 PseudoModem *PseudoModemList::Find(const PString &modemToken) const
 {
   PWaitAndSignal mutexWait(Mutex);
-  return _Find(modemToken);
+  return index.GetAt(modemToken);
 }
+///////////////////////////////////////////////////////////////
+/*
+ * Queue of modems with the same route.
+ *
+ * The queue is linked through the modems, so enqueueing does not
+ * allocate memory. The queues are kept when they get empty.
+ */
+class PseudoModemRouteQ : public PObject
+{
+    PCLASSINFO(PseudoModemRouteQ, PObject);
+  public:
+    PseudoModemRouteQ() : first(NULL), last(NULL) {}
+
+    PseudoModem *first;
+    PseudoModem *last;
+};
+
+PDICTIONARY(_PseudoModemRouteDict, PseudoModemKey, PseudoModemRouteQ);
+
+/*
+ * Index of queued modems.
+ *
+ * The modems with the same route are kept in the same queue, so the
+ * modems that accept a number can be found by looking up the queues
+ * for all prefixes of the number. The enqueue sequence numbers (kept in
+ * the modems) allow to select the modem that was enqueued first.
+ */
+class PseudoModemIndex : public PObject
+{
+    PCLASSINFO(PseudoModemIndex, PObject);
+  public:
+    PseudoModemIndex() : lastSeq(0) {}
+
+    PBoolean Append(PseudoModem *modem);
+    PseudoModem *FindWithRoute(const PString &number) const;
+    PBoolean Remove(PseudoModem *modem);
 
-PseudoModem *PseudoModemList::_Find(const PString &modemToken) const
+  protected:
+    _PseudoModemRouteDict routes;
+    PINDEX lastSeq;
+};
+
+PBoolean PseudoModemIndex::Append(PseudoModem *modem)
 {
-  PObject *object;
+  if (modem->queueSeq)
+    return FALSE;
+
+  PseudoModemRouteQ *routeQ = routes.GetAt(modem->Route());
 
-  for (PINDEX i = 0 ; (object = GetAt(i)) != NULL ; i++) {
-    PAssert(PIsDescendant(object, PseudoModem), PInvalidCast);
-    PseudoModem *modem = (PseudoModem *)object;
-    if (modem->modemToken() == modemToken)
-      return modem;
+  if (!routeQ) {
+    routeQ = new PseudoModemRouteQ();
+    routes.SetAt(modem->Route(), routeQ);
   }
-  return NULL;
+
+  modem->queueNext = NULL;
+  modem->queuePrev = routeQ->last;
+
+  if (routeQ->last)
+    routeQ->last->queueNext = modem;
+  else
+    routeQ->first = modem;
+
+  routeQ->last = modem;
+  modem->queueSeq = ++lastSeq;
+
+  return TRUE;
+}
+
+PseudoModem *PseudoModemIndex::FindWithRoute(const PString &number) const
+{
+  PseudoModem *found = NULL;
+  PINDEX foundSeq = P_MAX_INDEX;
+
+  for (PINDEX len = 0 ; len <= number.GetLength() ; len++) {
+    const PseudoModemRouteQ *routeQ = routes.GetAt(PseudoModemKey(number.Left(len)));
+
+    if (!routeQ)
+      continue;
+
+    for (PseudoModem *modem = routeQ->first ; modem != NULL ; modem = modem->queueNext) {
+      if (modem->queueSeq > foundSeq)
+        break;			// the rest was enqueued later
+
+      if (modem->CheckRoute(number) && modem->IsReady()) {
+        found = modem;
+        foundSeq = modem->queueSeq;
+        break;
+      }
+    }
+  }
+
+  return found;
+}
+
+PBoolean PseudoModemIndex::Remove(PseudoModem *modem)
+{
+  if (!modem->queueSeq)
+    return FALSE;
+
+  PseudoModemRouteQ *routeQ = routes.GetAt(modem->Route());
+
+  if (routeQ) {
+    if (modem->queuePrev)
+      modem->queuePrev->queueNext = modem->queueNext;
+    else
+      routeQ->first = modem->queueNext;
+
+    if (modem->queueNext)
+      modem->queueNext->queuePrev = modem->queuePrev;
+    else
+      routeQ->last = modem->queuePrev;
+  }
+
+  modem->queueNext = modem->queuePrev = NULL;
+  modem->queueSeq = 0;
+
+  return TRUE;
 }
 ///////////////////////////////////////////////////////////////
 PObject::Comparison PseudoModem::Compare(const PObject & obj) const
@@ -130,10 +264,12 @@ PObject::Comparison PseudoModem::Compare(const PObject & obj) const
 PseudoModemQ::PseudoModemQ()
 {
   pmodem_list = new PseudoModemList();
+  pmodem_index = new PseudoModemIndex();
 }
 
 PseudoModemQ::~PseudoModemQ()
 {
+  delete pmodem_index;
   delete pmodem_list;
 }
 
@@ -162,8 +298,13 @@ void PseudoModemQ::Enqueue(PseudoModem *modem)
   myPTRACE((modem != NULL) ? 3 : 1, "PseudoModemQ::Enqueue "
     << ((modem != NULL) ? modem->ptyName() : "BAD"));
 
+  if (modem == NULL)
+    return;
+
   PWaitAndSignal mutexWait(Mutex);
-  _PseudoModemQ::Enqueue(modem);
+
+  if (!pmodem_index->Append(modem))
+    myPTRACE(1, "PseudoModemQ::Enqueue " << modem->ptyName() << " already queued");
 }
 
 PBoolean PseudoModemQ::Enqueue(const PString &modemToken)
@@ -183,41 +324,23 @@ PBoolean PseudoModemQ::Enqueue(const PString &modemToken)
 PseudoModem *PseudoModemQ::DequeueWithRoute(const PString &number)
 {
   PWaitAndSignal mutexWait(Mutex);
-  PObject *object;
-  
-  for( PINDEX i = 0 ; (object = GetAt(i)) != NULL ; i++ ) {
-    PAssert(PIsDescendant(object, PseudoModem), PInvalidCast);
-    PseudoModem *modem = (PseudoModem *)object;
-    if (modem->CheckRoute(number) && modem->IsReady()) {
-      if (!Remove(modem))
-        modem = NULL;
-      myPTRACE(3, "PseudoModemQ::DequeueWithRoute "
-        << ((modem != NULL) ? modem->ptyName() : "BAD"));
-      return modem;
-    }
-  }
-  return NULL;
-}
+  PseudoModem *modem = pmodem_index->FindWithRoute(number);
 
-PseudoModem *PseudoModemQ::Find(const PString &modemToken) const
-{
-  PObject *object;
+  if (modem == NULL)
+    return NULL;
 
-  for( PINDEX i = 0 ; (object = GetAt(i)) != NULL ; i++ ) {
-    PAssert(PIsDescendant(object, PseudoModem), PInvalidCast);
-    PseudoModem *modem = (PseudoModem *)object;
-    if( modem->modemToken() == modemToken ) {
-      return modem;
-    }
-  }
-  return NULL;
+  if (!pmodem_index->Remove(modem))
+    modem = NULL;
+  myPTRACE(3, "PseudoModemQ::DequeueWithRoute "
+    << ((modem != NULL) ? modem->ptyName() : "BAD"));
+  return modem;
 }
 
 PseudoModem *PseudoModemQ::Dequeue(const PString &modemToken)
 {
+  PseudoModem *modem = pmodem_list->Find(modemToken);
   PWaitAndSignal mutexWait(Mutex);
-  PseudoModem *modem = Find(modemToken);
-  if (modem != NULL && !Remove(modem))
+  if (modem != NULL && !pmodem_index->Remove(modem))
     modem = NULL;
   myPTRACE(1, "PseudoModemQ::Dequeue "
     << ((modem != NULL) ? modem->ptyName() : "BAD"));
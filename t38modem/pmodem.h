@@ -80,12 +80,14 @@ class PseudoModem : public ModemThread
 
   /**@name Construction */
   //@{
-    PseudoModem(const PString &_tty) : ttyname(_tty), valid(FALSE) {};
+    PseudoModem(const PString &_tty) : ttyname(_tty), valid(FALSE),
+      queueSeq(0), queueNext(NULL), queuePrev(NULL) {};
   //@}
 
   /**@name Operations */
     virtual PBoolean IsReady() const = 0;
     virtual PBoolean CheckRoute(const PString &number) const = 0;
+    virtual const PString &Route() const = 0;	// the prefix of accepted numbers
     virtual PBoolean Request(PStringToString &request) const = 0;
     virtual T38Engine *NewPtrT38Engine() const = 0;
     virtual AudioEngine *NewPtrAudioEngine() const = 0;
@@ -103,14 +105,21 @@ class PseudoModem : public ModemThread
     PString ttyname;
     PString ptyname;
     PBoolean valid;
+
+  private:
+    PINDEX queueSeq;	// enqueue sequence number, 0 if not queued
+    PseudoModem *queueNext;	// links of the route queue
+    PseudoModem *queuePrev;
+
+  friend class PseudoModemIndex;
 };
 ///////////////////////////////////////////////////////////////
 class PseudoModemList;
-PQUEUE(_PseudoModemQ, PseudoModem);
+class PseudoModemIndex;
 
-class PseudoModemQ : protected _PseudoModemQ
+class PseudoModemQ : public PObject
 {
-    PCLASSINFO(PseudoModemQ, _PseudoModemQ);
+    PCLASSINFO(PseudoModemQ, PObject);
   public:
   /**@name Construction */
   //@{
@@ -131,9 +140,8 @@ class PseudoModemQ : protected _PseudoModemQ
     PseudoModem *Dequeue(const PString &modemToken);
   //@}
   protected:
-    PseudoModem *Find(const PString &modemToken) const;
-
     PseudoModemList *pmodem_list;
+    PseudoModemIndex *pmodem_index;
     PMutex Mutex;
 };
 ///////////////////////////////////////////////////////////////
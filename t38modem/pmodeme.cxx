@@ -397,6 +397,9 @@
 #include "fcs.h"
 #include "t38engine.h"
 #include "audio.h"
+#include "reactor.h"
+#include "tone_gen.h"
+#include "stats.h"
 #include "version.h"
 
 ///////////////////////////////////////////////////////////////
@@ -818,8 +821,8 @@ class ModemEngineBody : public PObject
     PBoolean Request(PStringToString &request);
     EngineBase *NewPtrEngine(ModemClassEngine mce);
     void OnParentStop();
-    void HandleData(const PBYTEArray &buf, PBYTEArray &bresp);
-    void CheckState(PBYTEArray &bresp);
+    PINDEX HandleData(const BYTE *_pBuf, PINDEX count, PBYTEArena &bresp);
+    void CheckState(PBYTEArena &bresp);
     void CheckStatePost();
 
     PBoolean IsReady() const {
@@ -831,15 +834,51 @@ class ModemEngineBody : public PObject
       PWaitAndSignal mutexWait(Mutex);
       return currentClassEngine && currentClassEngine->isOutBufFull();
     }
+
+    PBoolean isInputHeld() const {
+      PWaitAndSignal mutexWait(Mutex);
+      return respHeld || connectHeld;
+    }
   //@}
 
   protected:
     PBoolean Echo() const { return P.Echo(); }
-    PBoolean HandleClass1Cmd(const char **ppCmd, PString &resp, PBoolean &ok, PBoolean &crlf);
-    PBoolean HandleClass8Cmd(const char **ppCmd, PString &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleClass1Cmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleClass8Cmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+
+    PBoolean HandleCmdFAA(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdFCLASS(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdFLO(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdFMFR(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdFMDL(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdFREV(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdIFC(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVCID(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVEM(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVGR(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVGT(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVIP(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVIT(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVLS(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVRA(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVRN(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVSD(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVSM(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+    PBoolean HandleCmdVTD(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+
+    typedef PBoolean (ModemEngineBody::*ExtCmdHandler)(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
+
+    struct ExtCmd {
+      const char *name;
+      ExtCmdHandler handler;
+    };
+
+    static const ExtCmd extCmds[];
+
+    PBoolean HandleExtCmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf);
     PBoolean Answer();
-    void HandleCmd(PString &resp);
-    void HandleCmdRest(PString &resp);
+    void HandleCmd(PBYTEArena &resp);
+    void HandleCmdRest(PBYTEArena &resp);
 
     unsigned EstablishmentTimeout() const {
       return unsigned(P.S7() ? P.S7() : Profiles[0].S7()) * 1000;
@@ -849,6 +888,17 @@ class ModemEngineBody : public PObject
       dleData.Clean();
       dataCount = 0;
       moreFrames = FALSE;
+      connectHeld = FALSE;
+      timerConnect.Stop();
+    }
+
+    void PutConnect(PBYTEArena &bresp) {
+      // send CONNECT just before data for AT+FRM command
+
+      PString _resp = RC_PREF() + RC_CONNECT();
+
+      myPTRACE(1, "<-- " << PRTHEX(PBYTEArray((const BYTE *)(const char *)_resp, _resp.GetLength())));
+      bresp.Put((const char *)_resp, _resp.GetLength());
     }
 
     PBoolean SetBitRevDleData() {
@@ -932,6 +982,8 @@ class ModemEngineBody : public PObject
 
     void _AttachEngine(ModemClassEngine mce);
     void _DetachEngine(ModemClassEngine mce);
+    PBoolean _TryDetachEngine(ModemClassEngine mce, PBoolean force);
+    void _CheckDetachingEngines(PBoolean force = FALSE);
     void _ClearCall();
 
     int NextSeq() { return seq = ++seq & EngineBase::cbpUserDataMask; }
@@ -940,6 +992,8 @@ class ModemEngineBody : public PObject
 
     EngineBase *activeEngines[mceNumberOfItems];
     EngineBase *currentClassEngine;
+    EngineBase *detachingEngines[mceNumberOfItems];
+    PTimeInterval detachDeadline[mceNumberOfItems];
 
     PBoolean enableFakeIn[mceNumberOfItems];
     PBoolean enableFakeOut[mceNumberOfItems];
@@ -953,8 +1007,15 @@ class ModemEngineBody : public PObject
     Timeout timerRing;
     Timeout timerBusy;
     Timeout timeout;
+    Timeout timerDetach;
+    Timeout timerResp;
+    Timeout timerConnect;
     PTime lastOnHookActivity;
 
+    PBoolean respHeld;
+    PString heldResp;
+    PBoolean connectHeld;
+
     int seq;
 
     PBoolean forceFaxMode;
@@ -975,6 +1036,8 @@ class ModemEngineBody : public PObject
     int callSubState;
     State state;
     int subState;
+    PTimeInterval stateStart;
+    ModemStats &stats;
 
     #define TRACE_STATE(level, header) \
         PTRACE(level, header \
@@ -1010,6 +1073,16 @@ class ModemEngineBody : public PObject
 
     void SetState(State newState, int newSubState = 0) {
       if (state != newState || subState != newSubState) {
+        if (state != newState) {
+          PTimeInterval now = PTimer::Tick();
+
+          if (int(state) < ModemStats::maxStates)
+            ModemStats::Hist(stats.stateTime[state], (now - stateStart).GetMilliSeconds());
+
+          ModemStats::Add(stats.stateChanges);
+          stateStart = now;
+        }
+
         state = newState;
         subState = newSubState;
         TRACE_STATE(4, "ModemEngineBody::SetState:");
@@ -1099,17 +1172,74 @@ class ModemEngineBody : public PObject
 
 ///////////////////////////////////////////////////////////////
 ModemEngine::ModemEngine(PseudoModemBody &_parent)
-  : ModemThreadChild(_parent)
+  : ModemThreadChild(_parent),
+    task(NULL)
 {
   body = new ModemEngineBody(*this, Parent().GetCallbackEndPoint());
 }
 
 ModemEngine::~ModemEngine()
 {
+#ifdef MODEM_REACTOR
+  if( task )
+    delete task;
+#endif
+
   if( body )
     delete body;
 }
 
+void ModemEngine::Start()
+{
+#ifdef MODEM_REACTOR
+  ModemReactor *reactor = Parent().GetReactor();
+
+  if (reactor) {
+    myPTRACE(1, "<-> Started in reactor for " << ptyName());
+
+    if( !body ) {
+      myPTRACE(1, "<-> no body" << ptyName());
+      SignalStop();
+      return;
+    }
+
+    task = new ModemReactorTask(*reactor, PCREATE_NOTIFIER(OnReactorTask));
+    task->Schedule();
+    return;
+  }
+#endif
+
+  Resume();
+}
+
+void ModemEngine::Stop()
+{
+  SignalStop();
+
+#ifdef MODEM_REACTOR
+  if (task) {
+    task->Detach();
+    body->OnParentStop();
+    myPTRACE(1, "<-> Stopped in reactor for " << ptyName());
+    return;
+  }
+#endif
+
+  WaitForTermination();
+}
+
+void ModemEngine::SignalDataReady()
+{
+#ifdef MODEM_REACTOR
+  if (task) {
+    task->Schedule();
+    return;
+  }
+#endif
+
+  ModemThreadChild::SignalDataReady();
+}
+
 PBoolean ModemEngine::IsReady() const
 {
   return body && body->IsReady();
@@ -1163,50 +1293,59 @@ void ModemEngine::Main()
     return;
   }
 
-  for(;;) {
-    PBYTEArray bresp;
+  while (HandleDataReady())
+    WaitDataReady();
 
-    if (stop)
-      break;
+  body->OnParentStop();
 
-    body->CheckState(bresp);
+  myPTRACE(1, "<-> Stopped" << GetThreadTimes(", CPU usage: "));
+}
 
-    if (stop)
-      break;
+PBoolean ModemEngine::HandleDataReady()
+{
+  bresp.Clean();
 
-    while( !body->isOutBufFull() ) {
-      PBYTEArray *buf = Parent().FromInPtyQ();
+  if (stop)
+    return FALSE;
 
-      if (buf)  {
-        body->HandleData(*buf, bresp);
-        delete buf;
-        if (stop)
-          break;
-      } else
-          break;
-    }
+  body->CheckState(bresp);
 
-    if (stop)
-      break;
+  if (stop)
+    return FALSE;
 
-    if (bresp.GetSize()) {
-      ToPtyQ(bresp, bresp.GetSize());
-    }
+  Parent().FlushOutPtyQ();
 
-    if (stop)
-      break;
+  while (!body->isOutBufFull() && !body->isInputHeld()) {
+    PINDEX count = 1024;
+    const BYTE *pBuf = Parent().FromInPtyQ(count);
 
-    body->CheckStatePost();
+    if (count)  {
+      count = body->HandleData(pBuf, count, bresp);
+      Parent().FromInPtyQDone(count);
+      if (stop)
+        return FALSE;
+    } else
+        break;
+  }
 
-    if (stop)
-      break;
+  if (stop)
+    return FALSE;
 
-    WaitDataReady();
+  if (bresp.GetSize()) {
+    ToPtyQ(bresp.GetPointer(), bresp.GetSize());
   }
 
-  body->OnParentStop();
+  if (stop)
+    return FALSE;
 
-  myPTRACE(1, "<-> Stopped" << GetThreadTimes(", CPU usage: "));
+  body->CheckStatePost();
+
+  return !stop;
+}
+
+void ModemEngine::OnReactorTask(ModemReactorTask &, INT)
+{
+  HandleDataReady();
 }
 
 ///////////////////////////////////////////////////////////////
@@ -1258,6 +1397,11 @@ ModemEngineBody::ModemEngineBody(ModemEngine &_parent, const PNotifier &_callbac
     timerRing(timerCallback, TRUE),
     timerBusy(timerCallback, TRUE),
     timeout(timerCallback),
+    timerDetach(timerCallback),
+    timerResp(timerCallback),
+    timerConnect(timerCallback),
+    respHeld(FALSE),
+    connectHeld(FALSE),
     seq(0),
     forceFaxMode(FALSE),
     connectionEstablished(FALSE),
@@ -1266,12 +1410,15 @@ ModemEngineBody::ModemEngineBody(ModemEngine &_parent, const PNotifier &_callbac
     callDirection(cdUndefined),
     callState(cstCleared),
     state(stCommand),
+    stateStart(PTimer::Tick()),
+    stats(ModemStats::Get(_parent.ptyName())),
     dataType(EngineBase::dtNone),
     sendOnIdle(EngineBase::dtNone),
     pPlayTone(NULL)
 {
   for (int i = 0 ; i < mceNumberOfItems ; i++) {
     activeEngines[i] = NULL;
+    detachingEngines[i] = NULL;
     enableFakeIn[i] = FALSE;
     enableFakeOut[i] = FALSE;
   }
@@ -1282,10 +1429,14 @@ ModemEngineBody::~ModemEngineBody()
   PWaitAndSignal mutexWait(Mutex);
 
   OnHook();
+  _CheckDetachingEngines(TRUE);
 
   timeout.Stop();
   timerRing.Stop();
   timerBusy.Stop();
+  timerDetach.Stop();
+  timerResp.Stop();
+  timerConnect.Stop();
 }
 
 void ModemEngineBody::OnParentStop()
@@ -1293,6 +1444,7 @@ void ModemEngineBody::OnParentStop()
   PWaitAndSignal mutexWait(Mutex);
 
   OnHook();
+  _CheckDetachingEngines(TRUE);
 }
 
 void ModemEngineBody::OnHook()
@@ -1591,35 +1743,12 @@ void ModemEngineBody::_DetachEngine(ModemClassEngine mce)
 {
   PAssert(mce == mceT38 || mce == mceAudio, "mce is not valid");
 
-  if (activeEngines[mce] == NULL)
-    return;
-
-  if (!CallToken().IsEmpty() && activeEngines[mce]->SendingNotCompleted()) {
-    Mutex.Signal();
-    myPTRACE(2, "ModemEngineBody::_DetachEngine: sending is not completed for " << mce);
-    PThread::Sleep(100);
-    Mutex.Wait();
-
-    if (activeEngines[mce] == NULL)
-      return;
-  }
-
-  for (;;) {
-    if (activeEngines[mce]->TryLockModemCallback()) {
-      activeEngines[mce]->Detach(engineCallback);
-      activeEngines[mce]->UnlockModemCallback();
-      ReferenceObject::DelPointer(activeEngines[mce]);
-      activeEngines[mce] = NULL;
-      break;
-    }
+  EngineBase *engine = activeEngines[mce];
 
-    Mutex.Signal();
-    PThread::Sleep(20);
-    Mutex.Wait();
+  if (engine == NULL)
+    return;
 
-    if (activeEngines[mce] == NULL)
-      return;
-  }
+  activeEngines[mce] = NULL;
 
   switch (mce) {
     case mceT38:
@@ -1638,7 +1767,67 @@ void ModemEngineBody::_DetachEngine(ModemClassEngine mce)
       break;
   }
 
+  if (detachingEngines[mce] != NULL)
+    _TryDetachEngine(mce, TRUE);
+
+  detachingEngines[mce] = engine;
+  detachDeadline[mce] = PTimer::Tick();
+
+  if (!CallToken().IsEmpty() && engine->SendingNotCompleted()) {
+    myPTRACE(2, "ModemEngineBody::_DetachEngine: sending is not completed for " << mce);
+    detachDeadline[mce] += 100;
+  }
+
+  _CheckDetachingEngines();
+}
+
+PBoolean ModemEngineBody::_TryDetachEngine(ModemClassEngine mce, PBoolean force)
+{
+  EngineBase *engine = detachingEngines[mce];
+
+  if (engine == NULL)
+    return TRUE;
+
+  if (!force && PTimer::Tick() < detachDeadline[mce] && engine->SendingNotCompleted())
+    return FALSE;
+
+  while (!engine->TryLockModemCallback()) {
+    if (!force)
+      return FALSE;
+
+    // the engine is in the callback and waits for Mutex
+    Mutex.Signal();
+    PThread::Sleep(20);
+    Mutex.Wait();
+
+    if (detachingEngines[mce] != engine)
+      return TRUE;
+  }
+
+  engine->Detach(engineCallback);
+  engine->UnlockModemCallback();
+  ReferenceObject::DelPointer(engine);
+  detachingEngines[mce] = NULL;
+
   myPTRACE(1, "ModemEngineBody::_DetachEngine Detached " << mce);
+
+  return TRUE;
+}
+
+void ModemEngineBody::_CheckDetachingEngines(PBoolean force)
+{
+  PBoolean pending = FALSE;
+
+  for (int i = 0 ; i < mceNumberOfItems ; i++) {
+    if (!_TryDetachEngine(ModemClassEngine(i), force))
+      pending = TRUE;
+  }
+
+  // retry from CheckState() instead of sleeping in the thread
+  if (pending)
+    timerDetach.Start(20);
+  else
+    timerDetach.Stop();
 }
 
 void ModemEngineBody::OnEngineCallback(PObject & PTRACE_PARAM(from), INT extra)
@@ -1725,7 +1914,7 @@ static int ParseNum(const char **ppCmd,
     return num;
 }
 
-PBoolean ModemEngineBody::HandleClass1Cmd(const char **ppCmd, PString &resp, PBoolean &ok, PBoolean &crlf)
+PBoolean ModemEngineBody::HandleClass1Cmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf)
 {
   PBoolean T;
 
@@ -1857,7 +2046,7 @@ PBoolean ModemEngineBody::HandleClass1Cmd(const char **ppCmd, PString &resp, PBo
                     }
 
                     if (!res)
-                      PThread::Sleep(100);	// workaround
+                      respHeld = TRUE;	// workaround
                     return res;
                   }
                 default:
@@ -1875,7 +2064,7 @@ PBoolean ModemEngineBody::HandleClass1Cmd(const char **ppCmd, PString &resp, PBo
   return TRUE;
 }
 
-PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PString &resp, PBoolean &ok, PBoolean &crlf)
+PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf)
 {
   PBoolean T;
 
@@ -1913,7 +2102,7 @@ PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PString &resp, PBo
               if (P.ModemClassId() == EngineBase::mcAudio) {
                 ok = FALSE;
 
-                PDTMFEncoder tone;
+                DTMFEncoder tone;
 
                 for (;;) {
                   int dms = P.Vtd();
@@ -2018,11 +2207,7 @@ PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PString &resp, PBo
                         unsigned ms = dms*10;
 
                         if (dtmf == ' ') {
-                          if (!tone.Generate(' ', 0, 0, ms)) {
-                            myPTRACE(1, "Cannot encode tone \"0 0:" << ms << "\"");
-                            return FALSE;
-                          }
-
+                          tone.AddSilence(ms);
                           myPTRACE(2, "Encoded tone \"0 0:" << ms << "\", size=" << tone.GetSize());
                         } else {
                           tone.AddTone(dtmf, ms);
@@ -2059,11 +2244,7 @@ PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PString &resp, PBo
                     case ',': {
                       unsigned ms = dms*10;
 
-                      if (!tone.Generate(' ', 0, 0, ms)) {
-                        myPTRACE(1, "Cannot encode tone \"0 0:" << ms << "\"");
-                        return FALSE;
-                      }
-
+                      tone.AddSilence(ms);
                       myPTRACE(2, "Encoded tone \"0 0:" << ms << "\", size=" << tone.GetSize());
                       break;
                     }
@@ -2127,7 +2308,7 @@ PBoolean ModemEngineBody::HandleClass8Cmd(const char **ppCmd, PString &resp, PBo
         }
 
         if (!res)
-          PThread::Sleep(100);	// workaround
+          respHeld = TRUE;	// workaround
 
         return res;
       } else {
@@ -2183,105 +2364,723 @@ PBoolean ModemEngineBody::Answer()
   return TRUE;
 }
 
-void ModemEngineBody::HandleCmd(PString &resp)
+PBoolean ModemEngineBody::HandleCmdFAA(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
 {
-  PINDEX i;
-
-  for (i = 0 ;  ; i++) {
-    i = cmd.FindOneOf("Aa", i);
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n0";
+          crlf = TRUE;
+          break;
+        default:
+          if (ParseNum(&pCmd) != 0)
+            return FALSE;
+      }
+      break;
+    case '?':
+      resp += "\r\n0";
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
 
-    if (i == P_MAX_INDEX) {
-      myPTRACE(1, "--> " << cmd.GetLength() << " bytes of binary");
-      cmd.MakeEmpty();
-      return;
-    }
+PBoolean ModemEngineBody::HandleCmdFCLASS(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n1,8";
+          crlf = TRUE;
+          break;
+        default: {
+          const char *modemClass;
 
-    PString at = cmd.Mid(i, 2);
+          switch (ParseNum(&pCmd)) {
+            case 0:
+              modemClass = "0";
+              break;
+            case 1:
+              modemClass = "1";
+              break;
+            case 8:
+              modemClass = "8";
+              break;
+            default:
+              return FALSE;
+          }
 
-    if (at == "AT" || at == "at")
+          PWaitAndSignal mutexWait(Mutex);
+          P.ModemClass(modemClass);
+          OnChangeModemClass();
+        }
+      }
       break;
+    case '?':
+      resp += "\r\n" + P.ModemClass();
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
   }
+  return TRUE;
+}
 
-#if PTRACING
-  if (i) {
-    PBYTEArray bin((const BYTE *)(const char *)cmd, i);
+PBoolean ModemEngineBody::HandleCmdFLO(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n0-2";
+          crlf = TRUE;
+          break;
+        default: {
+          int val = ParseNum(&pCmd);
 
-    myPTRACE(1, "--> " << PRTHEX(bin));
+          switch (val) {
+            case 0:
+            case 1:
+            case 2:
+              break;
+            default:
+              return FALSE;
+          }
+
+          PWaitAndSignal mutexWait(Mutex);
+          P.Flo((BYTE)val);
+        }
+      }
+      break;
+    case '?':
+      resp.sprintf("\r\n%u", (unsigned)P.Flo());
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
   }
-#endif
+  return TRUE;
+}
 
-  const char *pCmd;
+PBoolean ModemEngineBody::HandleCmdFMFR(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  if (*(*ppCmd)++ != '?')
+    return FALSE;
 
-  pCmd = ((const char *)cmd) + i;
+  resp += "\r\n" + PString(Manufacturer);
+  crlf = TRUE;
+  return TRUE;
+}
 
-  myPTRACE(1, "--> " << pCmd);
+PBoolean ModemEngineBody::HandleCmdFMDL(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  if (*(*ppCmd)++ != '?')
+    return FALSE;
 
-  pCmd += 2;  // skip AT
+  resp += "\r\n" + PString(Model);
+  crlf = TRUE;
+  return TRUE;
+}
 
-  cmdRest = PString(pCmd).ToUpper();
-  cmd.MakeEmpty();
+PBoolean ModemEngineBody::HandleCmdFREV(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  if (*(*ppCmd)++ != '?')
+    return FALSE;
 
-  HandleCmdRest(resp);
+  resp += "\r\n" + PString(Revision);
+  crlf = TRUE;
+  return TRUE;
 }
 
-#define ToSBit(funk)                    \
-  switch (ParseNum(&pCmd, 0, 1, 1)) {   \
-    case 0:                             \
-      P.funk(FALSE);                    \
-      break;                            \
-    case 1:                             \
-      P.funk(TRUE);                     \
-      break;                            \
-    default:                            \
-      err = TRUE;                       \
-  }
-
-void ModemEngineBody::HandleCmdRest(PString &resp)
+PBoolean ModemEngineBody::HandleCmdIFC(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
 {
-  PString tmp = cmdRest;
-  cmdRest.MakeEmpty();
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n+IFC:(0-2),(0-2)";
+          crlf = TRUE;
+          break;
+        default: {
+          int valByDTE = ParseNum(&pCmd, 1, 1, 2);
 
-  const char *pCmd = tmp;
-  PBoolean err = FALSE;
-  PBoolean ok = TRUE;
-  PBoolean crlf = FALSE;
+          if (valByDTE < 0)
+            return FALSE;
 
-  while (state == stCommand && !err && *pCmd) {
-      switch( *pCmd++ ) {
-        case ' ':
-        case ';':
-          break;
-        case 'A':	// Accept incoming call
-          ok = FALSE;
+          int valByDCE;
 
-          {
-            PWaitAndSignal mutexWait(Mutex);
+          if (*pCmd == ',') {
+            pCmd++;
 
-            callDirection = cdIncoming;
-            if (!Answer())
-              err = TRUE;
-          }
+            valByDCE = ParseNum(&pCmd);
 
-          break;
-        case 'B':       // Turn ITU-T V.22/BELL 212A
-          if (ParseNum(&pCmd, 0, 1) >= 0) {
+            if (valByDCE < 0)
+              return FALSE;
           } else {
-            err = TRUE;
+            valByDCE = P.IfcByDCE();
           }
-          break;
-        case 'D':	// Dial
-          ok = FALSE;
 
-          {
-            PWaitAndSignal mutexWait(Mutex);
+          PWaitAndSignal mutexWait(Mutex);
 
-            PBoolean wasOnHook = OffHook();
+          P.IfcByDTE((BYTE)valByDTE);
+          P.IfcByDCE((BYTE)valByDCE);
+        }
+      }
+      break;
+    case '?':
+      resp.sprintf("\r\n+IFC:%u,%u", (unsigned)P.IfcByDTE(), (unsigned)P.IfcByDCE());
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
 
-            PString num;
-            PString numTone;
-            PBoolean addNumTone;
-            PString LocalPartyName;
-            PBoolean local = FALSE;
+PBoolean ModemEngineBody::HandleCmdVCID(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n(0,1)";
+          crlf = TRUE;
+          break;
+        default: {
+          int val = ParseNum(&pCmd);
+
+          switch (val) {
+            case 0:
+            case 1:
+              break;
+            default:
+              return FALSE;
+          }
+
+          PWaitAndSignal mutexWait(Mutex);
+          P.CidMode((BYTE)val);
+        }
+      }
+      break;
+    case '?':
+      resp.sprintf("\r\n%u", (unsigned)P.CidMode());
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+PBoolean ModemEngineBody::HandleCmdVEM(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n(0)";
+          crlf = TRUE;
+          break;
+        default:
+          if (ParseNum(&pCmd) != 0)
+            return FALSE;
+      }
+      break;
+    case '?':
+      resp += "\r\n0";
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+PBoolean ModemEngineBody::HandleCmdVIP(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+  int val;
+
+  if (*pCmd == '=') {
+    pCmd++;
+    if (*pCmd == '?') {
+      pCmd++;
+      resp.sprintf("\r\n(0-%u)", sizeof(Profiles)/sizeof(Profiles[0]) - 1);
+      crlf = TRUE;
+      return TRUE;
+    }
+
+    val = ParseNum(&pCmd);
+
+    if( val < 0 || val > ((int)(sizeof(Profiles)/sizeof(Profiles[0])) - 1))
+      return FALSE;
+  } else {
+    val = 0;
+  }
+
+  PWaitAndSignal mutexWait(Mutex);
+  P.SetVoiceProfile(Profiles[val]);
+  return TRUE;
+}
+
+PBoolean ModemEngineBody::HandleCmdVIT(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n(0)";
+          crlf = TRUE;
+          break;
+        default:
+          if (ParseNum(&pCmd) < 0)
+            return FALSE;
+      }
+      break;
+    case '?':
+      resp += "\r\n0";
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+PBoolean ModemEngineBody::HandleCmdVLS(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n0,\"\",00000000,00000000,00000000";
+          resp += "\r\n1,\"T\",00000000,00000000,00000000";
+          resp += "\r\n5,\"ST\",00000000,00000000,00000000";
+          resp += "\r\n7,\"MST\",00000000,00000000,00000000";
+          crlf = TRUE;
+          break;
+        default:
+          switch (ParseNum(&pCmd)) {
+            case 0: {
+              PWaitAndSignal mutexWait(Mutex);
+
+              if (off_hook || P.ClearMode())
+                OnHook();
+              break;
+            }
+            case 1:
+            case 5:
+            case 7: {
+              ok = FALSE;
+
+              PWaitAndSignal mutexWait(Mutex);
+
+              callDirection = cdUndefined;
+              if (!Answer())
+                return FALSE;
+              break;
+            }
+            default:
+              return FALSE;
+          }
+      }
+      break;
+    case '?':
+      resp += off_hook ? "\r\n1" : "\r\n0";
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+#define HandleCmdByte(name, func)                                                                  \
+PBoolean ModemEngineBody::HandleCmd##name(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf) \
+{                                                                                                  \
+  const char *&pCmd = *ppCmd;                                                                      \
+                                                                                                   \
+  switch (*pCmd++) {                                                                               \
+    case '=':                                                                                      \
+      switch (*pCmd) {                                                                             \
+        case '?':                                                                                  \
+          pCmd++;                                                                                  \
+          resp += "\r\n(0-255)";                                                                   \
+          crlf = TRUE;                                                                             \
+          break;                                                                                   \
+        default: {                                                                                 \
+          int val = ParseNum(&pCmd);                                                               \
+                                                                                                   \
+          if (val < 0)                                                                             \
+            return FALSE;                                                                          \
+                                                                                                   \
+          PWaitAndSignal mutexWait(Mutex);                                                         \
+          P.func((BYTE)val);                                                                       \
+        }                                                                                          \
+      }                                                                                            \
+      break;                                                                                       \
+    case '?':                                                                                      \
+      resp.sprintf("\r\n%u", (unsigned)P.func());                                                  \
+      crlf = TRUE;                                                                                 \
+      break;                                                                                       \
+    default:                                                                                       \
+      return FALSE;                                                                                \
+  }                                                                                                \
+  return TRUE;                                                                                     \
+}
+
+HandleCmdByte(VGR, VgrInterval)
+HandleCmdByte(VGT, VgtInterval)
+HandleCmdByte(VRA, VraInterval)
+HandleCmdByte(VRN, VrnInterval)
+HandleCmdByte(VTD, Vtd)
+
+#undef HandleCmdByte
+
+PBoolean ModemEngineBody::HandleCmdVSD(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n(0-255),(0-255)";
+          crlf = TRUE;
+          break;
+        default: {
+          int sds = ParseNum(&pCmd);
+
+          if (sds < 0 || *pCmd != ',')
+            return FALSE;
+
+          pCmd++;
+
+          int sdi = ParseNum(&pCmd);
+
+          if (sdi < 0)
+            return FALSE;
+
+          PWaitAndSignal mutexWait(Mutex);
+
+          P.Vsds((BYTE)sds);
+          P.Vsdi((BYTE)sdi);
+        }
+      }
+      break;
+    case '?':
+      resp.sprintf("\r\n%u,%u", (unsigned)P.Vsds(), (unsigned)P.Vsdi());
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+PBoolean ModemEngineBody::HandleCmdVSM(const char **ppCmd, PBYTEArena &resp, PBoolean &/*ok*/, PBoolean &crlf)
+{
+  const char *&pCmd = *ppCmd;
+
+  switch (*pCmd++) {
+    case '=':
+      switch (*pCmd) {
+        case '?':
+          pCmd++;
+          resp += "\r\n0,\"SIGNED PCM\",8,0,(8000),(0),(0)";
+          resp += "\r\n1,\"UNSIGNED PCM\",8,0,(8000),(0),(0)";
+          resp += "\r\n4,\"G.711U\",8,0,(8000),(0),(0)";
+          resp += "\r\n5,\"G.711A\",8,0,(8000),(0),(0)";
+          resp += "\r\n128,\"8-BIT LINEAR\",8,0,(8000),(0),(0)";
+          resp += "\r\n129,\"ADPCM (NOT IMPLEMENTED)\",0,0,(0),(0),(0)";
+          resp += "\r\n130,\"UNSIGNED PCM\",8,0,(8000),(0),(0)";
+          resp += "\r\n131,\"G.711 ULAW\",8,0,(8000),(0),(0)";
+          resp += "\r\n132,\"G.711 ALAW\",8,0,(8000),(0),(0)";
+          crlf = TRUE;
+          break;
+        default: {
+          int cml = ParseNum(&pCmd);
+
+          switch (cml) {
+            case 0:
+            case 1:
+            case 4:
+            case 5:
+            case 128:
+            case 130:
+            case 131:
+            case 132:
+              break;
+            default:
+              return FALSE;
+          }
+
+          if (*pCmd == ',') {
+            pCmd++;
+
+            int vsr = ParseNum(&pCmd, 4, 4, 8000);
+
+            if (vsr != 8000)
+              return FALSE;
+
+            if (*pCmd == ',') {
+              pCmd++;
+
+              int scs = ParseNum(&pCmd);
+
+              if (scs != 0)
+                return FALSE;
+
+              if (*pCmd == ',') {
+                pCmd++;
+
+                int sel = ParseNum(&pCmd);
+
+                if (sel != 0)
+                  return FALSE;
+              }
+            }
+          }
+
+          PWaitAndSignal mutexWait(Mutex);
+          P.Vcml((BYTE)cml);
+        }
+      }
+      break;
+    case '?':
+      resp.sprintf("\r\n%u,8000,0,0", (unsigned)P.Vcml());
+      crlf = TRUE;
+      break;
+    default:
+      return FALSE;
+  }
+  return TRUE;
+}
+
+/*
+ * The extended commands (V.250 5.4) by the names.
+ * Keep sorted by strcmp() for the binary search in HandleExtCmd().
+ */
+const ModemEngineBody::ExtCmd ModemEngineBody::extCmds[] = {
+  { "FAA",    &ModemEngineBody::HandleCmdFAA },
+  { "FCLASS", &ModemEngineBody::HandleCmdFCLASS },
+  { "FLO",    &ModemEngineBody::HandleCmdFLO },
+  { "FMDL",   &ModemEngineBody::HandleCmdFMDL },
+  { "FMFR",   &ModemEngineBody::HandleCmdFMFR },
+  { "FMI",    &ModemEngineBody::HandleCmdFMFR },
+  { "FMM",    &ModemEngineBody::HandleCmdFMDL },
+  { "FMR",    &ModemEngineBody::HandleCmdFREV },
+  { "FREV",   &ModemEngineBody::HandleCmdFREV },
+  { "FRH",    &ModemEngineBody::HandleClass1Cmd },
+  { "FRM",    &ModemEngineBody::HandleClass1Cmd },
+  { "FRS",    &ModemEngineBody::HandleClass1Cmd },
+  { "FTH",    &ModemEngineBody::HandleClass1Cmd },
+  { "FTM",    &ModemEngineBody::HandleClass1Cmd },
+  { "FTS",    &ModemEngineBody::HandleClass1Cmd },
+  { "IFC",    &ModemEngineBody::HandleCmdIFC },
+  { "VCID",   &ModemEngineBody::HandleCmdVCID },
+  { "VEM",    &ModemEngineBody::HandleCmdVEM },
+  { "VGR",    &ModemEngineBody::HandleCmdVGR },
+  { "VGT",    &ModemEngineBody::HandleCmdVGT },
+  { "VIP",    &ModemEngineBody::HandleCmdVIP },
+  { "VIT",    &ModemEngineBody::HandleCmdVIT },
+  { "VLS",    &ModemEngineBody::HandleCmdVLS },
+  { "VRA",    &ModemEngineBody::HandleCmdVRA },
+  { "VRN",    &ModemEngineBody::HandleCmdVRN },
+  { "VRX",    &ModemEngineBody::HandleClass8Cmd },
+  { "VSD",    &ModemEngineBody::HandleCmdVSD },
+  { "VSM",    &ModemEngineBody::HandleCmdVSM },
+  { "VTD",    &ModemEngineBody::HandleCmdVTD },
+  { "VTS",    &ModemEngineBody::HandleClass8Cmd },
+  { "VTX",    &ModemEngineBody::HandleClass8Cmd },
+};
+
+static PBoolean IsExtNameChar(char c)
+{
+  if (isupper(c) || isdigit(c))
+    return TRUE;
+
+  switch (c) {
+    case '!':
+    case '%':
+    case '-':
+    case '.':
+    case '/':
+    case ':':
+    case '_':
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+PBoolean ModemEngineBody::HandleExtCmd(const char **ppCmd, PBYTEArena &resp, PBoolean &ok, PBoolean &crlf)
+{
+  const char *pName = *ppCmd;
+  const char *pEnd = pName;
+
+  while (IsExtNameChar(*pEnd))
+    pEnd++;
+
+  /*
+   * A basic command can follow an extended one without ';' (e.g. "+VIPZ"),
+   * so if the whole name is unknown then try the longest known prefix.
+   */
+  for (size_t len = pEnd - pName ; len > 0 ; len--) {
+    int lo = 0;
+    int hi = int(sizeof(extCmds)/sizeof(extCmds[0])) - 1;
+
+    while (lo <= hi) {
+      int mid = (lo + hi)/2;
+      const char *name = extCmds[mid].name;
+      int res = strncmp(pName, name, len);
+
+      if (res == 0 && name[len])
+        res = -1;		// pName is a prefix of name
+
+      if (res < 0) {
+        hi = mid - 1;
+      } else
+      if (res > 0) {
+        lo = mid + 1;
+      } else {
+        *ppCmd = pName + len;
+        return (this->*extCmds[mid].handler)(ppCmd, resp, ok, crlf);
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+void ModemEngineBody::HandleCmd(PBYTEArena &resp)
+{
+  PINDEX i;
+
+  for (i = 0 ;  ; i++) {
+    i = cmd.FindOneOf("Aa", i);
+
+    if (i == P_MAX_INDEX) {
+      myPTRACE(1, "--> " << cmd.GetLength() << " bytes of binary");
+      cmd.MakeEmpty();
+      return;
+    }
+
+    PString at = cmd.Mid(i, 2);
+
+    if (at == "AT" || at == "at")
+      break;
+  }
+
+#if PTRACING
+  if (i) {
+    PBYTEArray bin((const BYTE *)(const char *)cmd, i);
+
+    myPTRACE(1, "--> " << PRTHEX(bin));
+  }
+#endif
+
+  const char *pCmd;
+
+  pCmd = ((const char *)cmd) + i;
+
+  myPTRACE(1, "--> " << pCmd);
+
+  pCmd += 2;  // skip AT
+
+  cmdRest = PString(pCmd).ToUpper();
+  cmd.MakeEmpty();
+
+  HandleCmdRest(resp);
+}
+
+#define ToSBit(funk)                    \
+  switch (ParseNum(&pCmd, 0, 1, 1)) {   \
+    case 0:                             \
+      P.funk(FALSE);                    \
+      break;                            \
+    case 1:                             \
+      P.funk(TRUE);                     \
+      break;                            \
+    default:                            \
+      err = TRUE;                       \
+  }
+
+void ModemEngineBody::HandleCmdRest(PBYTEArena &resp)
+{
+  PString tmp = cmdRest;
+  cmdRest.MakeEmpty();
+
+  const char *pCmd = tmp;
+  PBoolean err = FALSE;
+  PBoolean ok = TRUE;
+  PBoolean crlf = FALSE;
+
+  while (state == stCommand && !err && *pCmd) {
+      switch( *pCmd++ ) {
+        case ' ':
+        case ';':
+          break;
+        case 'A':	// Accept incoming call
+          ok = FALSE;
+
+          {
+            PWaitAndSignal mutexWait(Mutex);
+
+            callDirection = cdIncoming;
+            if (!Answer())
+              err = TRUE;
+          }
+
+          break;
+        case 'B':       // Turn ITU-T V.22/BELL 212A
+          if (ParseNum(&pCmd, 0, 1) >= 0) {
+          } else {
+            err = TRUE;
+          }
+          break;
+        case 'D':	// Dial
+          ok = FALSE;
+
+          {
+            PWaitAndSignal mutexWait(Mutex);
+
+            PBoolean wasOnHook = OffHook();
+
+            PString num;
+            PString numTone;
+            PBoolean addNumTone;
+            PString LocalPartyName;
+            PBoolean local = FALSE;
             PBoolean setForceFaxMode = FALSE;
             CallDirection setCallDirection = cdOutgoing;
 
@@ -2394,7 +3193,7 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
             myPTRACE(2, "Dial string: " << num << "@" << numTone << "L" << LocalPartyName << (setForceFaxMode ? "F" : "V") << (err ? "" : " - OK"));
 
             if (!err) {
-              PDTMFEncoder playTone;
+              DTMFEncoder playTone;
 
               for (PINDEX i = 0 ; i < numTone.GetLength() ; i++) {
                 char ch = numTone[i];
@@ -2403,7 +3202,7 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
                   case ',': {
                     unsigned ms = unsigned(P.DialTimeComma()) * 1000;
 
-                    playTone.Generate(' ', 0, 0, ms);
+                    playTone.AddSilence(ms);
                     myPTRACE(2, "Encoded tone \"0 0:" << ms << "\", size=" << playTone.GetSize());
                     break;
                   }
@@ -2412,7 +3211,7 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
 
                     playTone.AddTone(ch, ms);
                     myPTRACE(2, "Encoded DTMF tone \"" << ch << ":" << ms << "\", size=" << playTone.GetSize());
-                    playTone.Generate(' ', 0, 0, ms);
+                    playTone.AddSilence(ms);
                     myPTRACE(2, "Encoded tone \"0 0:" << ms << "\", size=" << playTone.GetSize());
                     break;
                   }
@@ -2553,423 +3352,55 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
           if (r >= 0) {
             switch (*pCmd++) {
               case '=':
-                {
-                  int val = ParseNum(&pCmd);
-
-                  PWaitAndSignal mutexWait(Mutex);
-
-                  if( val < 0 || !P.SetReg(r, (BYTE)val) ) {
-                    err = TRUE;
-                  }
-                }
-                break;
-              case '?':
-                {
-                  BYTE val;
-
-                  PWaitAndSignal mutexWait(Mutex);
-
-                  if (P.GetReg(r, val)) {
-                    resp.sprintf("\r\n%3.3u", (unsigned)val);
-                    crlf = TRUE;
-                  } else {
-                    err = TRUE;
-                  }
-                }
-                break;
-              case '.':
-                {
-                  int b = ParseNum(&pCmd, 1, 1, 7);
-
-                  if (b >= 0) {
-                    switch (*pCmd++) {
-                      case '=':
-                        {
-                          int val = ParseNum(&pCmd, 1, 1, 1);
-                          if( val < 0 || !P.SetBit(r, b, (PBoolean)val) ) {
-                            err = TRUE;
-                          }
-                        }
-                        break;
-                      case '?':
-                        {
-                          PBoolean val;
-
-                          if (P.GetBit(r, b, val)) {
-                            resp.sprintf("\r\n%u", (unsigned)val);
-                            crlf = TRUE;
-                          } else {
-                            err = TRUE;
-                          }
-                        }
-                        break;
-                      default:
-                        err = TRUE;
-                    }
-                  } else {
-                    err = TRUE;
-                  }
-                }
-                break;
-              default:
-                err = TRUE;
-            }
-          } else {
-            err = TRUE;
-          }
-          }
-          break;
-        case 'V': {	// Numeric or ASCII result codes
-          PWaitAndSignal mutexWait(Mutex);
-          ToSBit(asciiResultCodes);
-          break;
-        }
-        case 'X':	// Which result codes
-          if (ParseNum(&pCmd, 0, 1) >= 3) {
-          } else {
-            err = TRUE;
-          }
-          break;
-        case 'Z':	// Load Registers from Profile
-          {
-            int val = ParseNum(&pCmd, 0, 1, sizeof(Profiles)/sizeof(Profiles[0]) - 1);
-            if( val >= 0 ) {
-              PWaitAndSignal mutexWait(Mutex);
-
-              P = Profiles[val];
-              OnChangeModemClass();
-
-              if (off_hook)  // clear call only in off-hook state
-                OnHook();
-            } else {
-              err = TRUE;
-            }
-          }
-          break;
-        case '+':
-          switch( *pCmd++ ) {
-            case 'F':	// FAX
-              switch( *pCmd++ ) {
-                case 'A':
-                  if (*pCmd == 'A') {			// +FAA
-                    pCmd += 1;
-                    switch( *pCmd++ ) {
-                      case '=':
-                        switch( *pCmd ) {
-                          case '?':
-                            pCmd++;
-                            resp += "\r\n0";
-                            crlf = TRUE;
-                            break;
-                          default:
-                            switch( ParseNum(&pCmd) ) {
-                              case 0:
-                                break;
-                              default:
-                                err = TRUE;
-                            }
-                        }
-                        break;
-                      case '?':
-                        resp += "\r\n0";
-                        crlf = TRUE;
-                        break;
-                      default:
-                        err = TRUE;
-                    }
-                  } else {
-                    err = TRUE;
-                  }
-                  break;
-                case 'C':
-                  if( strncmp(pCmd, "LASS", 4) == 0 ) {	// +FCLASS
-                    pCmd += 4;
-                    switch( *pCmd++ ) {
-                      case '=':
-                        switch( *pCmd ) {
-                          case '?':
-                            pCmd++;
-                            resp += "\r\n1,8";
-                            crlf = TRUE;
-                            break;
-                          default: {
-                            const char *modemClass;
-
-                            switch (ParseNum(&pCmd)) {
-                              case 0:
-                                modemClass = "0";
-                                break;
-                              case 1:
-                                modemClass = "1";
-                                break;
-                              case 8:
-                                modemClass = "8";
-                                break;
-                              default:
-                                modemClass = NULL;
-                                err = TRUE;
-                            }
-
-                            if (modemClass) {
-                              PWaitAndSignal mutexWait(Mutex);
-                              P.ModemClass(modemClass);
-                              OnChangeModemClass();
-                            }
-                          }
-                        }
-                        break;
-                      case '?':
-                        resp += "\r\n" + P.ModemClass();
-                        crlf = TRUE;
-                        break;
-                      default:
-                        err = TRUE;
-                    }
-                  } else {
-                    err = TRUE;
-                  }
-                  break;
-                case 'L':
-                  switch (*pCmd++) {
-                    case 'O':				// +FLO
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n0-2";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-                                switch (val) {
-                                  case 0:
-                                  case 1:
-                                  case 2: {
-                                    PWaitAndSignal mutexWait(Mutex);
-                                    P.Flo((BYTE)val);
-                                    break;
-                                  }
-                                  default:
-                                    err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.Flo());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'M':
-                  switch (*pCmd++) {
-                    case 'D':
-                      switch (*pCmd++) {
-                        case 'L':			// +FMDL
-                          switch (*pCmd++) {
-                            case '?':
-                              resp += "\r\n" + PString(Model);
-                              crlf = TRUE;
-                              break;
-                            default:
-                              err = TRUE;
-                          }
-                          break;
-                      default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'F':
-                      switch (*pCmd++) {
-                        case 'R':			// +FMFR
-                          switch (*pCmd++) {
-                            case '?':
-                              resp += "\r\n" + PString(Manufacturer);
-                              crlf = TRUE;
-                              break;
-                            default:
-                              err = TRUE;
-                          }
-                          break;
-                      default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'I':				// +FMI
-                      switch (*pCmd++) {
-                        case '?':
-                          resp += "\r\n" + PString(Manufacturer);
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'M':				// +FMM
-                      switch (*pCmd++) {
-                        case '?':
-                          resp += "\r\n" + PString(Model);
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'R':				// +FMR
-                      switch (*pCmd++) {
-                        case '?':
-                          resp += "\r\n" + PString(Revision);
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'R':
-                  switch( *pCmd ) {
-                    case 'M':				// +FRM
-                    case 'H':				// +FRH
-                    case 'S':				// +FRS
-                      pCmd++;
-                      if (!HandleClass1Cmd(&pCmd, resp, ok, crlf))
-                        err = TRUE;
-                      break;
-                    default:
-                      if( strncmp(pCmd, "EV", 2) == 0 ) {	// +FREV
-                        pCmd += 2;
-                        switch( *pCmd++ ) {
-                          case '?':
-                            resp += "\r\n" + PString(Revision);
-                            crlf = TRUE;
-                            break;
-                          default:
-                            err = TRUE;
-                        }
-                      } else {
-                        err = TRUE;
-                      }
-                  }
-                  break;
-                case 'T':
-                  switch( *pCmd ) {
-                    case 'M':				// +FTM
-                    case 'H':				// +FTH
-                    case 'S':				// +FTS
-                      pCmd++;
-                      if (!HandleClass1Cmd(&pCmd, resp, ok, crlf))
-                        err = TRUE;
-                      break;
-                    default:
-                      err = TRUE;
+                {
+                  int val = ParseNum(&pCmd);
+
+                  PWaitAndSignal mutexWait(Mutex);
+
+                  if( val < 0 || !P.SetReg(r, (BYTE)val) ) {
+                    err = TRUE;
                   }
-                  break;
-                default:
-                  err = TRUE;
-              }
-              break;
-            case 'I':	// DTE-DCE interface commands
-              switch (*pCmd++) {
-                case 'F':
-                  switch (*pCmd++) {
-                    case 'C':				// +IFC
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n+IFC:(0-2),(0-2)";
-                              crlf = TRUE;
-                              break;
-                            default: {
-                              int valByDTE = ParseNum(&pCmd, 1, 1, 2);
-
-                              if (valByDTE < 0) {
-                                err = TRUE;
-                                break;
-                              }
-
-                              int valByDCE;
-
-                              if (*pCmd == ',') {
-                                pCmd++;
-
-                                valByDCE = ParseNum(&pCmd);
-
-                                if (valByDCE < 0) {
-                                  err = TRUE;
-                                  break;
-                                }
-                              } else {
-                                valByDCE = P.IfcByDCE();
-                              }
-
-                              PWaitAndSignal mutexWait(Mutex);
-
-                              P.IfcByDTE((BYTE)valByDTE);
-                              P.IfcByDCE((BYTE)valByDCE);
-                            }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n+IFC:%u,%u", (unsigned)P.IfcByDTE(), (unsigned)P.IfcByDCE());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
+                }
+                break;
+              case '?':
+                {
+                  BYTE val;
+
+                  PWaitAndSignal mutexWait(Mutex);
+
+                  if (P.GetReg(r, val)) {
+                    resp.sprintf("\r\n%3.3u", (unsigned)val);
+                    crlf = TRUE;
+                  } else {
+                    err = TRUE;
                   }
-                  break;
-                default:
-                  err = TRUE;
-              }
-              break;
-            case 'V':	// Voice
-              switch (*pCmd++) {
-                case 'C':
-                  if (strncmp(pCmd, "ID", 2) == 0) {	// +VCID
-                    pCmd += 2;
+                }
+                break;
+              case '.':
+                {
+                  int b = ParseNum(&pCmd, 1, 1, 7);
+
+                  if (b >= 0) {
                     switch (*pCmd++) {
                       case '=':
-                        switch (*pCmd) {
-                          case '?':
-                            pCmd++;
-                            resp += "\r\n(0,1)";
-                            crlf = TRUE;
-                            break;
-                          default:
-                            {
-                              int val = ParseNum(&pCmd);
-                              switch (val) {
-                                case 0:
-                                case 1: {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.CidMode((BYTE)val);
-                                  break;
-                                }
-                                default:
-                                  err = TRUE;
-                              }
-                            }
+                        {
+                          int val = ParseNum(&pCmd, 1, 1, 1);
+                          if( val < 0 || !P.SetBit(r, b, (PBoolean)val) ) {
+                            err = TRUE;
+                          }
                         }
                         break;
                       case '?':
-                        resp.sprintf("\r\n%u", (unsigned)P.CidMode());
-                        crlf = TRUE;
+                        {
+                          PBoolean val;
+
+                          if (P.GetBit(r, b, val)) {
+                            resp.sprintf("\r\n%u", (unsigned)val);
+                            crlf = TRUE;
+                          } else {
+                            err = TRUE;
+                          }
+                        }
                         break;
                       default:
                         err = TRUE;
@@ -2977,460 +3408,47 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
                   } else {
                     err = TRUE;
                   }
-                  break;
-                case 'E':
-                  switch (*pCmd++) {
-                    case 'M':				// +VEM
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              if (ParseNum(&pCmd) != 0)
-                                err = TRUE;
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n0");
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'G':
-                  switch (*pCmd++) {
-                    case 'R':				// +VGR
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-
-                                if (val >= 0) {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.VgrInterval((BYTE)val);
-                                } else {
-                                  err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.VgrInterval());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'T':				// +VGT
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-
-                                if (val >= 0) {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.VgtInterval((BYTE)val);
-                                } else {
-                                  err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.VgtInterval());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'I':
-                  switch (*pCmd++) {
-                    case 'P':				// +VIP
-                      {
-                        int val;
-
-                        if (*pCmd == '=') {
-                          pCmd++;
-                          if (*pCmd == '?') {
-                            pCmd++;
-                            resp.sprintf("\r\n(0-%u)", sizeof(Profiles)/sizeof(Profiles[0]) - 1);
-                            crlf = TRUE;
-                            break;
-                          }
-
-                          val = ParseNum(&pCmd);
+                }
+                break;
+              default:
+                err = TRUE;
+            }
+          } else {
+            err = TRUE;
+          }
+          }
+          break;
+        case 'V': {	// Numeric or ASCII result codes
+          PWaitAndSignal mutexWait(Mutex);
+          ToSBit(asciiResultCodes);
+          break;
+        }
+        case 'X':	// Which result codes
+          if (ParseNum(&pCmd, 0, 1) >= 3) {
+          } else {
+            err = TRUE;
+          }
+          break;
+        case 'Z':	// Load Registers from Profile
+          {
+            int val = ParseNum(&pCmd, 0, 1, sizeof(Profiles)/sizeof(Profiles[0]) - 1);
+            if( val >= 0 ) {
+              PWaitAndSignal mutexWait(Mutex);
 
-                          if( val < 0 || val > ((int)(sizeof(Profiles)/sizeof(Profiles[0])) - 1)) {
-                            err = TRUE;
-                            break;
-                          }
-                        } else {
-                          val = 0;
-                        }
+              P = Profiles[val];
+              OnChangeModemClass();
 
-                        PWaitAndSignal mutexWait(Mutex);
-                        P.SetVoiceProfile(Profiles[val]);
-                      }
-                      break;
-                    case 'T':				// +VIT
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              if (ParseNum(&pCmd) < 0)
-                                err = TRUE;
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n0");
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'L':
-                  switch (*pCmd++) {
-                    case 'S':				// +VLS
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n0,\"\",00000000,00000000,00000000";
-                              resp += "\r\n1,\"T\",00000000,00000000,00000000";
-                              resp += "\r\n5,\"ST\",00000000,00000000,00000000";
-                              resp += "\r\n7,\"MST\",00000000,00000000,00000000";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              switch (ParseNum(&pCmd)) {
-                                case 0: {
-                                  PWaitAndSignal mutexWait(Mutex);
-
-                                  if (off_hook || P.ClearMode())
-                                    OnHook();
-                                  break;
-                                }
-                                case 1:
-                                case 5:
-                                case 7:
-                                  ok = FALSE;
-
-                                  {
-                                    PWaitAndSignal mutexWait(Mutex);
-
-                                    callDirection = cdUndefined;
-                                    if (!Answer())
-                                      err = TRUE;
-                                  }
-                                  break;
-                                default:
-                                  err = TRUE;
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp += off_hook ? "\r\n1" : "\r\n0";
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'R':
-                  switch (*pCmd++) {
-                    case 'A':				// +VRA
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-
-                                if (val >= 0) {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.VraInterval((BYTE)val);
-                                } else {
-                                  err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.VraInterval());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'N':				// +VRN
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-
-                                if (val >= 0) {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.VrnInterval((BYTE)val);
-                                } else {
-                                  err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.VrnInterval());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'X':				// +VRX
-                      if (!HandleClass8Cmd(&pCmd, resp, ok, crlf))
-                        err = TRUE;
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'S':
-                  switch (*pCmd++) {
-                    case 'D':				// +VSD
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255),(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int sds = ParseNum(&pCmd);
-
-                                if (sds < 0 || *pCmd != ',') {
-                                  err = TRUE;
-                                  break;
-                                }
-
-                                pCmd++;
-
-                                int sdi = ParseNum(&pCmd);
-
-                                if (sdi < 0) {
-                                  err = TRUE;
-                                  break;
-                                }
-
-                                PWaitAndSignal mutexWait(Mutex);
-
-                                P.Vsds((BYTE)sds);
-                                P.Vsdi((BYTE)sdi);
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u,%u", (unsigned)P.Vsds(), (unsigned)P.Vsdi());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'M':				// +VSM
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n0,\"SIGNED PCM\",8,0,(8000),(0),(0)";
-                              resp += "\r\n1,\"UNSIGNED PCM\",8,0,(8000),(0),(0)";
-                              resp += "\r\n4,\"G.711U\",8,0,(8000),(0),(0)";
-                              resp += "\r\n5,\"G.711A\",8,0,(8000),(0),(0)";
-                              resp += "\r\n128,\"8-BIT LINEAR\",8,0,(8000),(0),(0)";
-                              resp += "\r\n129,\"ADPCM (NOT IMPLEMENTED)\",0,0,(0),(0),(0)";
-                              resp += "\r\n130,\"UNSIGNED PCM\",8,0,(8000),(0),(0)";
-                              resp += "\r\n131,\"G.711 ULAW\",8,0,(8000),(0),(0)";
-                              resp += "\r\n132,\"G.711 ALAW\",8,0,(8000),(0),(0)";
-                              crlf = TRUE;
-                              break;
-                            default: {
-                              int cml = ParseNum(&pCmd);
-
-                              switch (cml) {
-                                case 0:
-                                case 1:
-                                case 4:
-                                case 5:
-                                case 128:
-                                case 130:
-                                case 131:
-                                case 132:
-                                  break;
-                                default:
-                                  err = TRUE;
-                              }
-
-                              if (err)
-                                break;
-
-                              if (*pCmd == ',') {
-                                pCmd++;
-
-                                int vsr = ParseNum(&pCmd, 4, 4, 8000);
-
-                                if (vsr != 8000) {
-                                  err = TRUE;
-                                  break;
-                                }
-
-                                int scs = 0;
-                                int sel = 0;
-
-                                if (*pCmd == ',') {
-                                  pCmd++;
-                                  scs = ParseNum(&pCmd);
-
-                                  if (scs != 0) {
-                                    err = TRUE;
-                                    break;
-                                  }
-
-                                  if (*pCmd == ',') {
-                                    pCmd++;
-                                    sel = ParseNum(&pCmd);
-
-                                    if (sel != 0) {
-                                      err = TRUE;
-                                      break;
-                                    }
-                                  }
-                                }
-                              }
-
-                              PWaitAndSignal mutexWait(Mutex);
-                              P.Vcml((BYTE)cml);
-                            }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u,8000,0,0", (unsigned)P.Vcml());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                case 'T':
-                  switch (*pCmd++) {
-                    case 'D':				// +VTD
-                      switch (*pCmd++) {
-                        case '=':
-                          switch (*pCmd) {
-                            case '?':
-                              pCmd++;
-                              resp += "\r\n(0-255)";
-                              crlf = TRUE;
-                              break;
-                            default:
-                              {
-                                int val = ParseNum(&pCmd);
-
-                                if (val >= 0) {
-                                  PWaitAndSignal mutexWait(Mutex);
-                                  P.Vtd((BYTE)val);
-                                } else {
-                                  err = TRUE;
-                                }
-                              }
-                          }
-                          break;
-                        case '?':
-                          resp.sprintf("\r\n%u", (unsigned)P.Vtd());
-                          crlf = TRUE;
-                          break;
-                        default:
-                          err = TRUE;
-                      }
-                      break;
-                    case 'X':				// +VTX
-                    case 'S':				// +VTS
-                      if (!HandleClass8Cmd(&pCmd, resp, ok, crlf))
-                        err = TRUE;
-                      break;
-                    default:
-                      err = TRUE;
-                  }
-                  break;
-                default:
-                  err = TRUE;
-              }
-              break;
-            default:
+              if (off_hook)  // clear call only in off-hook state
+                OnHook();
+            } else {
               err = TRUE;
+            }
           }
           break;
+        case '+':
+          if (!HandleExtCmd(&pCmd, resp, ok, crlf))
+            err = TRUE;
+          break;
         case '&':
           switch( *pCmd++ ) {
             case 'C':					// &C
@@ -3673,10 +3691,10 @@ void ModemEngineBody::HandleCmdRest(PString &resp)
   }
 }
 
-void ModemEngineBody::HandleData(const PBYTEArray &buf, PBYTEArray &bresp)
+PINDEX ModemEngineBody::HandleData(const BYTE *_pBuf, PINDEX count, PBYTEArena &bresp)
 {
-    int len = buf.GetSize();
-    const BYTE *pBuf = buf;
+    int len = count;
+    const BYTE *pBuf = _pBuf;
 
     while (len > 0) {
       switch (state) {
@@ -3692,14 +3710,14 @@ void ModemEngineBody::HandleData(const PBYTEArray &buf, PBYTEArray &bresp)
             if (pEnd == NULL) {
               cmd += PString((const char *)pBuf, len);
               if( Echo() )
-                bresp.Concatenate(PBYTEArray(pBuf, len));
+                bresp.Put(pBuf, len);
               len = 0;
             } else {
               int rlen = int(pEnd - pBuf);
               if( rlen ) {
                 cmd += PString((const char *)pBuf, rlen);
                 if( Echo() ) {
-                  bresp.Concatenate(PBYTEArray(pBuf, rlen));
+                  bresp.Put(pBuf, rlen);
                 }
                 len -= rlen;
                 pBuf += rlen;
@@ -3708,17 +3726,24 @@ void ModemEngineBody::HandleData(const PBYTEArray &buf, PBYTEArray &bresp)
               pBuf++;
 
               if (Echo())
-                bresp.Concatenate(PBYTEArray((const BYTE *)"\r", 1));
+                bresp.Put("\r", 1);
+
+              PINDEX respBegin = bresp.GetSize();
 
-              PString resp;
+              HandleCmd(bresp);
 
-              HandleCmd(resp);
+              PINDEX respLen = bresp.GetSize() - respBegin;
 
-              if (resp.GetLength()) {
-                PBYTEArray _bresp((const BYTE *)(const char *)resp, resp.GetLength());
+              if (respHeld) {
+                // delay the response and the rest of input (see isInputHeld())
+                heldResp = PString((const char *)bresp.GetPointer() + respBegin, respLen);
+                bresp.Truncate(respBegin);
+                timerResp.Start(100);
+                return count - len;
+              }
 
-                myPTRACE(1, "<-- " << PRTHEX(_bresp));
-                bresp.Concatenate(_bresp);
+              if (respLen) {
+                myPTRACE(1, "<-- " << PRTHEX(PBYTEArray(bresp.GetPointer() + respBegin, respLen)));
               }
             }
           }
@@ -3828,10 +3853,8 @@ void ModemEngineBody::HandleData(const PBYTEArray &buf, PBYTEArray &bresp)
             timeout.Stop();
 
             if (state == stRecv && (dataCount || P.ModemClassId() == EngineBase::mcAudio)) {
-              PBYTEArray _bresp((const BYTE *)"\x10\x03", 2); // add <DLE><ETX>
-
-              myPTRACE(1, "<-- " << PRTHEX(_bresp));
-              bresp.Concatenate(_bresp);
+              myPTRACE(1, "<-- " << PRTHEX(PBYTEArray((const BYTE *)"\x10\x03", 2)));
+              bresp.Put("\x10\x03", 2);		// add <DLE><ETX>
             }
 
             SetState(stCommand);
@@ -3848,35 +3871,46 @@ void ModemEngineBody::HandleData(const PBYTEArray &buf, PBYTEArray &bresp)
               resp += RC_NO_CARRIER();
             }
 
-            PBYTEArray _bresp((const BYTE *)(const char *)resp, resp.GetLength());
-
-            myPTRACE(1, "<-- " << PRTHEX(_bresp));
-            bresp.Concatenate(_bresp);
+            myPTRACE(1, "<-- " << PRTHEX(PBYTEArray((const BYTE *)(const char *)resp, resp.GetLength())));
+            bresp.Put((const char *)resp, resp.GetLength());
           }
       }
     }
+
+    return count;
 }
 
-void ModemEngineBody::CheckState(PBYTEArray & bresp)
+void ModemEngineBody::CheckState(PBYTEArena &bresp)
 {
   PString resp;
   PWaitAndSignal mutexWait(Mutex);
 
+  if (timerDetach.Get())
+    _CheckDetachingEngines();
+
+  if (respHeld && timerResp.Get()) {
+    respHeld = FALSE;
+
+    if (heldResp.GetLength()) {
+      myPTRACE(1, "<-- " << PRTHEX(PBYTEArray((const BYTE *)(const char *)heldResp, heldResp.GetLength())));
+      bresp.Put((const char *)heldResp, heldResp.GetLength());
+      heldResp = PString::Empty();
+    }
+  }
+
   if (cmd.IsEmpty()) {
     if (timerBusy.Get()) {
       if (P.ModemClassId() == EngineBase::mcAudio) {
-        PBYTEArray _bresp((const BYTE *)"\x10" "b", 2);		// <DLE>b
-        bresp.Concatenate(_bresp);
-        myPTRACE(2, "<-- DLE " << PRTHEX(_bresp));
+        bresp.Put("\x10" "b", 2);		// <DLE>b
+        myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray((const BYTE *)"\x10" "b", 2)));
       }
     }
 
     if (timerRing.Get()) {
       if (off_hook && !pPlayTone && P.ModemClassId() == EngineBase::mcAudio) {
         BYTE b[2] = {'\x10', 'r'};
-        PBYTEArray _bresp(b, sizeof(b));
-        bresp.Concatenate(_bresp);
-        myPTRACE(2, "<-- DLE " << PRTHEX(_bresp));
+        bresp.Put(b, sizeof(b));
+        myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray(b, sizeof(b))));
       }
       else
       if (!off_hook && callState == cstCalled) {
@@ -3997,17 +4031,28 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
           case '#': {
             // <DLE>'/'<DLE>c<DLE>'~'
             BYTE b[6] = {'\x10', '/', '\x10', c, '\x10', '~'};
-            PBYTEArray _bresp(b, sizeof(b));
-            bresp.Concatenate(_bresp);
-            myPTRACE(2, "<-- DLE " << PRTHEX(_bresp));
+            bresp.Put(b, sizeof(b));
+            myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray(b, sizeof(b))));
+            break;
+          }
+          case 'V': {
+            // V.21 HDLC flags (T30ToneDetect) have no V.253 code, on the
+            // answering side it's a calling fax as with CNG, on the calling
+            // side it's the answering fax and it's not reported
+            if (callDirection == cdOutgoing)
+              break;
+
+            // <DLE>c
+            BYTE b[2] = {'\x10', 'c'};
+            bresp.Put(b, sizeof(b));
+            myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray(b, sizeof(b))));
             break;
           }
           default: {
             // <DLE>c
             BYTE b[2] = {'\x10', c};
-            PBYTEArray _bresp(b, sizeof(b));
-            bresp.Concatenate(_bresp);
-            myPTRACE(2, "<-- DLE " << PRTHEX(_bresp));
+            bresp.Put(b, sizeof(b));
+            myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray(b, sizeof(b))));
             break;
           }
         }
@@ -4155,13 +4200,11 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
               SetState(stCommand);
               timeout.Stop();
 
-              PString _resp;
-              HandleCmdRest(_resp);
+              PINDEX respBegin = bresp.GetSize();
 
-              PBYTEArray _bresp((const BYTE *)(const char *)_resp, _resp.GetLength());
+              HandleCmdRest(bresp);
 
-              myPTRACE(1, "<-- " << PRTHEX(_bresp));
-              bresp.Concatenate(_bresp);
+              myPTRACE(1, "<-- " << PRTHEX(PBYTEArray(bresp.GetPointer() + respBegin, bresp.GetSize() - respBegin)));
             }
             else
             if (activeEngines[mceT38]) {
@@ -4294,6 +4337,14 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
       break;
     case stRecv:
       {
+        if (connectHeld) {
+          if (!timerConnect.Get())
+            break;
+
+          connectHeld = FALSE;
+          PutConnect(bresp);
+        }
+
         BYTE Buf[1024];
         int count;
 
@@ -4346,19 +4397,12 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
                     int dms = P.DelayFrmConnect();
 
                     if (dms) {
-                      Mutex.Signal();
-                      PThread::Sleep(dms * 10);
-                      Mutex.Wait();
+                      // keep the data in dleData until the delay expires
+                      connectHeld = TRUE;
+                      timerConnect.Start(dms * 10);
+                    } else {
+                      PutConnect(bresp);
                     }
-
-                    // send CONNECT just before data for AT+FRM command
-
-                    PString _resp = RC_PREF() + RC_CONNECT();
-
-                    PBYTEArray _bresp((const BYTE *)(const char *)_resp, _resp.GetLength());
-
-                    myPTRACE(1, "<-- " << PRTHEX(_bresp));
-                    bresp.Concatenate(_bresp);
                   }
                   break;
                 default:
@@ -4400,20 +4444,25 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
 
               dataCount += count;
           }
-          if (count <= 0)
+          if (count <= 0 || connectHeld)
             break;
         }
 
+        if (connectHeld)
+          break;
+
         if (P.ModemClassId() == EngineBase::mcAudio) {
           if (count < 0) {
-            PBYTEArray _bresp((const BYTE *)"\x10" "b", 2);	// <DLE>b
-            bresp.Concatenate(_bresp);
-            myPTRACE(2, "<-- DLE " << PRTHEX(_bresp));
+            bresp.Put("\x10" "b", 2);		// <DLE>b
+            myPTRACE(2, "<-- DLE " << PRTHEX(PBYTEArray((const BYTE *)"\x10" "b", 2)));
           }
         }
 
         for(;;) {
-          count = dleData.GetDleData(Buf, sizeof(Buf));
+          // escape the data in place in the output buffer
+          BYTE *pDle = bresp.PutBegin(sizeof(Buf));
+
+          count = dleData.GetDleData(pDle, sizeof(Buf));
 
           switch (count) {
             case -1:
@@ -4442,17 +4491,16 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
             case 0:
               break;
             default: {
-              PBYTEArray _bresp(PBYTEArray(Buf, count));
 #if PTRACING
               if (PTrace::CanTrace(4)) {
                  if (count <= 16) {
-                   PTRACE(4, "<-- DLE " << PRTHEX(_bresp));
+                   PTRACE(4, "<-- DLE " << PRTHEX(PBYTEArray(pDle, count)));
                  } else {
                    PTRACE(4, "<-- DLE " << count << " bytes");
                  }
               }
 #endif
-              bresp.Concatenate(_bresp);
+              bresp.PutEnd(count);
             }
           }
           if( count <= 0 ) break;
@@ -4466,10 +4514,8 @@ void ModemEngineBody::CheckState(PBYTEArray & bresp)
   if (resp.GetLength()) {
     resp = RC_PREF() + resp;
 
-    PBYTEArray _bresp((const BYTE *)(const char *)resp, resp.GetLength());
-
-    myPTRACE(1, "<-- " << PRTHEX(_bresp));
-    bresp.Concatenate(_bresp);
+    myPTRACE(1, "<-- " << PRTHEX(PBYTEArray((const BYTE *)(const char *)resp, resp.GetLength())));
+    bresp.Put((const char *)resp, resp.GetLength());
   }
 }
 
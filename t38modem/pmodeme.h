@@ -58,6 +58,7 @@
 ///////////////////////////////////////////////////////////////
 class ModemEngineBody;
 class PseudoModemBody;
+class ModemReactorTask;
 
 class ModemEngine : public ModemThreadChild
 {
@@ -72,6 +73,9 @@ class ModemEngine : public ModemThreadChild
 
   /**@name Operations */
   //@{
+    void Start();
+    void Stop();
+    virtual void SignalDataReady();
     PBoolean IsReady() const;
     PBoolean Request(PStringToString &request) const;
     virtual T38Engine *NewPtrT38Engine() const;
@@ -84,9 +88,14 @@ class ModemEngine : public ModemThreadChild
   protected:
     PseudoModemBody &Parent() const { return (PseudoModemBody &)parent; }
     virtual void Main();
+    PBoolean HandleDataReady();
     void ToPtyQ(const void *buf, PINDEX count) const { Parent().ToOutPtyQ(buf, count); }
 
+    PDECLARE_NOTIFIER(ModemReactorTask, ModemEngine, OnReactorTask);
+
     ModemEngineBody *body;
+    ModemReactorTask *task;
+    PBYTEArena bresp;			// output of HandleDataReady(), reused
 };
 ///////////////////////////////////////////////////////////////
 
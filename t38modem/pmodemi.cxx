@@ -88,15 +88,22 @@
 #include <ptlib.h>
 #include "pmodemi.h"
 #include "pmodeme.h"
+#include "stats.h"
 
 #define new PNEW
 
+///////////////////////////////////////////////////////////////
+static const PINDEX MAX_qBUF = 1024*2;
 ///////////////////////////////////////////////////////////////
 PseudoModemBody::PseudoModemBody(const PString &_tty, const PString &_route, const PNotifier &_callbackEndPoint)
   : PseudoModem(_tty),
     route(_route),
     callbackEndPoint(_callbackEndPoint),
-    engine(NULL)
+    engine(NULL),
+    outPtyQ(MAX_qBUF),
+    inPtyQ(MAX_qBUF),
+    isOutPtyQParked(FALSE),
+    stats(NULL)
 {
 }
 
@@ -149,27 +156,101 @@ EngineBase *PseudoModemBody::NewPtrUserInputEngine() const
   return engine->NewPtrUserInputEngine();
 }
 
+ModemStats &PseudoModemBody::Stats() const
+{
+  ModemStats *s = stats;
+
+  if (s == NULL)
+    stats = s = &ModemStats::Get(ptyName());
+
+  return *s;
+}
+
+void PseudoModemBody::FromInPtyQDone(PINDEX count)
+{
+  inPtyQ.GetEnd(count);
+
+  ModemStats::Set(Stats().inPtyQDepth, inPtyQ.GetCount());
+
+  if (GetReactor()) {
+    // the reactor does not read the pty while inPtyQ is full
+    PWaitAndSignal mutexWait(Mutex);
+    ModemThreadChild *notify = GetPtyNotifier();
+
+    if (notify)
+      notify->SignalDataReady();
+  }
+}
+
+void PseudoModemBody::FromOutPtyQDone(PINDEX count)
+{
+  outPtyQ.GetEnd(count);
+
+  ModemStats::Set(Stats().outPtyQDepth, outPtyQ.GetCount());
+
+  myMemoryBarrier();		// released the space before checking isOutPtyQParked
+
+  if (isOutPtyQParked) {
+    // the engine can flush the parked data now
+    PWaitAndSignal mutexWait(Mutex);
+
+    if (engine)
+      engine->SignalDataReady();
+  }
+}
+
+void PseudoModemBody::FlushOutPtyQ()
+{
+  PINDEX size = outPtyQParked.GetSize();
+
+  if (size == 0)
+    return;
+
+  isOutPtyQParked = TRUE;
+
+  myMemoryBarrier();		// set isOutPtyQParked before checking the space
+
+  PINDEX len = outPtyQ.Put(outPtyQParked.GetPointer(), size);
+
+  PutPtyQDone(outPtyQ, TRUE);
+
+  outPtyQParked.GetEnd(len);
+
+  if (len == size)
+    isOutPtyQParked = FALSE;
+
+  if (len) {
+    PWaitAndSignal mutexWait(Mutex);
+    ModemThreadChild *notify = GetPtyNotifier();
+
+    if (notify)
+      notify->SignalDataReady();
+  }
+}
+
 void PseudoModemBody::ToPtyQ(const void *buf, PINDEX count, PBoolean OutQ)
 {
   if( count == 0 )
     return;
 
-  PBYTEArrayQ &PtyQ = OutQ ? outPtyQ : inPtyQ;
+  if (OutQ && GetReactor()) {
+    // the reactor workers should not be blocked, so park the data
+    // till the pty will be drained
+    outPtyQParked.Put(buf, count);
+    FlushOutPtyQ();
+    return;
+  }
+
+  PBYTERingQ &PtyQ = OutQ ? outPtyQ : inPtyQ;
 
   for( int delay = 10 ;; delay *= 2 ) {
-    static const PINDEX MAX_qBUF = 1024*2;
     static const int MAX_delay = ((MAX_qBUF/2)*8*1000)/14400;
-    PINDEX busy = PtyQ.GetCount();
-
-    if( busy < MAX_qBUF ) {
-      PINDEX free = MAX_qBUF - busy;
-      PINDEX len = count;
-      if( len > free )
-        len = free;
-      PtyQ.Enqueue(new PBYTEArray((const BYTE *)buf, len));
-      buf = (const BYTE *)buf + len;
-      count -= len;
-    }
+    PINDEX len = PtyQ.Put(buf, count);
+
+    PutPtyQDone(PtyQ, OutQ);
+
+    buf = (const BYTE *)buf + len;
+    count -= len;
 
     {
       PWaitAndSignal mutexWait(Mutex);
@@ -190,20 +271,33 @@ void PseudoModemBody::ToPtyQ(const void *buf, PINDEX count, PBoolean OutQ)
     if (delay > MAX_delay) {
       delay = MAX_delay;
       myPTRACE(2, "PseudoModemBody::ToPtyQ(" << (OutQ ? "outPtyQ" : "inPtyQ") << ")"
-        << " busy=" << busy << " count=" << count << " delay=" << delay);
+        << " busy=" << PtyQ.GetCount() << " count=" << count << " delay=" << delay);
     }
     PThread::Sleep(delay);
     if( stop ) break;
   }
 }
 
+void PseudoModemBody::PutPtyQDone(const PBYTERingQ &PtyQ, PBoolean OutQ)
+{
+  PINDEX depth = PtyQ.GetCount();
+
+  if (OutQ) {
+    ModemStats::Set(Stats().outPtyQDepth, depth);
+    ModemStats::Max(Stats().outPtyQMaxDepth, depth);
+  } else {
+    ModemStats::Set(Stats().inPtyQDepth, depth);
+    ModemStats::Max(Stats().inPtyQMaxDepth, depth);
+  }
+}
+
 PBoolean PseudoModemBody::StartAll()
 {
   if (engine)
     return TRUE;
 
   if ((engine = new ModemEngine(*this)) != NULL) {
-    engine->Resume();
+    engine->Start();
     return TRUE;
   }
   PseudoModemBody::StopAll();
@@ -213,14 +307,19 @@ PBoolean PseudoModemBody::StartAll()
 void PseudoModemBody::StopAll()
 {
   if (engine) {
-    engine->SignalStop();
-    engine->WaitForTermination();
+    engine->Stop();
     PWaitAndSignal mutexWait(Mutex);
     delete engine;
     engine = NULL;
   }
+  myPTRACE(2, "PseudoModemBody::StopAll high water marks:"
+              " outPtyQ=" << outPtyQ.GetHighWaterMark() << "/" << outPtyQ.GetSize() <<
+              " inPtyQ=" << inPtyQ.GetHighWaterMark() << "/" << inPtyQ.GetSize());
+
   outPtyQ.Clean();
   inPtyQ.Clean();
+  outPtyQParked.Clean();
+  isOutPtyQParked = FALSE;
   childstop = FALSE;
 }
 
@@ -67,6 +67,8 @@
 
 ///////////////////////////////////////////////////////////////
 class ModemEngine;
+class ModemReactor;
+struct ModemStats;
 
 class PseudoModemBody : public PseudoModem
 {
@@ -81,18 +83,23 @@ class PseudoModemBody : public PseudoModem
 
   /**@name Operations */
   //@{
-    PBYTEArray *FromInPtyQ() { return inPtyQ.Dequeue(); }
+    const BYTE *FromInPtyQ(PINDEX &count) const { return inPtyQ.GetBegin(count); }
+    void FromInPtyQDone(PINDEX count);
     void ToOutPtyQ(const void *buf, PINDEX count) { ToPtyQ(buf, count, TRUE); };
+    void FlushOutPtyQ();
   //@}
 
     virtual PBoolean IsReady() const;
     PBoolean CheckRoute(const PString &number) const;
+    const PString &Route() const { return route; }
     PBoolean Request(PStringToString &request) const;
     virtual T38Engine *NewPtrT38Engine() const;
     virtual AudioEngine *NewPtrAudioEngine() const;
     virtual EngineBase *NewPtrUserInputEngine() const;
 
     const PNotifier &GetCallbackEndPoint() const { return callbackEndPoint; }
+    virtual ModemReactor *GetReactor() const { return NULL; }
+    ModemStats &Stats() const;
 
   protected:
     virtual const PString &ttyPath() const = 0;
@@ -102,22 +109,29 @@ class PseudoModemBody : public PseudoModem
     virtual void MainLoop() = 0;
 
     PBoolean AddModem() const;
-    PBYTEArray *FromOutPtyQ() { return outPtyQ.Dequeue(); }
-    void ToInPtyQ(PBYTEArray *buf) { inPtyQ.Enqueue(buf); }
+    const BYTE *FromOutPtyQ(PINDEX &count) const { return outPtyQ.GetBegin(count); }
+    PINDEX FromOutPtyQ(const BYTE *pBuf[2], PINDEX count[2]) const { return outPtyQ.GetBegin(pBuf, count); }
+    void FromOutPtyQDone(PINDEX count);
     void ToInPtyQ(const void *buf, PINDEX count) { ToPtyQ(buf, count, FALSE); };
+    void PutInPtyQ(const void *buf, PINDEX count) { inPtyQ.Put(buf, count); PutPtyQDone(inPtyQ, FALSE); }	// w/o notifying
+    PINDEX GetInPtyQFree() const { return inPtyQ.GetFree(); }
 
     PMutex Mutex;
 
   private:
     void Main();
     void ToPtyQ(const void *buf, PINDEX count, PBoolean OutQ);
+    void PutPtyQDone(const PBYTERingQ &PtyQ, PBoolean OutQ);
 
     PString route;
     const PNotifier callbackEndPoint;
     ModemEngine *engine;
 
-    PBYTEArrayQ outPtyQ;
-    PBYTEArrayQ inPtyQ;
+    PBYTERingQ outPtyQ;
+    PBYTERingQ inPtyQ;
+    PBYTEArena outPtyQParked;		// can't be put to outPtyQ w/o waiting
+    volatile PBoolean isOutPtyQParked;
+    mutable Atomic<ModemStats *> stats;	// bound on first use when ptyName() is known
 };
 ///////////////////////////////////////////////////////////////
 
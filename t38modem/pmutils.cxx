@@ -116,36 +116,141 @@ void ModemThreadChild::SignalStop()
   parent.SignalChildStop();
 }
 ///////////////////////////////////////////////////////////////
-int ChunkStream::write(const void *pBuf, PINDEX count)
+PBYTERingQ::PBYTERingQ(PINDEX _size)
+  : head(0),
+    tail(0),
+    highWaterMark(0)
 {
-  int len = sizeof(data) - last;
+  for (size = 256 ; size < _size ; size <<= 1)
+    ;
 
-  if (!len)
-    return -1;
+  data.SetSize(size);
+}
+
+PINDEX PBYTERingQ::Put(const void *_pBuf, PINDEX count)
+{
+  DWORD last = tail;
+  PINDEX busy = PINDEX(last - head.Get());	// acquire, do not overwrite the data before it was got
+
+  if (count > size - busy)
+    count = size - busy;
+
+  const BYTE *pBuf = (const BYTE *)_pBuf;
+  BYTE *pData = data.GetPointer();
+  PINDEX offset = PINDEX(last & (size - 1));
+  PINDEX len = size - offset;
 
   if (len > count)
     len = count;
 
-  memcpy(data + last, pBuf, len);
-  last += len;
+  memcpy(pData + offset, pBuf, len);
+  memcpy(pData, pBuf + len, count - len);
+
+  tail.Set(last + count);	// release, put the data before publishing it
+
+  if (highWaterMark < busy + count)
+    highWaterMark = busy + count;
 
-  return len;
+  return count;
 }
 
-int ChunkStream::read(void *pBuf, PINDEX count)
+const BYTE *PBYTERingQ::GetBegin(PINDEX &count) const
 {
-  if (sizeof(data) == first)
-    return -1;
+  DWORD first = head;
+  PINDEX busy = PINDEX(tail.Get() - first);	// acquire, do not read the data before it was put
 
-  int len = last - first;
+  PINDEX offset = PINDEX(first & (size - 1));
+  PINDEX len = size - offset;
 
-  if (len > count)
-    len = count;
+  if (len > busy)
+    len = busy;
+
+  if (count > len)
+    count = len;
+
+  return (const BYTE *)data + offset;
+}
+
+PINDEX PBYTERingQ::GetBegin(const BYTE *pBuf[2], PINDEX count[2]) const
+{
+  DWORD first = head;
+  PINDEX busy = PINDEX(tail.Get() - first);	// acquire, do not read the data before it was put
+
+  PINDEX offset = PINDEX(first & (size - 1));
+  PINDEX len = size - offset;
+
+  if (len > busy)
+    len = busy;
+
+  pBuf[0] = (const BYTE *)data + offset;
+  count[0] = len;
+  pBuf[1] = (const BYTE *)data;
+  count[1] = busy - len;
+
+  return busy;
+}
+
+void PBYTERingQ::GetEnd(PINDEX count)
+{
+  head.Set(head + count);	// release, got the data before releasing the space
+}
+
+void PBYTERingQ::Clean()
+{
+  head.Set(tail);
+}
+///////////////////////////////////////////////////////////////
+BYTE *PBYTEArena::PutBegin(PINDEX count)
+{
+  PINDEX size = data.GetSize();
+
+  if (size - busy < count) {
+    if (size < 256)
+      size = 256;
+
+    while (size - busy < count)
+      size *= 2;
+
+    data.SetSize(size);
+  }
+
+  return data.GetPointer() + busy;
+}
+
+PBYTEArena &PBYTEArena::sprintf(const char *fmt, ...)
+{
+  PINDEX count = 64;
+
+  for (;;) {
+    va_list args;
+
+    va_start(args, fmt);
+    int len = vsnprintf((char *)PutBegin(count), count, fmt, args);
+    va_end(args);
+
+    if (len < 0)
+      break;
+
+    if (len < count) {
+      PutEnd(len);
+      break;
+    }
+
+    count = len + 1;
+  }
 
-  memcpy(pBuf, data + first, len);
-  first += len;
+  return *this;
+}
+
+void PBYTEArena::GetEnd(PINDEX count)
+{
+  if (count >= busy) {
+    busy = 0;
+    return;
+  }
 
-  return len;
+  busy -= count;
+  memmove(data.GetPointer(), (const BYTE *)data + count, busy);
 }
 ///////////////////////////////////////////////////////////////
 int DataStream::PutData(const void *_pBuf, PINDEX count)
@@ -153,29 +258,21 @@ int DataStream::PutData(const void *_pBuf, PINDEX count)
   if (eof)
     return -1;
 
-  int done = 0;
   const BYTE *pBuf = (const BYTE *)_pBuf;
+  PINDEX rest = count;
 
-  while (count) {
-    if (!lastBuf) {
-      lastBuf = new ChunkStream();
-      bufQ.Enqueue(lastBuf);
-    }
+  while (rest) {
+    PINDEX len = rest;
+    BYTE *pDst = PutBegin(len);
 
-    int len = lastBuf->write(pBuf, count);
+    memcpy(pDst, pBuf, len);
+    PutEnd(len);
 
-    if (len < 0) {
-      lastBuf = NULL;
-    } else {
-      pBuf += len;
-      count -= len;
-      done += len;
-    }
+    pBuf += len;
+    rest -= len;
   }
 
-  busy += done;
-
-  return done;
+  return count;
 }
 
 int DataStream::GetData(void *_pBuf, PINDEX count)
@@ -191,42 +288,98 @@ int DataStream::GetData(void *_pBuf, PINDEX count)
   BYTE *pBuf = (BYTE *)_pBuf;
 
   while (count) {
-    if (!firstBuf) {
-      firstBuf = bufQ.Dequeue();
-      if (!firstBuf) {
-        lastBuf = NULL;
-        break;
-      }
-    }
+    PINDEX len = count;
+    const BYTE *pSrc = GetBegin(len);
 
-    int len = firstBuf->read(pBuf, count);
-
-    if (len < 0) {
-      delete firstBuf;
-      firstBuf = NULL;
-    } else {
-      if (!len)
-        break;
-      pBuf += len;
-      count -= len;
-      done += len;
-    }
-  }
+    if (!len)
+      break;
+
+    memcpy(pBuf, pSrc, len);
+    GetEnd(len);
 
-  busy -= done;
+    pBuf += len;
+    count -= len;
+    done += len;
+  }
 
   return done;
 }
 
+BYTE *DataStream::PutBegin(PINDEX &count)
+{
+  if (eof) {
+    count = 0;
+    return NULL;
+  }
+
+  if (data.GetSize() - busy < count)
+    Grow(busy + count);
+
+  PINDEX size = data.GetSize();
+  PINDEX last = (first + busy) & (size - 1);
+  PINDEX len = size - busy;
+
+  if (len > size - last)
+    len = size - last;
+
+  if (count > len)
+    count = len;
+
+  return data.GetPointer() + last;
+}
+
+const BYTE *DataStream::GetBegin(PINDEX &count)
+{
+  PINDEX len = data.GetSize() - first;
+
+  if (len > busy)
+    len = busy;
+
+  if (count > len)
+    count = len;
+
+  return (const BYTE *)data + first;
+}
+
+void DataStream::GetEnd(PINDEX count)
+{
+  busy -= count;
+
+  if (busy)
+    first = (first + count) & (data.GetSize() - 1);
+  else
+    first = 0;		// keep free space contiguous
+}
+
+void DataStream::Grow(PINDEX count)
+{
+  PINDEX size = data.GetSize();
+  PINDEX newSize = size ? size : 256;
+
+  while (newSize < count || newSize <= threshold)
+    newSize <<= 1;
+
+  PBYTEArray newData(newSize);
+
+  if (busy) {
+    PINDEX len = size - first;
+
+    if (len > busy)
+      len = busy;
+
+    memcpy(newData.GetPointer(), (const BYTE *)data + first, len);
+
+    if (len < busy)
+      memcpy(newData.GetPointer() + len, (const BYTE *)data, busy - len);
+  }
+
+  data = newData;
+  first = 0;
+}
+
 void DataStream::Clean()
 {
-  ChunkStream *buf;
-  while ((buf = bufQ.Dequeue()) != NULL)
-    delete buf;
-  if (firstBuf)
-    delete firstBuf;
-  firstBuf = lastBuf = NULL;
-  busy = 0;
+  first = busy = 0;
   eof = FALSE;
   diag = 0;
 }
@@ -104,7 +104,7 @@ class ModemThread : public PThread
 
   /**@name Operations */
   //@{
-    void SignalDataReady() { dataReadySyncPoint.Signal(); }
+    virtual void SignalDataReady() { dataReadySyncPoint.Signal(); }
     void SignalChildStop();
     virtual void SignalStop();
   //@}
@@ -136,64 +136,132 @@ class ModemThreadChild : public ModemThread
     ModemThread &parent;
 };
 ///////////////////////////////////////////////////////////////
-PQUEUE(_PBYTEArrayQ, PBYTEArray);
+#if defined(__GNUC__)
+#define myMemoryBarrier() __sync_synchronize()
+#elif defined(_MSC_VER)
+#define myMemoryBarrier() MemoryBarrier()
+#else
+#error "myMemoryBarrier() is not defined for this compiler"
+#endif
 
-class PBYTEArrayQ : public _PBYTEArrayQ
+/*
+ * Integer or pointer value shared by several threads without locking.
+ *
+ * Get() has acquire semantics and Set() has release semantics, so the
+ * data written before Set() are visible after Get() returned the new
+ * value. CompareAndSwap(), Increment() and Decrement() are full barriers
+ * and they are for 32-bit integers only.
+ */
+template <class T> class Atomic
 {
-    PCLASSINFO(PBYTEArrayQ, _PBYTEArrayQ);
   public:
-    PBYTEArrayQ() : count(0) {}
-    ~PBYTEArrayQ() { Clean(); }
+    Atomic(T _value) : value(_value) {}
 
-    virtual void Enqueue(PBYTEArray *buf) {
-      PWaitAndSignal mutexWait(Mutex);
-      count += buf->GetSize();
-      _PBYTEArrayQ::Enqueue(buf);
-    }
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+    T Get() const { return __atomic_load_n(&value, __ATOMIC_ACQUIRE); }
+    void Set(T _value) { __atomic_store_n(&value, _value, __ATOMIC_RELEASE); }
+#else
+    T Get() const { T v = value; myMemoryBarrier(); return v; }
+    void Set(T _value) { myMemoryBarrier(); value = _value; }
+#endif
 
-    virtual PBYTEArray *Dequeue() {
-      PWaitAndSignal mutexWait(Mutex);
-      PBYTEArray *buf = _PBYTEArrayQ::Dequeue();
-      if( buf ) count -= buf->GetSize();
-      return buf;
+#if defined(__GNUC__)
+    PBoolean CompareAndSwap(T oldValue, T newValue) {
+      return __sync_bool_compare_and_swap(&value, oldValue, newValue);
+    }
+    T Increment() { return __sync_add_and_fetch(&value, 1); }
+    T Decrement() { return __sync_sub_and_fetch(&value, 1); }
+#elif defined(_MSC_VER)
+    PBoolean CompareAndSwap(T oldValue, T newValue) {
+      return InterlockedCompareExchange((volatile LONG *)&value, LONG(newValue), LONG(oldValue)) == LONG(oldValue);
     }
+    T Increment() { return T(InterlockedIncrement((volatile LONG *)&value)); }
+    T Decrement() { return T(InterlockedDecrement((volatile LONG *)&value)); }
+#endif
 
-    PINDEX GetCount() const { return count; }
+    operator T() const { return Get(); }
+    Atomic &operator=(T _value) { Set(_value); return *this; }
 
-    void Clean() {
-      PBYTEArray *buf;
-      while( (buf = Dequeue()) != NULL ) {
-        delete buf;
-      }
-    }
-  protected:
-    PINDEX count;
-    PMutex Mutex;
+  private:
+    Atomic(const Atomic &);
+    Atomic &operator=(const Atomic &);
+
+    volatile T value;
 };
 ///////////////////////////////////////////////////////////////
-class ChunkStream : public PObject
+/*
+ * Bounded byte queue for one producer thread and one consumer thread.
+ *
+ * The producer (Put()) and the consumer (GetBegin()/GetEnd()) never lock
+ * each other, they only share the free running head and tail counters.
+ * Clean() can be called only if there is no concurrent consumer.
+ */
+class PBYTERingQ : public PObject
 {
-    PCLASSINFO(ChunkStream, PObject);
+    PCLASSINFO(PBYTERingQ, PObject);
   public:
-    ChunkStream() : first(0), last(0) {}
+    PBYTERingQ(PINDEX _size);
 
-    int write(const void *pBuf, PINDEX count);
-    int read(void *pBuf, PINDEX count);
+    PINDEX Put(const void *pBuf, PINDEX count);
+    const BYTE *GetBegin(PINDEX &count) const;
+    PINDEX GetBegin(const BYTE *pBuf[2], PINDEX count[2]) const;	// both contiguous parts
+    void GetEnd(PINDEX count);
+    void Clean();
 
-  private:
-    BYTE data[256];
-    PINDEX first;
-    PINDEX last;
+    PINDEX GetCount() const { return PINDEX(tail - head); }
+    PINDEX GetFree() const { return size - GetCount(); }
+    PINDEX GetSize() const { return size; }
+    PINDEX GetHighWaterMark() const { return highWaterMark; }
+
+  protected:
+    PBYTEArray data;
+    PINDEX size;		// a power of 2
+    Atomic<DWORD> head;	// changed by consumer only
+    Atomic<DWORD> tail;	// changed by producer only
+    PINDEX highWaterMark;
 };
+///////////////////////////////////////////////////////////////
+/*
+ * Linear byte buffer for collecting the output of one pass.
+ *
+ * Clean() and GetEnd() keep the allocated memory, so a buffer reused for
+ * each pass stops allocating as soon as it has grown to the largest pass.
+ * PutBegin() returns a pointer to at least count free bytes and PutEnd()
+ * commits the number of bytes really put there.
+ * The operator += and sprintf() append text like the PString ones, so the
+ * responses can be built in place.
+ */
+class PBYTEArena : public PObject
+{
+    PCLASSINFO(PBYTEArena, PObject);
+  public:
+    PBYTEArena(PINDEX _size = 0) : data(_size), busy(0) {}
+
+    void Put(const void *pBuf, PINDEX count) { memcpy(PutBegin(count), pBuf, count); PutEnd(count); }
+    BYTE *PutBegin(PINDEX count);
+    void PutEnd(PINDEX count) { busy += count; }
+    void GetEnd(PINDEX count);
+    void Truncate(PINDEX count) { if (count < busy) busy = count; }
+    void Clean() { busy = 0; }
+
+    PBYTEArena &operator+=(const char *str) { Put(str, (PINDEX)strlen(str)); return *this; }
+    PBYTEArena &operator+=(const PString &str) { Put((const char *)str, str.GetLength()); return *this; }
+    PBYTEArena &sprintf(const char *fmt, ...);
+
+    const BYTE *GetPointer() const { return data; }
+    PINDEX GetSize() const { return busy; }
 
-PQUEUE(ChunkStreamQ, ChunkStream);
+  protected:
+    PBYTEArray data;
+    PINDEX busy;
+};
 ///////////////////////////////////////////////////////////////
 class DataStream : public PObject
 {
     PCLASSINFO(DataStream, PObject);
   public:
     DataStream(PINDEX _threshold = 0)
-      : firstBuf(NULL), lastBuf(NULL), busy(0),
+      : first(0), busy(0),
         threshold(_threshold), eof(FALSE), diag(0) {}
     ~DataStream() { DataStream::Clean(); }
 
@@ -205,10 +273,26 @@ class DataStream : public PObject
     PBoolean isFull() const { return threshold && threshold < busy; }
     virtual void Clean();
 
+    /*
+     * In place access to the buffer.
+     *
+     * PutBegin() returns a pointer to contiguous free space for up to count
+     * bytes (the buffer is grown if it has less than count free bytes) and
+     * updates count to the size of that space (0 if eof).
+     * GetBegin() returns a pointer to contiguous data for up to count bytes
+     * and updates count to the size of that data (0 if no data).
+     * PutEnd() and GetEnd() commit the number of bytes really put or got.
+     */
+    BYTE *PutBegin(PINDEX &count);
+    void PutEnd(PINDEX count) { busy += count; }
+    const BYTE *GetBegin(PINDEX &count);
+    void GetEnd(PINDEX count);
+
   private:
-    ChunkStream *firstBuf;
-    ChunkStreamQ bufQ;
-    ChunkStream *lastBuf;	// if not NULL then it should be in bufQ or firstBuf
+    void Grow(PINDEX count);
+
+    PBYTEArray data;		// ring buffer, the size is a power of 2
+    PINDEX first;		// offset of the first busy byte
     PINDEX busy;
 
     PINDEX threshold;
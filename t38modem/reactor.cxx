@@ -0,0 +1,408 @@
+/*
+ * reactor.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: reactor.cxx,v $
+ *
+ */
+
+#include <ptlib.h>
+#include "pmutils.h"
+#include "reactor.h"
+
+#ifdef MODEM_REACTOR
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#define new PNEW
+
+///////////////////////////////////////////////////////////////
+class ModemReactorWorker : public PThread
+{
+    PCLASSINFO(ModemReactorWorker, PThread);
+  public:
+    ModemReactorWorker(ModemReactor &_reactor, PINDEX _num)
+      : PThread(30000, AutoDeleteThread, NormalPriority),
+        reactor(_reactor),
+        num(_num)
+    {
+      Resume();
+    }
+  protected:
+    virtual void Main();
+
+    ModemReactor &reactor;
+    PINDEX num;
+};
+///////////////////////////////////////////////////////////////
+void ModemReactorWorker::Main()
+{
+  RenameCurrentThread(PString("reactor") + PString(num));
+  myPTRACE(1, "Started");
+
+  reactor.WorkerMain();
+}
+///////////////////////////////////////////////////////////////
+ModemReactorTask::ModemReactorTask(ModemReactor &_reactor, const PNotifier &_handler)
+  : reactor(_reactor),
+    handler(_handler),
+    fd(-1),
+    key(0),
+    events(0),
+    queued(FALSE),
+    running(FALSE),
+    pending(FALSE),
+    detached(FALSE),
+    runningThread(0),
+    deleted(NULL),
+    next(NULL)
+{
+}
+
+ModemReactorTask::~ModemReactorTask()
+{
+  Detach();
+
+  PWaitAndSignal mutexWait(reactor.Mutex);
+
+  // deleted by own handler, do not let ModemReactor::Run() touch it
+  if (deleted)
+    *deleted = TRUE;
+}
+
+void ModemReactorTask::Schedule(int _events)
+{
+  PWaitAndSignal mutexWait(reactor.Mutex);
+
+  reactor.Post(this, _events);
+}
+
+PBoolean ModemReactorTask::Attach(int _fd)
+{
+  PWaitAndSignal mutexWait(reactor.Mutex);
+
+  if (detached || fd >= 0)
+    return FALSE;
+
+  key = ++reactor.lastKey;
+
+  epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLONESHOT;
+  ev.data.u64 = key;
+
+  if (::epoll_ctl(reactor.epfd, EPOLL_CTL_ADD, _fd, &ev) != 0) {
+    int err = errno;
+    myPTRACE(1, "ModemReactorTask::Attach epoll_ctl ERROR: " << strerror(err));
+    return FALSE;
+  }
+
+  fd = _fd;
+  reactor.tasks.SetAt(key, this);
+
+  return TRUE;
+}
+
+PBoolean ModemReactorTask::Arm(int _events)
+{
+  PWaitAndSignal mutexWait(reactor.Mutex);
+
+  if (detached || fd < 0)
+    return FALSE;
+
+  epoll_event ev;
+
+  memset(&ev, 0, sizeof(ev));
+  ev.events = _events | EPOLLONESHOT;
+  ev.data.u64 = key;
+
+  if (::epoll_ctl(reactor.epfd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+    int err = errno;
+    myPTRACE(1, "ModemReactorTask::Arm epoll_ctl ERROR: " << strerror(err));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+void ModemReactorTask::Detach()
+{
+  PWaitAndSignal mutexWait(reactor.Mutex);
+
+  if (detached)
+    return;
+
+  detached = TRUE;
+
+  if (fd >= 0) {
+    ::epoll_ctl(reactor.epfd, EPOLL_CTL_DEL, fd, NULL);
+    reactor.tasks.RemoveAt(key);
+    fd = -1;
+  }
+
+  if (queued)
+    reactor.Remove(this);
+
+  // wait the handler returns (if it's not the caller)
+  while (running && runningThread != PThread::GetCurrentThreadId()) {
+    reactor.Mutex.Signal();
+    idle.Wait();
+    reactor.Mutex.Wait();
+  }
+}
+///////////////////////////////////////////////////////////////
+static PMutex reactorMutex;
+static ModemReactor *theReactor = NULL;
+
+ModemReactor *ModemReactor::GetReactor()
+{
+  PWaitAndSignal mutexWait(reactorMutex);
+
+  return theReactor;
+}
+
+ModemReactor *ModemReactor::GetReactor(PINDEX workers)
+{
+  PWaitAndSignal mutexWait(reactorMutex);
+
+  if (theReactor == NULL) {
+    if (workers == 0)
+      workers = ::sysconf(_SC_NPROCESSORS_ONLN);
+
+    // the handlers can wait for the engine callbacks, so at least one worker should be free
+    if (workers < 2)
+      workers = 2;
+
+    ModemReactor *newReactor = new ModemReactor(workers);
+
+    if (newReactor->epfd < 0 || newReactor->wakefd < 0) {
+      myPTRACE(1, "ModemReactor::GetReactor can't create reactor");
+      delete newReactor;
+      return NULL;
+    }
+
+    theReactor = newReactor;
+
+    for (PINDEX i = 0 ; i < workers ; i++)
+      new ModemReactorWorker(*theReactor, i);
+
+    myPTRACE(1, "ModemReactor::GetReactor started " << workers << " workers");
+  }
+
+  return theReactor;
+}
+
+ModemReactor::ModemReactor(PINDEX _workers)
+  : epfd(::epoll_create(64)),
+    wakefd(::eventfd(0, EFD_NONBLOCK)),
+    workers(_workers),
+    idleWorkers(0),
+    lastKey(0),
+    first(NULL),
+    last(NULL)
+{
+  tasks.DisallowDeleteObjects();
+
+  if (epfd >= 0 && wakefd >= 0) {
+    epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.u64 = 0;
+
+    if (::epoll_ctl(epfd, EPOLL_CTL_ADD, wakefd, &ev) != 0) {
+      ::close(wakefd);
+      wakefd = -1;
+    }
+  }
+}
+
+ModemReactor::~ModemReactor()
+{
+  if (wakefd >= 0)
+    ::close(wakefd);
+
+  if (epfd >= 0)
+    ::close(epfd);
+}
+
+void ModemReactor::Enqueue(ModemReactorTask *task)
+{
+  task->queued = TRUE;
+  task->next = NULL;
+
+  if (last)
+    last->next = task;
+  else
+    first = task;
+
+  last = task;
+
+  if (idleWorkers)
+    eventfd_write(wakefd, 1);
+}
+
+ModemReactorTask *ModemReactor::Dequeue()
+{
+  ModemReactorTask *task = first;
+
+  if (task) {
+    first = task->next;
+
+    if (!first)
+      last = NULL;
+
+    task->next = NULL;
+    task->queued = FALSE;
+  }
+
+  return task;
+}
+
+void ModemReactor::Remove(ModemReactorTask *task)
+{
+  ModemReactorTask *prev = NULL;
+
+  for (ModemReactorTask *t = first ; t ; prev = t, t = t->next) {
+    if (t == task) {
+      if (prev)
+        prev->next = t->next;
+      else
+        first = t->next;
+
+      if (last == t)
+        last = prev;
+
+      t->next = NULL;
+      t->queued = FALSE;
+      break;
+    }
+  }
+}
+
+void ModemReactor::Run(ModemReactorTask *task)
+{
+  int events = task->events;
+  PBoolean deleted = FALSE;
+
+  task->events = 0;
+  task->running = TRUE;
+  task->runningThread = PThread::GetCurrentThreadId();
+  task->deleted = &deleted;
+
+  Mutex.Signal();
+  task->handler(*task, events);
+  Mutex.Wait();
+
+  if (deleted)
+    return;
+
+  task->deleted = NULL;
+  task->running = FALSE;
+  task->runningThread = 0;
+
+  if (task->detached) {
+    task->idle.Signal();
+  }
+  else
+  if (task->pending) {
+    task->pending = FALSE;
+    Enqueue(task);
+  }
+}
+
+void ModemReactor::Post(ModemReactorTask *task, int events)
+{
+  if (task->detached)
+    return;
+
+  task->events |= events;
+
+  if (task->running)
+    task->pending = TRUE;
+  else
+  if (!task->queued)
+    Enqueue(task);
+}
+
+void ModemReactor::WorkerMain()
+{
+  for (;;) {
+    Mutex.Wait();
+
+    ModemReactorTask *task = Dequeue();
+
+    if (task) {
+      // pass the rest of queue to idle workers
+      if (first && idleWorkers)
+        eventfd_write(wakefd, 1);
+
+      Run(task);
+      Mutex.Signal();
+      continue;
+    }
+
+    idleWorkers++;
+    Mutex.Signal();
+
+    epoll_event events[32];
+
+    int count = ::epoll_wait(epfd, events, PARRAYSIZE(events), -1);
+    int err = errno;
+
+    Mutex.Wait();
+    idleWorkers--;
+
+    if (count < 0) {
+      Mutex.Signal();
+
+      if (err != EINTR) {
+        myPTRACE(1, "ModemReactor::WorkerMain epoll_wait ERROR: " << strerror(err));
+        PThread::Sleep(100);
+      }
+      continue;
+    }
+
+    for (int i = 0 ; i < count ; i++) {
+      if (events[i].data.u64 == 0) {
+        eventfd_t value;
+        eventfd_read(wakefd, &value);
+        continue;
+      }
+
+      task = tasks.GetAt((PINDEX)events[i].data.u64);
+
+      if (task != NULL)
+        Post(task, events[i].events);
+    }
+
+    Mutex.Signal();
+  }
+}
+///////////////////////////////////////////////////////////////
+
+#endif // MODEM_REACTOR
+
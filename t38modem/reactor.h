@@ -0,0 +1,139 @@
+/*
+ * reactor.h
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: reactor.h,v $
+ *
+ */
+
+#ifndef _REACTOR_H
+#define _REACTOR_H
+
+#if defined(P_LINUX)
+  #define MODEM_REACTOR
+#endif
+
+#ifdef MODEM_REACTOR
+
+///////////////////////////////////////////////////////////////
+class ModemReactor;
+class ModemReactorWorker;
+
+/*
+ * A unit of work served by ModemReactor.
+ *
+ * The handler is called as handler(task, events) by one of the reactor
+ * workers, where events is a mask of EPOLL* events reported for the
+ * attached file descriptor (0 if the task was scheduled by Schedule()).
+ * Calls of the handler for the same task are never overlapped, several
+ * Schedule() calls done while the task is waiting or running are merged
+ * into one call. The handler may delete its own task.
+ */
+class ModemReactorTask : public PObject
+{
+    PCLASSINFO(ModemReactorTask, PObject);
+  public:
+  /**@name Construction */
+  //@{
+    ModemReactorTask(ModemReactor &_reactor, const PNotifier &_handler);
+    ~ModemReactorTask();
+  //@}
+
+  /**@name Operations */
+  //@{
+    void Schedule() { Schedule(0); }
+    PBoolean Attach(int _fd);
+    PBoolean Arm(int _events);
+    void Detach();
+  //@}
+
+  private:
+    void Schedule(int _events);
+
+    ModemReactor &reactor;
+    const PNotifier handler;
+
+    int fd;
+    PINDEX key;
+
+    int events;
+    PBoolean queued;
+    PBoolean running;
+    PBoolean pending;
+    PBoolean detached;
+    PThreadIdentifier runningThread;
+    PBoolean *deleted;
+    PSyncPoint idle;
+    ModemReactorTask *next;
+
+    friend class ModemReactor;
+};
+///////////////////////////////////////////////////////////////
+PDICTIONARY(_ModemReactorTaskDict, POrdinalKey, ModemReactorTask);
+
+class ModemReactor : public PObject
+{
+    PCLASSINFO(ModemReactor, PObject);
+  public:
+  /**@name Construction */
+  //@{
+    static ModemReactor *GetReactor(PINDEX workers);
+    static ModemReactor *GetReactor();    // NULL if it was not created yet
+  //@}
+
+  /**@name Operations */
+  //@{
+    PINDEX GetWorkers() const { return workers; }
+  //@}
+
+  private:
+    ModemReactor(PINDEX _workers);
+    ~ModemReactor();
+
+    void Enqueue(ModemReactorTask *task);
+    ModemReactorTask *Dequeue();
+    void Remove(ModemReactorTask *task);
+    void Run(ModemReactorTask *task);
+    void Post(ModemReactorTask *task, int events);
+    void WorkerMain();
+
+    int epfd;
+    int wakefd;
+    PINDEX workers;
+    PINDEX idleWorkers;
+    PINDEX lastKey;
+    _ModemReactorTaskDict tasks;
+    ModemReactorTask *first;
+    ModemReactorTask *last;
+    PMutex Mutex;
+
+    friend class ModemReactorTask;
+    friend class ModemReactorWorker;
+};
+///////////////////////////////////////////////////////////////
+
+#endif // MODEM_REACTOR
+
+#endif // _REACTOR_H
+
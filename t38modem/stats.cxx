@@ -0,0 +1,323 @@
+/*
+ * stats.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: stats.cxx,v $
+ *
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/mman.h>
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+#include "pmutils.h"
+#include "stats.h"
+
+#define new PNEW
+
+///////////////////////////////////////////////////////////////
+static const DWORD MAX_MODEMS = 1024;
+///////////////////////////////////////////////////////////////
+class ModemStatsSlot : public PObject
+{
+    PCLASSINFO(ModemStatsSlot, PObject);
+  public:
+    ModemStatsSlot(ModemStats &_stats) : stats(_stats) {}
+
+    ModemStats &stats;
+};
+
+PDICTIONARY(_ModemStatsSlots, PString, ModemStatsSlot);
+///////////////////////////////////////////////////////////////
+static PMutex &SlotsMutex()
+{
+  static PMutex mutex;
+  return mutex;
+}
+
+static ModemStatsHeader *statsHeader = NULL;
+
+static ModemStats *GetSlots(ModemStatsHeader *header)
+{
+  return (ModemStats *)((BYTE *)header + header->headerSize);
+}
+
+static PINDEX StatsFileSize(DWORD maxModems)
+{
+  return sizeof(ModemStatsHeader) + maxModems * sizeof(ModemStats);
+}
+///////////////////////////////////////////////////////////////
+#ifdef _WIN32
+static void *MapFile(const PString &path, PINDEX &size, PBoolean create)
+{
+  HANDLE hFile = ::CreateFile(path,
+                              create ? GENERIC_READ|GENERIC_WRITE : GENERIC_READ,
+                              FILE_SHARE_READ|FILE_SHARE_WRITE,
+                              NULL,
+                              create ? CREATE_ALWAYS : OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL,
+                              NULL);
+
+  if (hFile == INVALID_HANDLE_VALUE)
+    return NULL;
+
+  if (!create)
+    size = (PINDEX)::GetFileSize(hFile, NULL);
+
+  HANDLE hMap = ::CreateFileMapping(hFile, NULL,
+                                    create ? PAGE_READWRITE : PAGE_READONLY,
+                                    0, (DWORD)size, NULL);
+
+  ::CloseHandle(hFile);
+
+  if (hMap == NULL)
+    return NULL;
+
+  void *p = ::MapViewOfFile(hMap, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+
+  ::CloseHandle(hMap);
+
+  return p;
+}
+
+static void UnmapFile(void *p, PINDEX)
+{
+  ::UnmapViewOfFile(p);
+}
+#else
+static void *MapFile(const PString &path, PINDEX &size, PBoolean create)
+{
+  int fd = ::open(path, create ? O_RDWR|O_CREAT|O_TRUNC : O_RDONLY, 0644);
+
+  if (fd < 0)
+    return NULL;
+
+  if (create) {
+    if (::ftruncate(fd, size) != 0) {
+      ::close(fd);
+      return NULL;
+    }
+  } else {
+    off_t end = ::lseek(fd, 0, SEEK_END);
+
+    if (end <= 0) {
+      ::close(fd);
+      return NULL;
+    }
+
+    size = (PINDEX)end;
+  }
+
+  void *p = ::mmap(NULL, size, create ? PROT_READ|PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+  ::close(fd);
+
+  return p == MAP_FAILED ? NULL : p;
+}
+
+static void UnmapFile(void *p, PINDEX size)
+{
+  ::munmap(p, size);
+}
+#endif
+///////////////////////////////////////////////////////////////
+PBoolean ModemStats::OpenFile(const PString &path)
+{
+  PWaitAndSignal mutexWait(SlotsMutex());
+
+  if (statsHeader) {
+    myPTRACE(1, "ModemStats::OpenFile " << path << " already opened");
+    return FALSE;
+  }
+
+  PINDEX size = StatsFileSize(MAX_MODEMS);
+  ModemStatsHeader *header = (ModemStatsHeader *)MapFile(path, size, TRUE);
+
+  if (header == NULL) {
+    myPTRACE(1, "ModemStats::OpenFile " << path << " ERROR: " << strerror(errno));
+    return FALSE;
+  }
+
+  // the new file is filled by zeros
+  header->version = MODEM_STATS_VERSION;
+  header->headerSize = sizeof(ModemStatsHeader);
+  header->statsSize = sizeof(ModemStats);
+  header->maxModems = MAX_MODEMS;
+  header->numModems = 0;
+  header->pid = (DWORD)PProcess::Current().GetProcessID();
+
+  myMemoryBarrier();		// the header is valid before the magic
+  memcpy(header->magic, MODEM_STATS_MAGIC, sizeof(header->magic));
+
+  statsHeader = header;
+
+  myPTRACE(1, "ModemStats::OpenFile " << path << " " << size << " bytes for " << MAX_MODEMS << " modems");
+
+  return TRUE;
+}
+
+ModemStats &ModemStats::Get(const PString &name)
+{
+  PWaitAndSignal mutexWait(SlotsMutex());
+
+  static _ModemStatsSlots *slots = NULL;
+
+  if (slots == NULL) {
+    slots = new _ModemStatsSlots;
+    slots->DisallowDeleteObjects();
+  }
+
+  ModemStatsSlot *slot = slots->GetAt(name);
+
+  if (slot)
+    return slot->stats;
+
+  ModemStats *stats;
+
+  if (statsHeader && statsHeader->numModems < statsHeader->maxModems) {
+    stats = &GetSlots(statsHeader)[statsHeader->numModems];
+
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+
+    myMemoryBarrier();		// the name is valid before the slot is counted
+    statsHeader->numModems++;
+  } else {
+    if (statsHeader) {
+      myPTRACE(1, "ModemStats::Get no free slot in the file for " << name);
+    }
+
+    stats = (ModemStats *)calloc(1, sizeof(ModemStats));
+    strncpy(stats->name, name, sizeof(stats->name) - 1);
+  }
+
+  slots->SetAt(name, new ModemStatsSlot(*stats));
+
+  return *stats;
+}
+///////////////////////////////////////////////////////////////
+static void DumpHist(ostream &out, const char *head, const volatile PUInt64 hist[ModemStats::histSize])
+{
+  PUInt64 total = 0;
+
+  for (int i = 0 ; i < ModemStats::histSize ; i++)
+    total += hist[i];
+
+  if (total == 0)
+    return;
+
+  out << "  " << head << ":";
+
+  for (int i = 0 ; i < ModemStats::histSize ; i++) {
+    if (hist[i] == 0)
+      continue;
+
+    if (i == 0)
+      out << " <1ms=";
+    else
+    if (i == ModemStats::histSize - 1)
+      out << " >=" << (1 << (i - 1)) << "ms=";
+    else
+      out << " " << (1 << (i - 1)) << "ms=";
+
+    out << hist[i];
+  }
+
+  out << "\n";
+}
+
+PBoolean ModemStats::Dump(const PString &path, ostream &out)
+{
+  PINDEX size = 0;
+  ModemStatsHeader *header = (ModemStatsHeader *)MapFile(path, size, FALSE);
+
+  if (header == NULL) {
+    out << path << ": " << strerror(errno) << endl;
+    return FALSE;
+  }
+
+  if (size < (PINDEX)sizeof(ModemStatsHeader)
+      || memcmp(header->magic, MODEM_STATS_MAGIC, sizeof(header->magic)) != 0
+      || header->version != MODEM_STATS_VERSION
+      || header->statsSize != sizeof(ModemStats)
+      || size < (PINDEX)(header->headerSize + header->maxModems * header->statsSize))
+  {
+    out << path << ": invalid statistics file" << endl;
+    UnmapFile(header, size);
+    return FALSE;
+  }
+
+  DWORD numModems = header->numModems;
+
+  myMemoryBarrier();		// numModems before the slots
+
+  out << path << ": pid " << header->pid << ", " << numModems << " modems\n";
+
+  const ModemStats *slots = GetSlots(header);
+
+  for (DWORD n = 0 ; n < numModems && n < header->maxModems ; n++) {
+    const ModemStats &s = slots[n];
+    PString name(s.name, strnlen(s.name, sizeof(s.name)));
+
+    out << name << ":\n"
+        << "  pty: read " << s.ptyReadCalls << " calls, " << s.ptyReadBytes << " bytes"
+        <<      ", write " << s.ptyWriteCalls << " calls, " << s.ptyWriteBytes << " bytes\n"
+        << "  queues: inPtyQ=" << s.inPtyQDepth << " (max " << s.inPtyQMaxDepth << ")"
+        <<         " outPtyQ=" << s.outPtyQDepth << " (max " << s.outPtyQMaxDepth << ")\n"
+        << "  states: " << s.stateChanges << " changes\n";
+
+    for (int i = 0 ; i < ModemStats::maxStates ; i++)
+      DumpHist(out, psprintf("state %d", i), s.stateTime[i]);
+
+    out << "  ifp out: " << s.ifpOut << " (repeated " << s.ifpOutRepeated << ")\n"
+        << "  ifp in: " << s.ifpIn
+        <<         " (lost " << s.ifpInLost
+        <<         ", repeated " << s.ifpInRepeated
+        <<         ", fake " << s.ifpInFake
+        <<         ", decode errors " << s.ifpInDecodeErrors
+        <<         ", reordered " << s.ifpInReordered << ")\n"
+        << "  udptl in: " << s.udptlIn
+        <<         " (lost " << s.udptlInLost
+        <<         ", loss rate " << s.udptlLossRate << "/1000)\n"
+        << "  udptl redundancy: level " << s.udptlRedundancyLevel
+        <<         " (raised " << s.udptlRedundancyRaised
+        <<         ", lowered " << s.udptlRedundancyLowered << ")\n"
+        << "  audio out: " << s.audioBytesOut << " bytes (silence " << s.audioBytesOutSilence << ")\n"
+        << "  audio in: " << s.audioBytesIn << " bytes\n";
+  }
+
+  out << flush;
+
+  UnmapFile(header, size);
+
+  return TRUE;
+}
+///////////////////////////////////////////////////////////////
+
@@ -0,0 +1,185 @@
+/*
+ * stats.h
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: stats.h,v $
+ *
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+///////////////////////////////////////////////////////////////
+/*
+ * Statistics file layout (host byte order, 64-bit aligned):
+ *
+ *   ModemStatsHeader
+ *   ModemStats[ModemStatsHeader::maxModems]
+ *
+ * A slot is allocated for each pseudo-modem on first use and its name is
+ * written before numModems is incremented, so a reader can map the file
+ * and sample the first numModems slots at any time. All counters are
+ * only incremented (except the current queue depths, the UDPTL loss rate
+ * and redundancy level), so the rates are the deltas between two samples.
+ */
+#define MODEM_STATS_MAGIC    "T38MSTAT"
+#define MODEM_STATS_VERSION  3
+
+struct ModemStatsHeader
+{
+  char magic[8];
+  DWORD version;
+  DWORD headerSize;           // sizeof(ModemStatsHeader)
+  DWORD statsSize;            // sizeof(ModemStats)
+  DWORD maxModems;
+  volatile DWORD numModems;
+  DWORD pid;
+};
+
+struct ModemStats
+{
+  enum {
+    maxStates = 16,           // ModemEngineBody states
+    histSize = 16,            // buckets: <1 ms, [1,2) ms, [2,4) ms, ... >=16384 ms
+  };
+
+  char name[32];              // pty name
+
+  /**@name Pseudo-modem */
+  //@{
+  volatile PUInt64 ptyReadCalls;
+  volatile PUInt64 ptyReadBytes;
+  volatile PUInt64 ptyWriteCalls;
+  volatile PUInt64 ptyWriteBytes;
+  volatile PUInt64 inPtyQDepth;
+  volatile PUInt64 inPtyQMaxDepth;
+  volatile PUInt64 outPtyQDepth;
+  volatile PUInt64 outPtyQMaxDepth;
+  volatile PUInt64 stateChanges;
+  volatile PUInt64 stateTime[maxStates][histSize];   // time spent in the state
+  //@}
+
+  /**@name T.38 */
+  //@{
+  volatile PUInt64 ifpOut;
+  volatile PUInt64 ifpOutRepeated;                   // "repeated" packets with a fake payload
+  volatile PUInt64 ifpIn;
+  volatile PUInt64 ifpInLost;
+  volatile PUInt64 ifpInRepeated;                    // redundant copies of handled packets
+  volatile PUInt64 ifpInFake;
+  volatile PUInt64 ifpInDecodeErrors;
+  volatile PUInt64 ifpInReordered;                   // missing packets arrived within the hold time
+  volatile PUInt64 udptlIn;                          // received UDPTL packets
+  volatile PUInt64 udptlInLost;                      // missing UDPTL packets before the recovery
+  volatile PUInt64 udptlLossRate;                    // estimated loss rate (1/1000)
+  volatile PUInt64 udptlRedundancyLevel;             // adaptive redundancy level
+  volatile PUInt64 udptlRedundancyRaised;
+  volatile PUInt64 udptlRedundancyLowered;
+  //@}
+
+  /**@name Audio */
+  //@{
+  volatile PUInt64 audioBytesOut;
+  volatile PUInt64 audioBytesOutSilence;             // sendAudio underruns
+  volatile PUInt64 audioBytesIn;
+  //@}
+
+  /**@name Operations */
+  //@{
+    static void Add(volatile PUInt64 &counter, PUInt64 value = 1);
+    static void Set(volatile PUInt64 &gauge, PUInt64 value) { gauge = value; }
+    static void Max(volatile PUInt64 &gauge, PUInt64 value);
+    static void Hist(volatile PUInt64 hist[histSize], PInt64 msec);
+  //@}
+
+  /**@name Slots */
+  //@{
+    /**Create and map the statistics file.
+      */
+    static PBoolean OpenFile(
+      const PString &path
+    );
+
+    /**Print the statistics file to the stream.
+      */
+    static PBoolean Dump(
+      const PString &path,
+      ostream &out
+    );
+
+    /**Get the slot for the pseudo-modem.
+       If there is no statistics file or it is full then returns a private
+       slot in the heap. The slot is never freed.
+      */
+    static ModemStats &Get(
+      const PString &name
+    );
+  //@}
+};
+///////////////////////////////////////////////////////////////
+#if defined(__GNUC__)
+inline void ModemStats::Add(volatile PUInt64 &counter, PUInt64 value)
+{
+  __sync_fetch_and_add(&counter, value);
+}
+
+inline void ModemStats::Max(volatile PUInt64 &gauge, PUInt64 value)
+{
+  for (PUInt64 old = gauge ; old < value ; old = gauge) {
+    if (__sync_bool_compare_and_swap(&gauge, old, value))
+      break;
+  }
+}
+#elif defined(_MSC_VER)
+inline void ModemStats::Add(volatile PUInt64 &counter, PUInt64 value)
+{
+  InterlockedExchangeAdd64((volatile LONGLONG *)&counter, LONGLONG(value));
+}
+
+inline void ModemStats::Max(volatile PUInt64 &gauge, PUInt64 value)
+{
+  for (PUInt64 old = gauge ; old < value ; old = gauge) {
+    if (InterlockedCompareExchange64((volatile LONGLONG *)&gauge, LONGLONG(value), LONGLONG(old)) == LONGLONG(old))
+      break;
+  }
+}
+#else
+#error "ModemStats::Add() is not defined for this compiler"
+#endif
+
+inline void ModemStats::Hist(volatile PUInt64 hist[histSize], PInt64 msec)
+{
+  int i = 0;
+
+  while (msec > 0 && i < histSize - 1) {
+    msec >>= 1;
+    i++;
+  }
+
+  Add(hist[i]);
+}
+///////////////////////////////////////////////////////////////
+
+#endif  // _STATS_H
+
@@ -52,6 +52,7 @@
  */
 
 #include <ptlib.h>
+#include <math.h>
 #include "pmutils.h"
 #include "t30tone.h"
 
@@ -64,205 +65,283 @@ typedef	PInt16                    SIMPLE_TYPE;
 #define BYTES_PER_SIMPLE          sizeof(SIMPLE_TYPE)
 #define SIMPLES_PER_SEC           8000
 ///////////////////////////////////////////////////////////////
-#define CNG_HZ                    1100
-#define CNG_ON_MSEC               500
-#define CNG_OFF_MSEC              3000
+#define BLOCK_MSEC                10
+#define BLOCK_LEN                 ((SIMPLES_PER_SEC*BLOCK_MSEC)/1000)
+#define MSEC2BLOCKS(ms)           ((ms)/BLOCK_MSEC)
+
+#define MIN_LEVEL                 30          // min RMS of a tone
+#define MIN_RATIO                 0.5         // min part of the block energy in the tone
+///////////////////////////////////////////////////////////////
+#define CNG_ON_MSEC_MIN           300         // 500 ms +-40%
+#define CNG_ON_MSEC_MAX           700
+#define CNG_OFF_MSEC_MIN          250
+#define CNG_GAP_MSEC_MAX          10
+///////////////////////////////////////////////////////////////
+#define CED_ON_MSEC_MIN           500
+#define CED_GAP_MSEC_MAX          20          // ANSam phase reversals
+///////////////////////////////////////////////////////////////
+#define V21_ON_MSEC_MIN           300         // preamble is 1 sec
+#define V21_GAP_MSEC_MAX          10
 ///////////////////////////////////////////////////////////////
-#define CNG_FILTER_BUF_LEN ((((SIMPLES_PER_SEC + CNG_HZ - 1)/CNG_HZ + 1)/2)*2)
+#define BUSY_MSEC_MIN             200         // on and off periods
+#define BUSY_MSEC_MAX             700
+#define BUSY_GAP_MSEC_MAX         10
+#define BUSY_CYCLES               2
+///////////////////////////////////////////////////////////////
+enum {
+  f425,			// call progress (Europe)
+  f480,			// busy (North America) 480+620
+  f620,
+  f1100,		// CNG
+  f1650,		// V.21 channel 2 mark
+  f1850,		// V.21 channel 2 space
+  f2100,		// CED, ANSam
+  fUnused,
+};
 
-#define tone_trace(cng_filter_buf, power, cng_power, cng_power_norm)
-#ifndef tone_trace
-static void tone_trace(const long *cng_filter_buf, long power, long cng_power, long cng_power_norm)
-{
-  PString str;
+static const unsigned frequencies[T30ToneDetect::numFilters] = {
+  425, 480, 620, 1100, 1650, 1850, 2100, 0
+};
 
-  for (PINDEX i = 0 ; i < CNG_FILTER_BUF_LEN ; i++) {
-    str += PString(cng_filter_buf[i]);
-    str += " ";
-  }
+static float coefficients[T30ToneDetect::numFilters];
 
-  myPTRACE(1, str << " pw=" << power << " cng_pw=" << cng_power << " norm=" << cng_power_norm);
-}
-#endif
+#define TWO_PI                    (3.1415926535897932384626433832795029L*2)
+
+static PBoolean InitCoefficients(const void *)
+{
+  for (PINDEX k = 0 ; k < T30ToneDetect::numFilters ; k++)
+    coefficients[k] = frequencies[k] ? float(2*cos(double((TWO_PI*frequencies[k])/SIMPLES_PER_SEC))) : 0;
 
+  return TRUE;
+}
+///////////////////////////////////////////////////////////////
 enum {
-  cng_phase_off_head,
-  cng_phase_on,
-  cng_phase_off_tail,
+  cdNone,
+  cdOnEnd,		// the on period ended (lastOn is set)
+  cdOffEnd,		// the off period ended (lastOff is set)
 };
 
-T30ToneDetect::T30ToneDetect()
+static void InitCadence(T30ToneDetect::Cadence &c, int off)
 {
-  cng_filter_buf = new long[CNG_FILTER_BUF_LEN];
-  memset(cng_filter_buf, 0, CNG_FILTER_BUF_LEN*sizeof(cng_filter_buf[0]));
+  memset(&c, 0, sizeof(c));
+  c.off = off;
+}
+
+static int UpdateCadence(T30ToneDetect::Cadence &c, PBoolean present, int maxGap)
+{
+  if (present) {
+    if (c.on == 0) {
+      c.lastOff = c.off;
+      c.off = 0;
+      c.on = 1;
+      c.gap = 0;
+      return cdOffEnd;
+    }
+
+    c.on += c.gap + 1;
+    c.gap = 0;
+    return cdNone;
+  }
+
+  if (c.on == 0) {
+    if (c.off < MSEC2BLOCKS(60*1000))
+      c.off++;
+    return cdNone;
+  }
 
-  index = 0;
-  power = 0;
+  if (++c.gap <= maxGap)
+    return cdNone;
 
-  cng_on_count = 0;
-  cng_off_count = 0;
-  cng_phase = cng_phase_off_head;
+  c.lastOn = c.on;
+  c.on = 0;
+  c.off = c.gap;
+  c.gap = 0;
+  return cdOnEnd;
 }
 
-T30ToneDetect::~T30ToneDetect()
+static PBoolean InRange(int blocks, int msMin, int msMax)
 {
-  delete [] cng_filter_buf;
+  return blocks >= MSEC2BLOCKS(msMin) && blocks <= MSEC2BLOCKS(msMax);
 }
+///////////////////////////////////////////////////////////////
+T30ToneDetect::T30ToneDetect()
+{
+  static const PBoolean initCoefficients = InitCoefficients(&initCoefficients);
 
-#define CNG_FILTER_CHUNK_LEN	20
-#define CNG_ON_CHUNKS_MIN	(((CNG_HZ*CNG_ON_MSEC)*60)/((CNG_FILTER_CHUNK_LEN*1000)*100))
-#define CNG_ON_CHUNKS_MAX	(((CNG_HZ*CNG_ON_MSEC)*140)/((CNG_FILTER_CHUNK_LEN*1000)*100))
-#define CNG_OFF_CHUNKS_MIN	(((CNG_HZ*CNG_OFF_MSEC)*30)/((CNG_FILTER_CHUNK_LEN*1000)*100))
+  for (PINDEX k = 0 ; k < numFilters ; k++) {
+    s1[k] = 0;
+    s2[k] = 0;
+  }
 
-PBoolean T30ToneDetect::Write(const void * buffer, PINDEX len)
+  energy = 0;
+  count = 0;
+
+  // the beginning of the stream is an off period
+  InitCadence(cng, MSEC2BLOCKS(CNG_OFF_MSEC_MIN));
+  InitCadence(ced, 0);
+  InitCadence(v21, 0);
+  InitCadence(busy, MSEC2BLOCKS(BUSY_MSEC_MIN));
+
+  numDetected = 0;
+  detected[0] = 0;
+}
+
+const char *T30ToneDetect::Write(const void * buffer, PINDEX len)
 {
-  PBoolean detected = FALSE;
+  const SIMPLE_TYPE *pBuf = (const SIMPLE_TYPE *)buffer;
 
-  SIMPLE_TYPE *pBuf = (SIMPLE_TYPE *)buffer;
   len /= BYTES_PER_SIMPLE;
+  numDetected = 0;
 
   while (len) {
-    PINDEX iBuf = 0;
+    PINDEX n = BLOCK_LEN - count;
+
+    if (n > len)
+      n = len;
 
-    // filter CNG and calculate total power
+    count += n;
+    len -= n;
 
-    PINDEX index0 = index;
+    // local copies of the state, so the compiler knows they are not aliased
 
-    while (index < CNG_FILTER_BUF_LEN*CNG_FILTER_CHUNK_LEN) {
-      iBuf = ((index - index0)*SIMPLES_PER_SEC)/(CNG_FILTER_BUF_LEN*CNG_HZ);
+    float c[numFilters], cc[numFilters], p1[numFilters], p2[numFilters];
+    float e = energy;
+
+    for (PINDEX k = 0 ; k < numFilters ; k++) {
+      c[k] = coefficients[k];
+      cc[k] = c[k]*c[k] - 1;
+      p1[k] = s1[k];
+      p2[k] = s2[k];
+    }
 
-      if (iBuf >= len)
-        return detected;
+    // two samples per step, so both are computed from the same state:
+    //   s[n]     = x[n] + c*s[n-1] - s[n-2]
+    //   s[n + 1] = x[n + 1] + c*x[n] + (c*c - 1)*s[n-1] - c*s[n-2]
 
-      SIMPLE_TYPE pw = pBuf[iBuf];
+    for (const SIMPLE_TYPE *pEnd = pBuf + (n & ~1) ; pBuf < pEnd ; pBuf += 2) {
+      float x0 = pBuf[0];
+      float x1 = pBuf[1];
 
-      cng_filter_buf[index%CNG_FILTER_BUF_LEN] += pw;
+      e += x0*x0 + x1*x1;
 
-      if (pw < 0)
-        power -= pw;
-      else
-        power += pw;
+      // independent filters (GCC vectorizes this loop at -O2 and above)
+      for (PINDEX k = 0 ; k < numFilters ; k++) {
+        float y0 = x0 + c[k]*p1[k] - p2[k];
+        float y1 = x1 + c[k]*x0 + cc[k]*p1[k] - c[k]*p2[k];
 
-      index++;
+        p2[k] = y0;
+        p1[k] = y1;
+      }
     }
 
-    // calculate CNG power
+    if (n & 1) {
+      float x = *pBuf++;
 
-    PINDEX i;
-    long cng_power_cur = 0;
+      e += x*x;
 
-    for (i = 0 ; i < CNG_FILTER_BUF_LEN/2 ; i++)
-      cng_power_cur += cng_filter_buf[i];
+      for (PINDEX k = 0 ; k < numFilters ; k++) {
+        float s = x + c[k]*p1[k] - p2[k];
 
-    for (; i < CNG_FILTER_BUF_LEN ; i++)
-      cng_power_cur -= cng_filter_buf[i];
+        p2[k] = p1[k];
+        p1[k] = s;
+      }
+    }
 
-    long cng_power;
+    for (PINDEX k = 0 ; k < numFilters ; k++) {
+      s1[k] = p1[k];
+      s2[k] = p2[k];
+    }
 
-    if (cng_power_cur < 0)
-      cng_power = -cng_power_cur;
-    else
-      cng_power = cng_power_cur;
+    energy = e;
 
-    for (i = 1 ; i < CNG_FILTER_BUF_LEN/2 ; i++) {
-      cng_power_cur -= cng_filter_buf[i]*2;
-      cng_power_cur += cng_filter_buf[i + CNG_FILTER_BUF_LEN/2]*2;
+    if (count == BLOCK_LEN)
+      HandleBlock();
+  }
 
-      if (cng_power_cur < 0) {
-        if (cng_power < -cng_power_cur)
-          cng_power = -cng_power_cur;
-      } else {
-        if (cng_power < cng_power_cur)
-          cng_power = cng_power_cur;
-      }
-    }
+  detected[numDetected] = 0;
 
-    long cng_power_norm = cng_power * 1000;
+  return detected;
+}
 
-    if (power > 1)
-      cng_power_norm /= power;
+void T30ToneDetect::Detected(char tone)
+{
+  if (numDetected < PINDEX(sizeof(detected)) - 1)
+    detected[numDetected++] = tone;
+}
 
-    if (cng_on_count > 1)
-      cng_power_norm = (cng_power_norm*140)/100;
-    if (cng_off_count > 1)
-      cng_power_norm = (cng_power_norm*80)/100;
+void T30ToneDetect::HandleBlock()
+{
+  // the part of the block energy in each tone (about 1.0 for a pure tone)
 
-    if (cng_power_norm > 500) {
-      cng_on_count++;
+  float ratio[numFilters];
+  float norm = energy*(BLOCK_LEN/2);
+  PBoolean loud = energy > float(MIN_LEVEL*MIN_LEVEL*BLOCK_LEN);
 
-      switch (cng_phase) {
-        case cng_phase_off_head:
-          if (cng_off_count >= CNG_OFF_CHUNKS_MIN)
-            cng_phase = cng_phase_on;
-          else
-            cng_phase = cng_phase_off_head;
-          break;
+  for (PINDEX k = 0 ; k < numFilters ; k++) {
+    float power = s1[k]*s1[k] + s2[k]*s2[k] - coefficients[k]*s1[k]*s2[k];
 
-        case cng_phase_on:
-          break;
+    ratio[k] = loud ? power/norm : 0;
+    s1[k] = 0;
+    s2[k] = 0;
+  }
 
-        case cng_phase_off_tail:
-          cng_phase = cng_phase_off_head;
-          break;
+  energy = 0;
+  count = 0;
 
-        default:
-          cng_phase = cng_phase_off_head;
-      }
+  // CNG: 0.5 sec on, 3 sec off
 
-      if (cng_off_count) {
-        myPTRACE(2, "cng_off_count=" << cng_off_count);
-        cng_off_count = 0;
-      }
+  UpdateCadence(cng, ratio[f1100] > MIN_RATIO, MSEC2BLOCKS(CNG_GAP_MSEC_MAX));
 
-      tone_trace(cng_filter_buf, power, cng_power, cng_power_norm);
+  if (cng.on == 0 && cng.off == MSEC2BLOCKS(CNG_OFF_MSEC_MIN) && cng.lastOn) {
+    if (cng.lastOff >= MSEC2BLOCKS(CNG_OFF_MSEC_MIN) &&
+        InRange(cng.lastOn, CNG_ON_MSEC_MIN, CNG_ON_MSEC_MAX))
+    {
+      myPTRACE(1, "Detected CNG");
+      Detected('c');
     } else {
-      cng_off_count++;
-
-      switch (cng_phase) {
-        case cng_phase_off_head:
-          break;
-
-        case cng_phase_on:
-          if (cng_on_count >= CNG_ON_CHUNKS_MIN && cng_on_count <= CNG_ON_CHUNKS_MAX)
-            cng_phase = cng_phase_off_tail;
-          else
-            cng_phase = cng_phase_off_head;
-          break;
-
-        case cng_phase_off_tail:
-          if (cng_off_count >= CNG_OFF_CHUNKS_MIN) {
-            myPTRACE(1, "Detected CNG");
-            cng_phase = cng_phase_off_head;
-            detected = TRUE;
-          }
-          break;
-
-        default:
-          cng_phase = cng_phase_off_head;
-      }
+      myPTRACE(2, "CNG on " << cng.lastOn*BLOCK_MSEC << " ms after off " << cng.lastOff*BLOCK_MSEC << " ms");
+    }
+  }
 
-      if (cng_on_count) {
-        myPTRACE(2, "cng_on_count=" << cng_on_count);
-        tone_trace(cng_filter_buf, power, cng_power, cng_power_norm);
+  // CED or ANSam: 2.6-4 sec on
 
-        cng_on_count = 0;
-      }
-    }
+  if (UpdateCadence(ced, ratio[f2100] > MIN_RATIO, MSEC2BLOCKS(CED_GAP_MSEC_MAX)) == cdOnEnd)
+    ced.reported = FALSE;
 
-    // reatart filter
+  if (ced.on >= MSEC2BLOCKS(CED_ON_MSEC_MIN) && !ced.reported) {
+    myPTRACE(1, "Detected CED");
+    Detected('a');
+    ced.reported = TRUE;
+  }
 
-    memset(cng_filter_buf, 0, CNG_FILTER_BUF_LEN*sizeof(cng_filter_buf[0]));
-    index = 0;
-    power = 0;
+  // V.21 HDLC flags: mark and space
 
-    // next chunk
+  if (UpdateCadence(v21, ratio[f1650] + ratio[f1850] > MIN_RATIO, MSEC2BLOCKS(V21_GAP_MSEC_MAX)) == cdOnEnd)
+    v21.reported = FALSE;
 
-    iBuf++;
-    pBuf += iBuf;
-    len -= iBuf;
+  if (v21.on >= MSEC2BLOCKS(V21_ON_MSEC_MIN) && !v21.reported) {
+    myPTRACE(1, "Detected V.21 flags");
+    Detected('V');
+    v21.reported = TRUE;
   }
 
-  return detected;
+  // busy: BUSY_CYCLES of on and off periods
+
+  if (UpdateCadence(busy, ratio[f425] > MIN_RATIO || ratio[f480] + ratio[f620] > MIN_RATIO,
+                    MSEC2BLOCKS(BUSY_GAP_MSEC_MAX)) == cdOffEnd)
+  {
+    if (InRange(busy.lastOn, BUSY_MSEC_MIN, BUSY_MSEC_MAX) &&
+        InRange(busy.lastOff, BUSY_MSEC_MIN, BUSY_MSEC_MAX))
+    {
+      if (++busy.cycles >= BUSY_CYCLES) {
+        myPTRACE(1, "Detected busy");
+        Detected('b');
+        busy.cycles = 0;
+      }
+    } else {
+      busy.cycles = 0;
+    }
+  }
 }
 ///////////////////////////////////////////////////////////////
 
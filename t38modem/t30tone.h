@@ -48,6 +48,14 @@
 #define _T30TONE_H
 
 ///////////////////////////////////////////////////////////////
+/*
+ * Bank of Goertzel filters for the tones of a fax call.
+ *
+ * All filters are updated together sample by sample and evaluated for each
+ * 10 ms block, so the per-sample work is one short loop over the bank
+ * (GCC vectorizes it at -O2 and above, it's scalar at -Os) and the
+ * per-block work is a few cadence counters.
+ */
 class T30ToneDetect : public PObject
 {
   PCLASSINFO(T30ToneDetect, PObject);
@@ -55,18 +63,51 @@ class T30ToneDetect : public PObject
   public:
 
     T30ToneDetect();
-    ~T30ToneDetect();
 
-    PBoolean Write(const void * buffer, PINDEX len);
+    /**Detect the tones in the linear PCM samples.
+       Returns the codes of the detected tones:
+         'c' - calling tone (CNG),
+         'a' - answer tone (CED or ANSam),
+         'b' - busy tone,
+         'V' - V.21 HDLC flags,
+       or an empty string.
+       The 'c', 'a' and 'b' are the DLE shielded codes (V.253). V.253 has no
+       code for the V.21 flags, so the modem reports 'V' as 'c' (a calling
+       fax) on the answering side only.
+      */
+    const char *Write(const void * buffer, PINDEX len);
+
+    struct Cadence {
+      int on;			// blocks of the current on period (0 if off)
+      int off;			// blocks of the current off period
+      int gap;			// blocks of the current gap in the on period
+      int lastOn;		// blocks of the last on period
+      int lastOff;		// blocks of the last off period
+      int cycles;		// on and off periods in the range
+      PBoolean reported;		// the on period was reported
+    };
+
+    enum {
+      numFilters = 8,
+    };
 
   protected:
 
-    long *cng_filter_buf;
-    PINDEX index;
-    long power;
-    int cng_on_count;
-    int cng_off_count;
-    int cng_phase;
+    void HandleBlock();
+    void Detected(char tone);
+
+    float s1[numFilters];
+    float s2[numFilters];
+    float energy;
+    PINDEX count;
+
+    Cadence cng;
+    Cadence ced;
+    Cadence v21;
+    Cadence busy;
+
+    char detected[8];
+    PINDEX numDetected;
 };
 ///////////////////////////////////////////////////////////////
 
@@ -271,19 +271,14 @@
 #endif
 
 #include "t38engine.h"
+#include "stats.h"
+#include "bintrace.h"
 
 #define new PNEW
 
 #define T38I(t30_indicator) T38_Type_of_msg_t30_indicator::t30_indicator
 #define T38D(msg_data) T38_Type_of_msg_data::msg_data
 #define T38F(field_type) T38_Data_Field_subtype_field_type::field_type
-#define msMaxOutDelay (msPerOut*5)
-
-#ifdef P_LINUX
-  #define mySleep(ms) usleep((ms) * 1000L)
-#else
-  #define mySleep(ms) PThread::Sleep(ms)
-#endif
 ///////////////////////////////////////////////////////////////
 enum StateOut {
   stOutIdle,
@@ -513,37 +508,48 @@ static const MODPARS &GetModPars(int key, enum GetModParsBy by = by_val) {
   return invalidMods;
 }
 ///////////////////////////////////////////////////////////////
+/*
+ * The IFP packets are reused (see T38Engine::GetIFP()), so the helpers below
+ * change the fields in place and do not re-create the already allocated ones.
+ */
+static void t38reset(T38_IFP &ifp)
+{
+    ifp.RemoveOptionalField(T38_IFPPacket::e_data_field);
+}
+
+static void t38type(T38_IFP &ifp, unsigned tag)
+{
+    if (ifp.m_type_of_msg.GetTag() != tag || !ifp.m_type_of_msg.IsValid())
+      ifp.m_type_of_msg.SetTag(tag);
+}
+
 static void t38indicator(T38_IFP &ifp, unsigned type)
 {
-    ifp.m_type_of_msg.SetTag(T38_Type_of_msg::e_t30_indicator);
+    t38type(ifp, T38_Type_of_msg::e_t30_indicator);
     (T38_Type_of_msg_t30_indicator &)ifp.m_type_of_msg = type;
 }
 
-#ifdef OPTIMIZE_CORRIGENDUM_IFP
-  #define T38_DATA_FIELD T38_Data_Field_subtype
-#else
-  #define T38_DATA_FIELD T38_PreCorrigendum_Data_Field_subtype
-#endif
-
 static T38_DATA_FIELD &t38data(T38_IFP &ifp, unsigned type, unsigned field_type)
 {
-    ifp.m_type_of_msg.SetTag(T38_Type_of_msg::e_data);
+    t38type(ifp, T38_Type_of_msg::e_data);
     (T38_Type_of_msg_data &)ifp.m_type_of_msg = type;
 
     ifp.IncludeOptionalField(T38_IFPPacket::e_data_field);
-    ifp.m_data_field.SetSize(ifp.m_data_field.GetSize()+1);
+    if (ifp.m_data_field.GetSize() != 1)
+      ifp.m_data_field.SetSize(1);
     T38_DATA_FIELD &Data_Field = ifp.m_data_field[0];
     Data_Field.m_field_type = field_type;
+    Data_Field.RemoveOptionalField(T38_Data_Field_subtype::e_field_data);
     return Data_Field;
 }
 
-static void t38data(T38_IFP &ifp, unsigned type, unsigned field_type, const PBYTEArray &data)
+static void t38data(T38_IFP &ifp, unsigned type, unsigned field_type, const BYTE *pData, PINDEX len)
 {
     T38_DATA_FIELD &Data_Field = t38data(ifp, type, field_type);
 
-    if( data.GetSize() > 0 ) {
+    if( len > 0 ) {
         Data_Field.IncludeOptionalField(T38_Data_Field_subtype::e_field_data);
-        Data_Field.m_field_data = data;
+        Data_Field.m_field_data.SetValue(pData, len);
     }
 }
 ///////////////////////////////////////////////////////////////
@@ -582,8 +588,9 @@ void FakePreparePacketThread::Main()
   unsigned long count = 0;
 #endif
 
+  T38_IFP &ifp = *t38engine.GetIFP();
+
   for (;;) {
-    T38_IFP ifp;
     int res;
 
     res = t38engine.PreparePacket(EngineBase::HOWNEROUT(this), ifp);
@@ -599,6 +606,7 @@ void FakePreparePacketThread::Main()
 #endif
   }
 
+  t38engine.PutIFP(&ifp);
   t38engine.CloseOut(EngineBase::HOWNEROUT(this));
 
   PTRACE(3, t38engine.Name() << " FakePreparePacketThread::Main stopped, faked out " << count << " IFP packets");
@@ -606,10 +614,12 @@ void FakePreparePacketThread::Main()
 ///////////////////////////////////////////////////////////////
 T38Engine::T38Engine(const PString &_name)
   : EngineBase(_name + " T38Engine")
+  , stats(ModemStats::Get(_name))
   , bufOut(2048)
   , preparePacketTimeout(-1)
   , preparePacketPeriod(-1)
-  , preparePacketDelay()
+  , preparePacketDelayEnd()
+  , preparePacketDelayRestart(TRUE)
   , stateOut(stOutNoSig)
   , onIdleOut(dtNone)
   , callbackParamOut(cbpReset)
@@ -632,6 +642,7 @@ T38Engine::T38Engine(const PString &_name)
   , modStreamIn(NULL)
   , modStreamInSaved(NULL)
   , stateModem(stmIdle)
+  , ifpPoolCount(0)
 {
   PTRACE(2, name << " T38Engine");
 }
@@ -645,6 +656,32 @@ T38Engine::~T38Engine()
 
   if (modStreamInSaved != NULL)
     delete modStreamInSaved;
+
+  while (ifpPoolCount)
+    delete ifpPool[--ifpPoolCount];
+}
+
+T38_IFP *T38Engine::GetIFP()
+{
+  PWaitAndSignal mutexWait(MutexIFPPool);
+
+  if (ifpPoolCount)
+    return ifpPool[--ifpPoolCount];
+
+  return new T38_IFP;
+}
+
+void T38Engine::PutIFP(T38_IFP *ifp)
+{
+  if (ifp == NULL)
+    return;
+
+  PWaitAndSignal mutexWait(MutexIFPPool);
+
+  if (ifpPoolCount < PINDEX(PARRAYSIZE(ifpPool)))
+    ifpPool[ifpPoolCount++] = ifp;
+  else
+    delete ifp;
 }
 
 void T38Engine::OnOpenIn()
@@ -667,6 +704,7 @@ void T38Engine::OnCloseOut()
 {
   EngineBase::OnCloseOut();
   SignalOutDataReady();
+  CancelOutDelay();
 }
 
 void T38Engine::OnChangeEnableFakeIn()
@@ -678,27 +716,50 @@ void T38Engine::OnChangeEnableFakeIn()
 
   isCarrierIn = 0;
 
-  if (modStreamInSaved != NULL) {
-    myPTRACE(1, name << " OnChangeEnableFakeIn modStreamInSaved != NULL, clean");
-    delete modStreamInSaved;
-    modStreamInSaved = NULL;
+  int callbackParam = 0;
+  PBoolean doCallback = FALSE;
+
+  {
+    PWaitAndSignal mutexWait(MutexStateIn);
+
+    if (modStreamInSaved != NULL) {
+      myPTRACE(1, name << " OnChangeEnableFakeIn modStreamInSaved != NULL, clean");
+      delete modStreamInSaved;
+      modStreamInSaved = NULL;
+    }
+
+    if (modStreamIn != NULL && modStreamIn->lastBuf != NULL) {
+      myPTRACE(1, name << " OnChangeEnableFakeIn modStreamIn->lastBuf != NULL");
+      modStreamIn->PutEof((countIn == 0 ? 0 : diagOutOfOrder) | diagNoCarrier);
+
+      if (stateModem == stmInRecvData) {
+        callbackParam = callbackParamIn;
+        doCallback = TRUE;
+      }
+    }
   }
 
-  if (modStreamIn != NULL && modStreamIn->lastBuf != NULL) {
-    myPTRACE(1, name << " OnChangeEnableFakeIn modStreamIn->lastBuf != NULL");
-    modStreamIn->PutEof((countIn == 0 ? 0 : diagOutOfOrder) | diagNoCarrier);
+  if (doCallback) {
+    ModemCallbackWithUnlock(callbackParam);
 
-    if (stateModem == stmInRecvData) {
-      ModemCallbackWithUnlock(callbackParamIn);
+    if (IsOpenIn() || !isEnableFakeIn)
+      return;
 
-      if (IsOpenIn() || !isEnableFakeIn)
-        return;
+    doCallback = FALSE;
+  }
+
+  {
+    PWaitAndSignal mutexWait(MutexStateIn);
+
+    if (stateModem == stmInWaitSilence) {
+      stateModem = stmIdle;
+      callbackParam = callbackParamIn;
+      doCallback = TRUE;
     }
   }
 
-  if (stateModem == stmInWaitSilence) {
-    stateModem = stmIdle;
-    ModemCallbackWithUnlock(callbackParamIn);
+  if (doCallback) {
+    ModemCallbackWithUnlock(callbackParam);
 
     //if (IsOpenIn() || !isEnableFakeIn)
     //  return;
@@ -709,6 +770,7 @@ void T38Engine::OnChangeEnableFakeOut()
 {
   EngineBase::OnChangeEnableFakeOut();
   SignalOutDataReady();
+  CancelOutDelay();
 
   if (IsOpenOut() || !isEnableFakeOut)
     return;
@@ -728,17 +790,34 @@ void T38Engine::OnDetach()
 {
   EngineBase::OnDetach();
   SignalOutDataReady();
+  CancelOutDelay();
 }
 
 void T38Engine::OnChangeModemClass()
 {
   EngineBase::OnChangeModemClass();
 }
+
+void T38Engine::UserInputWithUnlock(const PString & value)
+{
+  // EngineBase::Mutex can't be locked after MutexStateIn
+  MutexStateIn.Signal();
+
+  {
+    PWaitAndSignal mutexWait(Mutex);
+    OnUserInput(value);
+  }
+
+  MutexStateIn.Wait();
+}
 ///////////////////////////////////////////////////////////////
 //
 void T38Engine::OnResetModemState() {
   EngineBase::OnResetModemState();
 
+  PWaitAndSignal mutexWaitOut(MutexStateOut);
+  PWaitAndSignal mutexWaitIn(MutexStateIn);
+
   if (modStreamIn && modStreamIn->DeleteFirstBuf()) {
     PTRACE(1, name << " T38Engine::OnResetModemState modStreamIn->DeleteFirstBuf(), clean");
   }
@@ -759,7 +838,7 @@ void T38Engine::OnResetModemState() {
 
 PBoolean T38Engine::isOutBufFull() const
 {
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
   return bufOut.isFull();
 }
 ///////////////////////////////////////////////////////////////
@@ -768,7 +847,7 @@ void T38Engine::SendOnIdle(DataType _dataType)
   PTRACE(2, name << " SendOnIdle " << _dataType);
 
   PWaitAndSignal mutexWaitModem(MutexModem);
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
 
   onIdleOut = _dataType;
   SignalOutDataReady();
@@ -786,16 +865,20 @@ PBoolean T38Engine::SendStart(DataType _dataType, int param)
     return FALSE;
   }
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
 
-  if (modStreamIn != NULL) {
-    delete modStreamIn;
-    modStreamIn = NULL;
-  }
+  {
+    PWaitAndSignal mutexWaitIn(MutexStateIn);
 
-  if (modStreamInSaved != NULL && _dataType != dtSilence) {
-    delete modStreamInSaved;
-    modStreamInSaved = NULL;
+    if (modStreamIn != NULL) {
+      delete modStreamIn;
+      modStreamIn = NULL;
+    }
+
+    if (modStreamInSaved != NULL && _dataType != dtSilence) {
+      delete modStreamInSaved;
+      modStreamInSaved = NULL;
+    }
   }
 
   ModParsOut = invalidMods;
@@ -842,7 +925,7 @@ int T38Engine::Send(const void *pBuf, PINDEX count)
     return -1;
   }
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
   int res = bufOut.PutData(pBuf, count);
   if (res < 0) {
     myPTRACE(1, name << " Send res(" << res << ") < 0");
@@ -864,7 +947,7 @@ PBoolean T38Engine::SendStop(PBoolean moreFrames, int _callbackParam)
     return FALSE;
   }
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
   bufOut.PutEof();
   stateModem = stmOutNoMoreData;
   moreFramesOut = moreFrames;
@@ -889,7 +972,8 @@ PBoolean T38Engine::RecvWait(DataType _dataType, int param, int _callbackParam,
     return FALSE;
   }
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWaitOut(MutexStateOut);	// for t30
+  PWaitAndSignal mutexWait(MutexStateIn);
   switch( _dataType ) {
     case dtHdlc:
     case dtRaw:
@@ -983,7 +1067,8 @@ PBoolean T38Engine::RecvStart(int _callbackParam)
     myPTRACE(1, name << " RecvStart stateModem(" << stateModem << ") != stmInReadyData");
     return FALSE;
   }
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWaitOut(MutexStateOut);	// for t30
+  PWaitAndSignal mutexWait(MutexStateIn);
   callbackParamIn = _callbackParam;
 
   if (modStreamIn != NULL) {
@@ -1015,15 +1100,25 @@ int T38Engine::Recv(void *pBuf, PINDEX count)
     myPTRACE(1, name << " Recv stateModem(" << stateModem << ") != stmInRecvData");
     return -1;
   }
-  PWaitAndSignal mutexWait(Mutex);
-  if( modStreamIn == NULL ) {
-    myPTRACE(1, name << " Recv modStreamIn == NULL");
-    return -1;
+
+  int len;
+  PBoolean v21;
+
+  {
+    PWaitAndSignal mutexWait(MutexStateIn);
+
+    if( modStreamIn == NULL ) {
+      myPTRACE(1, name << " Recv modStreamIn == NULL");
+      return -1;
+    }
+
+    len = modStreamIn->GetData(pBuf, count);
+    v21 = (modStreamIn->ModPars.msgType == T38D(e_v21));
   }
 
-  int len = modStreamIn->GetData(pBuf, count);
+  if (v21) {
+    PWaitAndSignal mutexWait(MutexStateOut);	// for t30
 
-  if (modStreamIn->ModPars.msgType == T38D(e_v21)) {
     if (len > 0)
       t30.v21Data(pBuf, len);
     else
@@ -1037,7 +1132,7 @@ int T38Engine::Recv(void *pBuf, PINDEX count)
 int T38Engine::RecvDiag() const
 {
   PWaitAndSignal mutexWaitModem(MutexModem);
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateIn);
   if( modStreamIn == NULL ) {
     myPTRACE(1, name << " RecvDiag modStreamIn == NULL");
     return diagError;
@@ -1061,7 +1156,7 @@ void T38Engine::RecvStop()
     return;
   }
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateIn);
 
   if (modStreamIn)
     modStreamIn->DeleteFirstBuf();
@@ -1072,7 +1167,7 @@ void T38Engine::RecvStop()
 ///////////////////////////////////////////////////////////////
 PBoolean T38Engine::SendingNotCompleted() const
 {
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
 
   if (hOwnerOut == NULL)
     return FALSE;
@@ -1093,7 +1188,7 @@ void T38Engine::SetPreparePacketTimeout(HOWNEROUT hOwner, int timeout, int perio
   if (hOwnerOut != hOwner)
     return;
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateOut);
 
   if (hOwnerOut != hOwner)
     return;
@@ -1102,7 +1197,7 @@ void T38Engine::SetPreparePacketTimeout(HOWNEROUT hOwner, int timeout, int perio
   preparePacketPeriod = period;
 
   if (preparePacketPeriod > 0)
-    preparePacketDelay.Restart();
+    preparePacketDelayRestart = TRUE;
 }
 ///////////////////////////////////////////////////////////////
 int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
@@ -1112,37 +1207,48 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
 
   PWaitAndSignal mutexWait(MutexOut);
 
-  if (hOwnerOut != hOwner || !IsModemOpen())
-    return 0;
-
-  {
-    PWaitAndSignal mutexWait(Mutex);
+  if (firstOut) {
+    PWaitAndSignal mutexWait(MutexStateOut);
 
     if (hOwnerOut != hOwner || !IsModemOpen())
       return 0;
 
     if (firstOut) {
       firstOut = FALSE;
-      ModemCallbackWithUnlock(cbpUpdateState);
+      ModemCallbackWithUnlock(cbpUpdateState, MutexStateOut);
 
       if (hOwnerOut != hOwner || !IsModemOpen())
         return FALSE;
 
-      preparePacketDelay.Restart();
+      preparePacketDelayRestart = TRUE;
     }
   }
 
   //myPTRACE(1, name << " PreparePacket begin stM=" << stateModem << " stO=" << stateOut);
 
-  ifp = T38_IFP();
+  t38reset(ifp);
   PBoolean doDalay = TRUE;
   PTime preparePacketTimeoutEnd = (preparePacketTimeout > 0 ? (PTime() + preparePacketTimeout) : PTime(0));
 
   if (preparePacketPeriod > 0) {
-    preparePacketDelay.Delay(preparePacketPeriod);
+    if (preparePacketDelayRestart) {
+      preparePacketDelayRestart = FALSE;
+      preparePacketDelayEnd = PTime();
+    } else {
+      preparePacketDelayEnd += preparePacketPeriod;
 
-    if (hOwnerOut != hOwner || !IsModemOpen())
-      return 0;
+      for (;;) {
+        PTimeInterval delay = preparePacketDelayEnd - PTime();
+
+        if (delay.GetMilliSeconds() <= 0)
+          break;
+
+        WaitOutDelay(delay);
+
+        if (hOwnerOut != hOwner || !IsModemOpen())
+          return 0;
+      }
+    }
   }
 
   for(;;) {
@@ -1171,10 +1277,8 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
             delay = timeout;
         }
 
-        if (delay.GetMilliSeconds() > msMaxOutDelay)
-          delay = msMaxOutDelay;
-
-        mySleep(delay.GetMilliSeconds());
+        // no need to wake up periodically, closing cancels the delay
+        WaitOutDelay(delay);
 
         if (hOwnerOut != hOwner || !IsModemOpen())
           return 0;
@@ -1189,7 +1293,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
     for(;;) {
       PBoolean waitData = FALSE;
       {
-        PWaitAndSignal mutexWait(Mutex);
+        PWaitAndSignal mutexWait(MutexStateOut);
 
         if (hOwnerOut != hOwner || !IsModemOpen())
           return 0;
@@ -1228,8 +1332,8 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                 }
 
                 if (waitms) {
-                  if (isCarrierIn == 1) {
-                    isCarrierIn = 2;
+                  // HandlePacket() can change isCarrierIn at any time
+                  if (isCarrierIn.CompareAndSwap(1, 2)) {
                     timeBeginOut = PTime() + PTimeInterval(waitms);
                     redo = TRUE;
                     break;
@@ -1238,7 +1342,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                     break;
                   } else {
                     myPTRACE(1, name << " PreparePacket isCarrierIn expired");
-                    isCarrierIn = 0;
+                    isCarrierIn.CompareAndSwap(2, 0);
                   }
                 }
               }
@@ -1266,7 +1370,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
             case stOutCedWait:
               stateOut = stOutNoSig;
               stateModem = stmIdle;
-              ModemCallbackWithUnlock(callbackParamOut);
+              ModemCallbackWithUnlock(callbackParamOut, MutexStateOut);
 
               if (hOwnerOut != hOwner || !IsModemOpen())
                 return 0;
@@ -1277,7 +1381,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
             case stOutSilenceWait:
               stateOut = stOutIdle;
               stateModem = stmIdle;
-              ModemCallbackWithUnlock(callbackParamOut);
+              ModemCallbackWithUnlock(callbackParamOut, MutexStateOut);
 
               if (hOwnerOut != hOwner || !IsModemOpen())
                 return 0;
@@ -1335,7 +1439,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                 PBoolean wasFull = bufOut.isFull();
                 int count = hdlcOut.GetData(b, len);
                 if (wasFull && !bufOut.isFull()) {
-                  ModemCallbackWithUnlock(cbpOutBufNoFull);
+                  ModemCallbackWithUnlock(cbpOutBufNoFull, MutexStateOut);
 
                   if (hOwnerOut != hOwner || !IsModemOpen())
                     return 0;
@@ -1363,7 +1467,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                     if (hdlcOut.getLastChar() != -1 &&
                         (ModParsOut.dataType == dtHdlc || hdlcOut.getLastChar() != 0))
                     {
-                      ModemCallbackWithUnlock(cbpOutBufEmpty);
+                      ModemCallbackWithUnlock(cbpOutBufEmpty, MutexStateOut);
 
                       if (hOwnerOut != hOwner || !IsModemOpen())
                         return 0;
@@ -1375,7 +1479,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                     }
                     else
                     if (timeOutBufEmpty <= PTime()) {
-                      ModemCallbackWithUnlock(cbpOutBufEmpty);
+                      ModemCallbackWithUnlock(cbpOutBufEmpty, MutexStateOut);
 
                       if (hOwnerOut != hOwner || !IsModemOpen())
                         return 0;
@@ -1390,10 +1494,10 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                         if (ModParsOut.msgType == T38D(e_v21)) {
                           t30.v21Data(b, count);
                         }
-                        t38data(ifp, ModParsOut.msgType, T38F(e_hdlc_data), PBYTEArray(b, count));
+                        t38data(ifp, ModParsOut.msgType, T38F(e_hdlc_data), b, count);
                         break;
                       case dtRaw:
-                        t38data(ifp, ModParsOut.msgType, T38F(e_t4_non_ecm_data), PBYTEArray(b, count));
+                        t38data(ifp, ModParsOut.msgType, T38F(e_t4_non_ecm_data), b, count);
                         break;
                       default:
                         myPTRACE(1, name << " PreparePacket stOutData bad dataTypeT38="
@@ -1428,7 +1532,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                   stateOut = stOutDataNoSig;
 
                 if (wasFull && !bufOut.isFull()) {
-                  ModemCallbackWithUnlock(cbpOutBufNoFull);
+                  ModemCallbackWithUnlock(cbpOutBufNoFull, MutexStateOut);
 
                   if (hOwnerOut != hOwner || !IsModemOpen())
                     return 0;
@@ -1452,7 +1556,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
                 if (moreFramesOut) {
                   stateOut = stOutData;
                   stateModem = stmOutMoreData;
-                  ModemCallbackWithUnlock(callbackParamOut);
+                  ModemCallbackWithUnlock(callbackParamOut, MutexStateOut);
 
                   if (hOwnerOut != hOwner || !IsModemOpen())
                     return 0;
@@ -1489,7 +1593,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
               }
               stateOut = stOutNoSig;
               stateModem = stmIdle;
-              ModemCallbackWithUnlock(callbackParamOut);
+              ModemCallbackWithUnlock(callbackParamOut, MutexStateOut);
 
               if (hOwnerOut != hOwner || !IsModemOpen())
                 return 0;
@@ -1546,7 +1650,7 @@ int T38Engine::PreparePacket(HOWNEROUT hOwner, T38_IFP & ifp)
         return 0;
 
       {
-        PWaitAndSignal mutexWait(Mutex);
+        PWaitAndSignal mutexWait(MutexStateOut);
 
         if (hOwnerOut != hOwner || !IsModemOpen())
           return 0;
@@ -1595,7 +1699,7 @@ PBoolean T38Engine::HandlePacketLost(HOWNERIN hOwner, unsigned myPTRACE_PARAM(nL
   if (hOwnerIn != hOwner || !IsModemOpen())
     return FALSE;
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateIn);
 
   if (hOwnerIn != hOwner || !IsModemOpen())
     return FALSE;
@@ -1617,6 +1721,12 @@ PBoolean T38Engine::HandlePacketLost(HOWNERIN hOwner, unsigned myPTRACE_PARAM(nL
 PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
 {
 #if PTRACING
+  if (BinTrace::IsStarted()) {
+    myBTRACE(2, btHandlePacket, (ifp.m_type_of_msg.GetTag(),
+                                 ((const PASN_Enumeration &)ifp.m_type_of_msg.GetObject()).GetValue(),
+                                 ifp.HasOptionalField(T38_IFPPacket::e_data_field) ? ifp.m_data_field.GetSize() : 0));
+  }
+  else
   if (PTrace::CanTrace(3)) {
     PTRACE(3, name << " HandlePacket Received ifp\n  "
              << setprecision(2) << ifp);
@@ -1629,7 +1739,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
   if (hOwnerIn != hOwner || !IsModemOpen())
     return FALSE;
 
-  PWaitAndSignal mutexWait(Mutex);
+  PWaitAndSignal mutexWait(MutexStateIn);
 
   if (hOwnerIn != hOwner || !IsModemOpen())
     return FALSE;
@@ -1658,7 +1768,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
           myPTRACE(1, name << " HandlePacket out of order " << type_of_msg);
 
           if (stateModem == stmInRecvData) {
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
@@ -1678,31 +1788,31 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
 
           if (stateModem == stmInWaitSilence) {
             stateModem = stmIdle;
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
           }
           break;
         case T38I(e_ced):
-          OnUserInput('a');
+          UserInputWithUnlock('a');
           isCarrierIn = 0;
 
           if (stateModem == stmInWaitSilence) {
             stateModem = stmIdle;
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
           }
           break;
         case T38I(e_cng):
-          OnUserInput('c');
+          UserInputWithUnlock('c');
           isCarrierIn = 0;
 
           if (stateModem == stmInWaitSilence) {
             stateModem = stmIdle;
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
@@ -1728,7 +1838,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
 
           if (stateModem == stmInWaitSilence) {
             stateModem = stmIdle;
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
@@ -1753,7 +1863,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
               myPTRACE(1, name << " HandlePacket modStreamIn == NULL");
             }
             stateModem = stmInReadyData;
-            ModemCallbackWithUnlock(callbackParamIn);
+            ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
             if (hOwnerIn != hOwner || !IsModemOpen())
               return FALSE;
@@ -1849,7 +1959,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
 
                     if (stateModem == stmInWaitSilence) {
                       stateModem = stmIdle;
-                      ModemCallbackWithUnlock(callbackParamIn);
+                      ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
                       if (hOwnerIn != hOwner || !IsModemOpen())
                         return FALSE;
@@ -1860,7 +1970,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
         }
 
         if (stateModem == stmInRecvData) {
-          ModemCallbackWithUnlock(callbackParamIn);
+          ModemCallbackWithUnlock(callbackParamIn, MutexStateIn);
 
           if (hOwnerIn != hOwner || !IsModemOpen())
             return FALSE;
@@ -1874,7 +1984,7 @@ PBoolean T38Engine::HandlePacket(HOWNERIN hOwner, const T38_IFP & ifp)
 
   if (!firstIn) {
     firstIn = FALSE;
-    ModemCallbackWithUnlock(cbpUpdateState);
+    ModemCallbackWithUnlock(cbpUpdateState, MutexStateIn);
 
     if (hOwnerIn != hOwner || !IsModemOpen())
       return FALSE;
@@ -164,7 +164,6 @@
 #define _T38ENGINE_H
 
 #include "pmutils.h"
-#include <ptclib/delaychan.h>
 #include "hdlc.h"
 #include "t30.h"
 #include "enginebase.h"
@@ -196,13 +195,16 @@ class MODPARS
 #ifdef OPTIMIZE_CORRIGENDUM_IFP
   #define T38_IFP       T38_IFPPacket
   #define T38_IFP_NAME  "IFP"
+  #define T38_DATA_FIELD T38_Data_Field_subtype
 #else
   #define T38_IFP       T38_PreCorrigendum_IFPPacket
   #define T38_IFP_NAME  "Pre-corrigendum IFP"
+  #define T38_DATA_FIELD T38_PreCorrigendum_Data_Field_subtype
 #endif
 ///////////////////////////////////////////////////////////////
 class ModStream;
 class T38_IFP;
+struct ModemStats;
 
 class T38Engine : public EngineBase
 {
@@ -271,6 +273,29 @@ class T38Engine : public EngineBase
     );
   //@}
 
+  /**@name IFP packets pool */
+  //@{
+    /**Get IFP packet from the pool (or create new one).
+
+       The packet keeps the fields allocated by its previous user, so
+       PreparePacket() and decoding can reuse them for each packet.
+      */
+    T38_IFP *GetIFP();
+
+    /**Return IFP packet to the pool.
+      */
+    void PutIFP(
+      T38_IFP *ifp
+    );
+  //@}
+
+  /**@name Statistics */
+  //@{
+    /**Get the statistics slot of the modem.
+      */
+    ModemStats &Stats() const { return stats; }
+  //@}
+
   protected:
     virtual void OnAttach();
     virtual void OnDetach();
@@ -289,14 +314,20 @@ class T38Engine : public EngineBase
     PBoolean WaitOutDataReady(const PTimeInterval & timeout) {
       return outDataReadySyncPoint.Wait(timeout);
     }
+    void CancelOutDelay() { outDelaySyncPoint.Signal(); }
+    void WaitOutDelay(const PTimeInterval & delay) { outDelaySyncPoint.Wait(delay); }
+    void UserInputWithUnlock(const PString & value);
 
   private:
+    ModemStats &stats;
+
     DataStream bufOut;
 
     int preparePacketTimeout;
     int preparePacketPeriod;
 
-    PAdaptiveDelay preparePacketDelay;
+    PTime preparePacketDelayEnd;
+    PBoolean preparePacketDelayRestart;
 
     int stateOut;
     DataType onIdleOut;
@@ -312,7 +343,7 @@ class T38Engine : public EngineBase
     HDLC hdlcOut;
 
     int callbackParamIn;
-    volatile int isCarrierIn;
+    Atomic<int> isCarrierIn;
 #if PTRACING
     PTime timeBeginIn;
 #endif
@@ -323,9 +354,29 @@ class T38Engine : public EngineBase
     ModStream *modStreamIn;
     ModStream *modStreamInSaved;
 
-    volatile int stateModem;
+    Atomic<int> stateModem;
 
     PSyncPoint outDataReadySyncPoint;
+    PSyncPoint outDelaySyncPoint;
+
+    T38_IFP *ifpPool[4];
+    PINDEX ifpPoolCount;
+    PMutex MutexIFPPool;
+
+    /*
+     * The outgoing (PreparePacket(), Send...()) and incoming (HandlePacket(),
+     * Recv...()) state is locked by MutexStateOut and MutexStateIn, so the
+     * both directions do not lock each other and EngineBase::Mutex (t30 is
+     * a part of the outgoing state). The state changes made by the other
+     * direction are seen via atomic isCarrierIn and stateModem.
+     * The lock order is
+     *
+     *   MutexModem -> MutexOut -> Mutex -> MutexStateOut -> MutexStateIn
+     *
+     * and the modem is called back with unlocked state mutex.
+     */
+    PMutex MutexStateOut;
+    PMutex MutexStateIn;
 };
 ///////////////////////////////////////////////////////////////
 
@@ -0,0 +1,344 @@
+/*
+ * at_replay.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: at_replay.cxx,v $
+ *
+ */
+
+/*
+ * Replays AT command transcripts to the modem engine the way a fax server
+ * talks to an idle modem:
+ *   - the modem is a PseudoModemBody with the queues but w/o pty, so the
+ *     command lines are handled by ModemEngine and ModemEngineBody in
+ *     process, as if they were read from the pty;
+ *   - the built-in transcript is the modem reset, setup and probe sequence
+ *     of HylaFAX with the Class 1 defaults (or the commands from a file,
+ *     one command line per line, '#' starts a comment);
+ *   - each command line is put and the response is got up to the final
+ *     result code;
+ *   - the first round only sets the state (ATZ turns the echo on again),
+ *     the responses of every next round must be byte identical to the
+ *     second one, with -v they are printed for comparing two builds;
+ *   - then all command lines of a round are put at once, so the engine
+ *     thread is woken up once per round, the response must be the
+ *     responses of the second round;
+ *   - the time per command line of both ways is reported.
+ *
+ * Usage: at_replay [-q] [-v] [-n rounds] [transcript]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "pmodemi.h"
+
+#include <string>
+#include <vector>
+
+///////////////////////////////////////////////////////////////
+static const char * const HylaFaxClass1[] = {
+  "ATZ",                        // ModemSoftResetCmd
+  "ATE0",                       // ModemEchoOffCmd
+  "ATV1",                       // ModemVerboseResultsCmd
+  "ATQ0",                       // ModemResultCodesCmd
+  "ATS8=2",                     // ModemPauseTimeCmd
+  "ATS7=60",                    // ModemWaitTimeCmd
+  "AT&D2",                      // ModemSetupDTRCmd
+  "AT&C1",                      // ModemSetupDCDCmd
+  "AT+IFC=2,2",                 // ModemFlowControlCmd (rtscts)
+  "ATM0",                       // ModemSetVolumeCmd
+  "AT+FCLASS=?",                // probe
+  "AT+FCLASS=1",
+  "AT+FTM=?",
+  "AT+FRM=?",
+  "AT+FTH=?",
+  "AT+FRH=?",
+  "AT+FMI?",                    // ModemMfrQueryCmd
+  "AT+FMM?",                    // ModemModelQueryCmd
+  "AT+FREV?",                   // ModemRevQueryCmd (config.ttyx)
+  "AT+FLO=2",                   // Class1HFLOCmd
+  "AT+FCLASS=0",                // ModemSetupAACmd
+  "ATS0=0",                     // no auto answer
+  "ATH0",                       // ModemOnHookCmd
+  "ATE0V1Q0S0=0H0",             // the reset as one command line
+  "AT+FCLASS=1;+FLO=2;+FCLASS?",
+  "ATI3",
+  "AT+FCLASS=0",
+};
+
+static const char * const FinalCodes[] = {
+  "OK",
+  "ERROR",
+  "CONNECT",
+  "NO CARRIER",
+  "BUSY",
+  "NO DIALTONE",
+  "NO ANSWER",
+  "FCERROR",
+};
+///////////////////////////////////////////////////////////////
+class ReplayModem;
+
+/*
+ * Wakes up the replaying thread if the engine put the output.
+ */
+class ReplayNotifier : public ModemThreadChild
+{
+    PCLASSINFO(ReplayNotifier, ModemThreadChild);
+  public:
+    ReplayNotifier(ModemThread &_parent) : ModemThreadChild(_parent) {}
+
+    PBoolean WaitDataReady(const PTimeInterval &timeout) { return dataReadySyncPoint.Wait(timeout); }
+
+  protected:
+    virtual void Main() {}	// never started, only signaled
+};
+
+class ReplayModem : public PseudoModemBody
+{
+    PCLASSINFO(ReplayModem, PseudoModemBody);
+  public:
+    ReplayModem()
+      : PseudoModemBody("replay", PString::Empty(), PCREATE_NOTIFIER(OnEndPoint))
+      , notifier(*this)
+      , tty("replay")
+    {
+      ptyname = "replay";
+      valid = TRUE;
+    }
+
+    PBoolean Start() { return StartAll(); }
+    void Stop() { StopAll(); }
+
+    /*
+     * Puts the command lines and gets the response up to the numFinals-th
+     * final result code.
+     */
+    PBoolean Command(const std::string &lines, int numFinals, std::string &resp);
+
+  protected:
+    virtual const PString &ttyPath() const { return tty; }
+    virtual ModemThreadChild *GetPtyNotifier() { return &notifier; }
+    virtual void MainLoop() {}
+
+    PDECLARE_NOTIFIER(PObject, ReplayModem, OnEndPoint);
+
+    ReplayNotifier notifier;
+    const PString tty;
+};
+
+PBoolean ReplayModem::Command(const std::string &lines, int numFinals, std::string &resp)
+{
+  ToInPtyQ(lines.data(), (PINDEX)lines.size());
+
+  resp.clear();
+
+  std::string last;
+
+  for (;;) {
+    PINDEX count = P_MAX_INDEX;
+    const BYTE *pBuf = FromOutPtyQ(count);
+
+    if (count == 0) {
+      if (!notifier.WaitDataReady(5000))
+        return FALSE;
+
+      continue;
+    }
+
+    for (PINDEX i = 0 ; i < count ; i++) {
+      char c = (char)pBuf[i];
+
+      resp += c;
+
+      if (c != '\n') {
+        if (c != '\r')
+          last += c;
+        continue;
+      }
+
+      for (PINDEX f = 0 ; f < PINDEX(PARRAYSIZE(FinalCodes)) ; f++) {
+        if (last == FinalCodes[f]) {
+          numFinals--;
+          break;
+        }
+      }
+
+      last.clear();
+
+      if (numFinals == 0) {
+        FromOutPtyQDone(count);
+        return i == count - 1;    // nothing must follow the final result code
+      }
+    }
+
+    FromOutPtyQDone(count);
+  }
+}
+
+void ReplayModem::OnEndPoint(PObject &from, INT)
+{
+  // no calls are made by the replayed commands
+  PStringToString &request = (PStringToString &)from;
+
+  request.SetAt("response", "reject");
+}
+///////////////////////////////////////////////////////////////
+class AtReplay : public PProcess
+{
+    PCLASSINFO(AtReplay, PProcess);
+  public:
+    AtReplay() : PProcess("t38modem", "at_replay") {}
+    void Main();
+
+  protected:
+    void Fail(const PString &msg) {
+      cout << "FAIL: " << msg << endl;
+      SetTerminationValue(1);
+    }
+};
+
+PCREATE_PROCESS(AtReplay);
+
+static PString Literal(const std::string &str)
+{
+  return PString(str.c_str()).ToLiteral();
+}
+
+void AtReplay::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick."
+             "v-verbose."
+             "n-rounds:");
+
+  std::vector<std::string> cmds;
+
+  if (args.GetCount() > 0) {
+    PTextFile file;
+
+    if (!file.Open(args[0], PFile::ReadOnly)) {
+      Fail("can't open " + args[0]);
+      return;
+    }
+
+    PString line;
+
+    while (file.ReadLine(line)) {
+      PINDEX i = line.Find('#');
+
+      if (i != P_MAX_INDEX)
+        line.Delete(i, P_MAX_INDEX);
+
+      line = line.Trim();
+
+      if (!line.IsEmpty())
+        cmds.push_back((const char *)line);
+    }
+  } else {
+    for (PINDEX i = 0 ; i < PINDEX(PARRAYSIZE(HylaFaxClass1)) ; i++)
+      cmds.push_back(HylaFaxClass1[i]);
+  }
+
+  int rounds = args.HasOption('q') ? 100 : 2000;
+
+  if (args.HasOption('n'))
+    rounds = (int)args.GetOptionString('n').AsInteger();
+
+  ReplayModem *modem = new ReplayModem();
+
+  if (!modem->Start()) {
+    Fail("can't start the modem engine");
+    delete modem;
+    return;
+  }
+
+  std::vector<std::string> first(cmds.size());
+  std::string allCmds;
+  std::string allFirst;
+  std::string resp;
+  PTimeInterval elapsed;
+
+  for (int r = -1 ; r < rounds ; r++) {
+    PTimeInterval start = PTimer::Tick();
+
+    for (size_t i = 0 ; i < cmds.size() ; i++) {
+      if (!modem->Command(cmds[i] + "\r", 1, resp)) {
+        Fail("no final result code for " + PString(cmds[i].c_str()) + ": " + Literal(resp));
+        modem->Stop();
+        delete modem;
+        return;
+      }
+
+      if (r < 0)
+        continue;
+
+      if (r == 0) {
+        first[i] = resp;
+        allCmds += cmds[i] + "\r";
+        allFirst += resp;
+
+        if (args.HasOption('v'))
+          cout << cmds[i] << " -> " << Literal(resp) << endl;
+      } else
+      if (resp != first[i]) {
+        Fail(psprintf("round %d ", r) + PString(cmds[i].c_str()) + ": " + Literal(resp) +
+             " instead of " + Literal(first[i]));
+        modem->Stop();
+        delete modem;
+        return;
+      }
+    }
+
+    if (r >= 0)
+      elapsed += PTimer::Tick() - start;
+  }
+
+  PTimeInterval elapsedAll;
+
+  for (int r = 0 ; r < rounds ; r++) {
+    PTimeInterval start = PTimer::Tick();
+
+    if (!modem->Command(allCmds, (int)cmds.size(), resp) || resp != allFirst) {
+      Fail(psprintf("round %d at once: ", r) + Literal(resp) + " instead of " + Literal(allFirst));
+      modem->Stop();
+      delete modem;
+      return;
+    }
+
+    elapsedAll += PTimer::Tick() - start;
+  }
+
+  modem->Stop();
+  delete modem;
+
+  PInt64 total = PInt64(cmds.size()) * rounds;
+
+  cout << "OK: " << rounds << " rounds of " << cmds.size() << " command lines with identical responses" << endl
+       << "  one by one " << psprintf("%.1f", total > 0 ? elapsed.GetMilliSeconds() * 1000.0 / total : 0.0) << " us,"
+       << " at once " << psprintf("%.1f", total > 0 ? elapsedAll.GetMilliSeconds() * 1000.0 / total : 0.0) << " us"
+       << " per command line" << endl;
+}
+///////////////////////////////////////////////////////////////
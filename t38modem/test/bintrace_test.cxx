@@ -0,0 +1,163 @@
+/*
+ * bintrace_test.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: bintrace_test.cxx,v $
+ *
+ */
+
+/*
+ * Test of the binary trace:
+ *   - the events put by several threads right before BinTrace::Stop()
+ *     are in the file, so Stop() drains the rings and closes the file;
+ *   - every put event is decoded or counted by a dropped record;
+ *   - the time of Decode() is reported.
+ *
+ * Usage: bintrace_test [-q] [events per thread]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "bintrace.h"
+
+#include <sstream>
+
+static const int NUM_THREADS = 4;
+
+///////////////////////////////////////////////////////////////
+class Producer : public PThread
+{
+    PCLASSINFO(Producer, PThread);
+  public:
+    Producer(int _index, int _count)
+      : PThread(30000, NoAutoDeleteThread, NormalPriority, psprintf("Producer%d", _index))
+      , index(_index)
+      , count(_count)
+    {
+      Resume();
+    }
+
+  protected:
+    virtual void Main() {
+      for (int i = 0 ; i < count ; i++) {
+        BinTrace::Output(5, btHandlePacket, BinTraceArgs(index, i, 0));
+
+        // let the writer keep up with the ring
+        if ((i & 0xFF) == 0xFF)
+          PThread::Sleep(1);
+      }
+    }
+
+    int index;
+    int count;
+};
+///////////////////////////////////////////////////////////////
+class BinTraceTest : public PProcess
+{
+    PCLASSINFO(BinTraceTest, PProcess);
+  public:
+    BinTraceTest() : PProcess("t38modem", "bintrace_test") {}
+    void Main();
+
+  protected:
+    void Fail(const char *msg, int arg = 0) {
+      cout << "FAIL: " << msg << " " << arg << endl;
+      SetTerminationValue(1);
+    }
+};
+
+PCREATE_PROCESS(BinTraceTest);
+
+void BinTraceTest::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick.");
+
+  int count = args.HasOption('q') ? 5000 : 50000;
+
+  if (args.GetCount() > 0)
+    count = args[0].AsInteger();
+
+  const PString path = "bintrace_test.btr";
+
+  if (!BinTrace::Start(path)) {
+    Fail("could not start the binary trace");
+    return;
+  }
+
+  Producer *producers[NUM_THREADS];
+
+  for (int i = 0 ; i < NUM_THREADS ; i++)
+    producers[i] = new Producer(i, count);
+
+  for (int i = 0 ; i < NUM_THREADS ; i++) {
+    producers[i]->WaitForTermination();
+    delete producers[i];
+  }
+
+  // far less than the flush period after the last events
+  BinTrace::Stop();
+
+  if (BinTrace::IsStarted())
+    Fail("started after Stop()");
+
+  std::ostringstream decoded;
+  PTimeInterval start = PTimer::Tick();
+
+  if (!BinTrace::Decode(path, decoded)) {
+    Fail("could not decode the binary trace");
+    return;
+  }
+
+  PTimeInterval decodeTime = PTimer::Tick() - start;
+
+  PFile::Remove(path);
+
+  std::istringstream lines(decoded.str());
+  std::string line;
+  int events = 0;
+  int dropped = 0;
+
+  while (std::getline(lines, line)) {
+    size_t pos;
+
+    if (line.find("Received ifp") != std::string::npos)
+      events++;
+    else
+    if ((pos = line.find("dropped ")) != std::string::npos)
+      dropped += atoi(line.c_str() + pos + 8);
+  }
+
+  if (events + dropped != NUM_THREADS*count) {
+    Fail("decoded+dropped events differ from put ones, missing", NUM_THREADS*count - events - dropped);
+    return;
+  }
+
+  cout << "OK: " << NUM_THREADS*count << " events of " << NUM_THREADS << " threads, "
+       << events << " decoded, " << dropped << " dropped\n"
+       << "  decode " << decodeTime.GetMilliSeconds() << " ms" << endl;
+}
+///////////////////////////////////////////////////////////////
+
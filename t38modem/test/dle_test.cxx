@@ -0,0 +1,203 @@
+/*
+ * dle_test.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: dle_test.cxx,v $
+ *
+ */
+
+/*
+ * Fuzz test of the bit reversing copy of DLEData:
+ *   - the lookup table reverses the bits of each byte;
+ *   - every implementation supported by the CPU gives byte identical
+ *     output with the table lookup for random data, lengths and
+ *     alignments and does not write outside of the destination;
+ *   - DLEData with bit reversing gives the same data back.
+ * The time of each implementation is reported.
+ *
+ * Usage: dle_test [-q] [iterations]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "dle.h"
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////
+class DleTest : public PProcess
+{
+    PCLASSINFO(DleTest, PProcess);
+  public:
+    DleTest() : PProcess("t38modem", "dle_test") {}
+    void Main();
+
+  protected:
+    void Fail(const char *msg, const char *name, PINDEX arg) {
+      cout << "FAIL: " << name << ": " << msg << " " << arg << endl;
+      SetTerminationValue(1);
+    }
+};
+
+PCREATE_PROCESS(DleTest);
+
+enum {
+  MAX_COUNT = 300,
+  GUARD = 16,
+  BLOCK_SIZE = 65536,
+};
+
+static DWORD seed = 12345;
+
+static DWORD Random()
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 8;
+}
+
+void DleTest::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick.");
+
+  int iterations = args.HasOption('q') ? 10000 : 1000000;
+
+  if (args.GetCount() > 0)
+    iterations = args[0].AsInteger();
+
+  BitRevCopyFunc table;
+
+  GetBitRevCopy(0, table);
+
+  // the table itself for all bytes
+  {
+    BYTE src[256], dst[256];
+
+    for (unsigned i = 0 ; i < 256 ; i++)
+      src[i] = BYTE(i);
+
+    table(dst, src, 256);
+
+    for (unsigned i = 0 ; i < 256 ; i++) {
+      unsigned rev = 0;
+
+      for (int j = 0 ; j < 8 ; j++)
+        rev |= ((i >> j) & 1) << (7 - j);
+
+      if (dst[i] != rev) {
+        Fail("wrong reversing of byte", "table", i);
+        return;
+      }
+    }
+  }
+
+  const char *name;
+  BitRevCopyFunc func;
+
+  for (PINDEX i = 1 ; (name = GetBitRevCopy(i, func)) != NULL ; i++) {
+    if (func == NULL) {
+      cout << "SKIP: " << name << " is not supported by CPU" << endl;
+      continue;
+    }
+
+    BYTE src[MAX_COUNT + GUARD], ref[MAX_COUNT + 2*GUARD], dst[MAX_COUNT + 2*GUARD];
+
+    for (int n = 0 ; n < iterations ; n++) {
+      PINDEX count = Random() % (MAX_COUNT + 1);
+      PINDEX srcOffset = Random() % GUARD;
+      PINDEX dstOffset = Random() % GUARD;
+
+      for (PINDEX k = 0 ; k < (PINDEX)sizeof(src) ; k++)
+        src[k] = BYTE(Random());
+
+      memset(ref, 0xA5, sizeof(ref));
+      memset(dst, 0xA5, sizeof(dst));
+
+      table(ref + GUARD + dstOffset, src + srcOffset, count);
+      func(dst + GUARD + dstOffset, src + srcOffset, count);
+
+      if (memcmp(ref, dst, sizeof(ref)) != 0) {
+        Fail("differs from table for count", name, count);
+        return;
+      }
+    }
+  }
+
+  // DLE stuffing with bit reversing
+  for (int n = 0 ; n < 100 ; n++) {
+    std::vector<BYTE> data(Random() % 1000 + 1);
+
+    for (size_t k = 0 ; k < data.size() ; k++)
+      data[k] = BYTE(Random() % 4 ? Random() : 0x08);  // 0x08 is reversed DLE
+
+    DLEData in, out;
+
+    in.BitRev(TRUE);
+    in.PutData(&data[0], data.size());
+    in.PutEof();
+
+    out.BitRev(TRUE);
+
+    BYTE Buf[64];
+    int len;
+
+    while ((len = in.GetDleData(Buf, Random() % sizeof(Buf) + 1)) >= 0)
+      out.PutDleData(Buf, len);
+
+    std::vector<BYTE> back(data.size() + 1);
+
+    len = out.GetData(&back[0], back.size());
+
+    if (len != (int)data.size() || memcmp(&back[0], &data[0], len) != 0) {
+      Fail("DLE round trip failed for size", GetBitRevCopyName(), data.size());
+      return;
+    }
+  }
+
+  cout << "OK: all implementations give identical output, selected " << GetBitRevCopyName() << endl;
+
+  // measure
+  std::vector<BYTE> src(BLOCK_SIZE), dst(BLOCK_SIZE);
+
+  for (size_t k = 0 ; k < src.size() ; k++)
+    src[k] = BYTE(Random());
+
+  int blocks = iterations / 1000;
+
+  cout << blocks << " blocks of " << BLOCK_SIZE << " bytes:" << endl;
+
+  for (PINDEX i = 0 ; (name = GetBitRevCopy(i, func)) != NULL ; i++) {
+    if (func == NULL)
+      continue;
+
+    PTimeInterval start = PTimer::Tick();
+
+    for (int b = 0 ; b < blocks ; b++)
+      func(&dst[0], &src[0], BLOCK_SIZE);
+
+    cout << "  " << setw(6) << name << " " << PTimer::Tick() - start << " s" << endl;
+  }
+}
+///////////////////////////////////////////////////////////////
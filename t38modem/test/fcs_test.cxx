@@ -0,0 +1,202 @@
+/*
+ * fcs_test.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: fcs_test.cxx,v $
+ *
+ */
+
+/*
+ * Tests class FCS against the bitwise CRC-16/CCITT and reports the time
+ * of both:
+ *   - "123456789" gives the standard check value;
+ *   - build() gives the same as the bitwise CRC for any length and
+ *     alignment;
+ *   - check() accepts frames ended by their valid FCS and rejects
+ *     corrupted ones.
+ *
+ * Usage: fcs_test [-q] [blocks]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "fcs.h"
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////
+static WORD BitwiseFcs(const BYTE *pBuf, PINDEX count)
+{
+  WORD crc = 0xFFFF;
+
+  while (count--) {
+    crc ^= WORD(*(pBuf++) << 8);
+
+    for (int j = 0 ; j < 8 ; j++)
+      crc = WORD((crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1));
+  }
+
+  return WORD(~crc);
+}
+///////////////////////////////////////////////////////////////
+class FcsTest : public PProcess
+{
+    PCLASSINFO(FcsTest, PProcess);
+  public:
+    FcsTest() : PProcess("t38modem", "fcs_test") {}
+    void Main();
+
+  protected:
+    PBoolean Fail(const char *msg, PINDEX arg = 0) {
+      cout << "FAIL: " << msg << " " << arg << endl;
+      SetTerminationValue(1);
+      return FALSE;
+    }
+};
+
+PCREATE_PROCESS(FcsTest);
+
+enum {
+  BLOCK_SIZE = 65536,
+};
+
+void FcsTest::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick.");
+
+  int blocks = args.HasOption('q') ? 16 : 1000;
+
+  if (args.GetCount() > 0)
+    blocks = args[0].AsInteger();
+
+  // the check value of CRC-16/CCITT-FALSE is 0x29B1, FCS is its complement
+  {
+    FCS fcs;
+
+    fcs.build("123456789", 9);
+
+    if (WORD(fcs) != WORD(~0x29B1)) {
+      Fail("check value of \"123456789\" is", WORD(~WORD(fcs)));
+      return;
+    }
+  }
+
+  std::vector<BYTE> block(BLOCK_SIZE + 16);
+  DWORD seed = 12345;
+
+  for (size_t i = 0 ; i < block.size() ; i++) {
+    seed = seed * 1103515245 + 12345;
+    block[i] = BYTE(seed >> 16);
+  }
+
+  // slicing by 8 must give the same as bitwise for any length and alignment
+  for (PINDEX offset = 0 ; offset < 8 ; offset++) {
+    for (PINDEX count = 0 ; count <= 300 ; count++) {
+      FCS fcs;
+
+      fcs.build(&block[offset], count);
+
+      if (WORD(fcs) != BitwiseFcs(&block[offset], count)) {
+        Fail("build() differs from bitwise for count", count);
+        return;
+      }
+
+      // the same in two parts
+      FCS fcs2;
+
+      fcs2.build(&block[offset], count/3);
+      fcs2.build(&block[offset + count/3], count - count/3);
+
+      if (WORD(fcs2) != WORD(fcs)) {
+        Fail("build() in two parts differs for count", count);
+        return;
+      }
+    }
+  }
+
+  // frames with valid and corrupted FCS
+  for (PINDEX count = 0 ; count <= 256 ; count++) {
+    std::vector<BYTE> frame(block.begin(), block.begin() + count);
+    FCS fcs;
+
+    fcs.build(&frame[0], count);
+
+    BYTE Buf[2];
+
+    Buf[0] = BYTE(fcs >> 8);
+    Buf[1] = BYTE(fcs & 0xFF);
+
+    if (!fcs.check(Buf, 2)) {
+      Fail("check() rejected valid FCS of the built frame of size", count);
+      return;
+    }
+
+    frame.push_back(Buf[0]);
+    frame.push_back(Buf[1]);
+
+    if (!FCS().check(&frame[0], frame.size())) {
+      Fail("check() rejected valid frame of size", count);
+      return;
+    }
+
+    for (PINDEX bit = 0 ; bit < (PINDEX)frame.size() * 8 ; bit += 7) {
+      frame[bit/8] ^= BYTE(1 << (bit % 8));
+
+      if (FCS().check(&frame[0], frame.size())) {
+        Fail("check() accepted corrupted frame of size", count);
+        return;
+      }
+
+      frame[bit/8] ^= BYTE(1 << (bit % 8));
+    }
+  }
+
+  cout << "OK: FCS check value, bitwise equivalence and check()" << endl;
+
+  // measure
+  WORD res = 0;
+  PTimeInterval start = PTimer::Tick();
+
+  for (int b = 0 ; b < blocks ; b++) {
+    FCS fcs;
+
+    fcs.build(&block[0], BLOCK_SIZE);
+    res = WORD(res + WORD(fcs));
+  }
+
+  PTimeInterval table = PTimer::Tick() - start;
+
+  start = PTimer::Tick();
+
+  for (int b = 0 ; b < blocks ; b++)
+    res = WORD(res - BitwiseFcs(&block[0], BLOCK_SIZE));
+
+  PTimeInterval bitwise = PTimer::Tick() - start;
+
+  cout << blocks << " blocks of " << BLOCK_SIZE << " bytes" << (res ? " MISMATCH" : "") << ":" << endl
+       << "  build   table " << table << " s, bitwise " << bitwise << " s" << endl;
+}
+///////////////////////////////////////////////////////////////
@@ -0,0 +1,387 @@
+/*
+ * hdlc_bench.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: hdlc_bench.cxx,v $
+ *
+ */
+
+/*
+ * Compares the table driven bit stuffing of class HDLC with the original
+ * bitwise one on 64 KiB ECM blocks (256 frames of 256 bytes):
+ *   - the raw output of both for the same frames must be identical;
+ *   - unpacking of the raw output must return the frames with good FCS;
+ *   - the time of both is reported.
+ *
+ * Usage: hdlc_bench [-q] [blocks]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "hdlc.h"
+#include "enginebase.h"
+
+#include <vector>
+
+///////////////////////////////////////////////////////////////
+/*
+ * The bitwise implementation, as it was in hdlc.cxx before the
+ * stuffing tables.
+ */
+class BitwiseHdlc
+{
+  public:
+    BitwiseHdlc() : rawByte(0), rawByteLen(0), rawOnes(0), hdlcChunk(0), hdlcChunkLen(0) {}
+
+    void Pack(const BYTE *pBuf, PINDEX count, PBoolean flag, std::vector<BYTE> &out)
+    {
+      WORD w = WORD((WORD)rawByte << 8);
+
+      for (PINDEX i = 0 ; i < count ; i++) {
+        w |= *(pBuf++) & 0xFF;
+        for (PINDEX j = 0 ; j < 8 ; j++) {
+          w <<= 1;
+
+          if (++rawByteLen == 8) {
+            rawByte = BYTE(w >> 8);
+            out.push_back(rawByte);
+            rawByteLen = 0;
+          }
+
+          if (!flag) {
+            if (w & 0x100) {
+              if (++rawOnes == 5) {
+                w = WORD((w & 0xFF00) << 1 | (w & 0xFF));
+
+                if (++rawByteLen == 8) {
+                  rawByte = BYTE(w >> 8);
+                  out.push_back(rawByte);
+                  rawByteLen = 0;
+                }
+                rawOnes = 0;
+              }
+            }
+            else
+              rawOnes = 0;
+          }
+        }
+      }
+      rawByte = BYTE(w >> 8);
+      if (flag)
+        rawOnes = 0;
+    }
+
+    PBoolean Sync(BYTE b)
+    {
+      WORD w = WORD(((WORD)rawByte << 8) | (b & 0xFF));
+      PINDEX j = 8 - rawByteLen;
+
+      w <<= j;
+
+      for ( ; j <= 8 ; j++, w <<= 1) {
+        if ((w >> 8) == 0x7E) {
+          rawByte = BYTE(w >> j);
+          rawByteLen = 8 - j;
+          return TRUE;
+        }
+      }
+      rawByte = BYTE(w >> j);
+      rawByteLen = 7;
+      return FALSE;
+    }
+
+    PBoolean SkipFlag(BYTE b)
+    {
+      WORD w = WORD(((WORD)rawByte << 8) | (b & 0xFF));
+      PINDEX j = 8 - rawByteLen;
+
+      w <<= j;
+      if ((w >> 8) == 0x7E) {
+        rawByte = BYTE(w >> j);
+        return TRUE;
+      }
+
+      return FALSE;
+    }
+
+    PBoolean Unpack(BYTE b, std::vector<BYTE> &out)
+    {
+      WORD w = WORD(((WORD)rawByte << 8) | (b & 0xFF));
+      PINDEX j = 8 - rawByteLen;
+
+      w <<= j;
+
+      for ( ; j <= 8 ; j++, w <<= 1) {
+        if ((w >> 8) == 0x7E) {
+          rawByte = BYTE(w >> j);
+          rawByteLen = 8 - j;
+          return FALSE;
+        }
+
+        if (w & 0x8000) {
+          hdlcChunk <<= 1;
+          hdlcChunk |= 1;
+          hdlcChunkLen++;
+          rawOnes++;
+        } else {
+          if (rawOnes != 5) {
+            hdlcChunk <<= 1;
+            hdlcChunkLen++;
+          }
+          rawOnes = 0;
+        }
+
+        if (hdlcChunkLen == 24) {
+          out.push_back(BYTE(hdlcChunk >> 16));
+          hdlcChunkLen = 16;
+        }
+      }
+      rawByte = BYTE(w >> j);
+      rawByteLen = 7;
+      return TRUE;
+    }
+
+    // the same sequence as HDLC::GetRawData() does
+    void FrameToRaw(const BYTE *pFrame, PINDEX count, PINDEX flags, std::vector<BYTE> &out)
+    {
+      FCS fcs;
+
+      while (flags--)
+        Pack((const BYTE *)"\x7e", 1, TRUE, out);
+
+      fcs.build(pFrame, count);
+      Pack(pFrame, count, FALSE, out);
+
+      BYTE Buf[2];
+
+      Buf[0] = BYTE(fcs >> 8);
+      Buf[1] = BYTE(fcs & 0xFF);
+      Pack(Buf, 2, FALSE, out);
+      Pack((const BYTE *)"\x7e\x7e", 2, TRUE, out);
+    }
+
+    // the same sequence as HDLC::GetHdlcData() does with sync
+    PBoolean RawToFrame(const BYTE *pRaw, PINDEX count, std::vector<BYTE> &out)
+    {
+      enum { stSync, stSkipFlags, stData, stEof } state = stSync;
+
+      hdlcChunkLen = 0;
+      rawOnes = 0;
+
+      for (PINDEX i = 0 ; i < count && state != stEof ; i++) {
+        BYTE b = pRaw[i];
+
+        switch (state) {
+          case stSync:
+            if (Sync(b))
+              state = stSkipFlags;
+            break;
+          case stSkipFlags:
+            if (SkipFlag(b))
+              break;
+            state = stData;
+          case stData:
+            if (!Unpack(b, out))
+              state = stEof;
+            break;
+          default:
+            break;
+        }
+      }
+
+      if (hdlcChunkLen != 16 || out.empty())
+        return FALSE;
+
+      FCS fcs;
+
+      fcs.build(&out[0], out.size());
+
+      return WORD(hdlcChunk) == WORD(fcs);
+    }
+
+  private:
+    BYTE rawByte;
+    int rawByteLen;
+    int rawOnes;
+    DWORD hdlcChunk;
+    int hdlcChunkLen;
+};
+///////////////////////////////////////////////////////////////
+static void TableFrameToRaw(const BYTE *pFrame, PINDEX count, PINDEX flags, std::vector<BYTE> &out)
+{
+  DataStream in;
+  HDLC hdlc;
+  BYTE Buf[1024];
+  int len;
+
+  in.PutData(pFrame, count);
+  in.PutEof();
+
+  hdlc.PutHdlcData(&in);
+  hdlc.GetRawStart(flags);
+
+  while ((len = hdlc.GetData(Buf, sizeof(Buf))) >= 0)
+    out.insert(out.end(), Buf, Buf + len);
+}
+
+static PBoolean TableRawToFrame(const BYTE *pRaw, PINDEX count, std::vector<BYTE> &out)
+{
+  DataStream in;
+  HDLC hdlc;
+  BYTE Buf[1024];
+  int len;
+
+  in.PutData(pRaw, count);
+  in.PutEof();
+
+  hdlc.PutRawData(&in);
+  hdlc.GetHdlcStart(TRUE);
+
+  while ((len = hdlc.GetData(Buf, sizeof(Buf))) >= 0)
+    out.insert(out.end(), Buf, Buf + len);
+
+  return hdlc.isFcsOK();
+}
+///////////////////////////////////////////////////////////////
+class HdlcBench : public PProcess
+{
+    PCLASSINFO(HdlcBench, PProcess);
+  public:
+    HdlcBench() : PProcess("t38modem", "hdlc_bench") {}
+    void Main();
+};
+
+PCREATE_PROCESS(HdlcBench);
+
+enum {
+  FRAME_SIZE = 256,
+  FRAMES_PER_BLOCK = 256,
+  FLAGS = 3,
+};
+
+void HdlcBench::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick.");
+
+  int blocks = args.HasOption('q') ? 4 : 200;
+
+  if (args.GetCount() > 0)
+    blocks = args[0].AsInteger();
+
+  // an ECM block with random bytes and some runs of 1 bits
+  std::vector<BYTE> block(FRAME_SIZE * FRAMES_PER_BLOCK);
+  DWORD seed = 12345;
+
+  for (size_t i = 0 ; i < block.size() ; i++) {
+    seed = seed * 1103515245 + 12345;
+    block[i] = (seed >> 24) % 5 == 0 ? BYTE(0xFF) : BYTE(seed >> 16);
+  }
+
+  // check that both implementations do the same
+  for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+    const BYTE *pFrame = &block[f * FRAME_SIZE];
+    std::vector<BYTE> rawTable, rawBitwise, frameTable, frameBitwise;
+
+    TableFrameToRaw(pFrame, FRAME_SIZE, FLAGS, rawTable);
+    BitwiseHdlc().FrameToRaw(pFrame, FRAME_SIZE, FLAGS, rawBitwise);
+
+    if (rawTable != rawBitwise) {
+      cout << "FAIL: raw output differs for frame " << f << endl;
+      SetTerminationValue(1);
+      return;
+    }
+
+    PBoolean fcsTable = TableRawToFrame(&rawTable[0], rawTable.size(), frameTable);
+    PBoolean fcsBitwise = BitwiseHdlc().RawToFrame(&rawBitwise[0], rawBitwise.size(), frameBitwise);
+
+    if (!fcsTable || !fcsBitwise ||
+        frameTable != frameBitwise ||
+        frameTable != std::vector<BYTE>(pFrame, pFrame + FRAME_SIZE))
+    {
+      cout << "FAIL: unpacked frame " << f << " differs or has bad FCS" << endl;
+      SetTerminationValue(1);
+      return;
+    }
+  }
+
+  cout << "OK: table and bitwise stuffing give identical output" << endl;
+
+  // measure
+  PINDEX rawSize = 0;
+  PTimeInterval packTable, packBitwise, unpackTable, unpackBitwise;
+  std::vector< std::vector<BYTE> > raws(FRAMES_PER_BLOCK);
+
+  for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+    TableFrameToRaw(&block[f * FRAME_SIZE], FRAME_SIZE, FLAGS, raws[f]);
+    rawSize += raws[f].size();
+  }
+
+  std::vector<BYTE> out;
+
+  out.reserve(FRAME_SIZE * 2);
+
+  PTimeInterval start = PTimer::Tick();
+
+  for (int b = 0 ; b < blocks ; b++) {
+    for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+      out.clear();
+      TableFrameToRaw(&block[f * FRAME_SIZE], FRAME_SIZE, FLAGS, out);
+    }
+  }
+  packTable = PTimer::Tick() - start;
+
+  start = PTimer::Tick();
+  for (int b = 0 ; b < blocks ; b++) {
+    for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+      out.clear();
+      BitwiseHdlc().FrameToRaw(&block[f * FRAME_SIZE], FRAME_SIZE, FLAGS, out);
+    }
+  }
+  packBitwise = PTimer::Tick() - start;
+
+  start = PTimer::Tick();
+  for (int b = 0 ; b < blocks ; b++) {
+    for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+      out.clear();
+      TableRawToFrame(&raws[f][0], raws[f].size(), out);
+    }
+  }
+  unpackTable = PTimer::Tick() - start;
+
+  start = PTimer::Tick();
+  for (int b = 0 ; b < blocks ; b++) {
+    for (int f = 0 ; f < FRAMES_PER_BLOCK ; f++) {
+      out.clear();
+      BitwiseHdlc().RawToFrame(&raws[f][0], raws[f].size(), out);
+    }
+  }
+  unpackBitwise = PTimer::Tick() - start;
+
+  cout << blocks << " blocks of " << block.size() << " bytes (" << rawSize << " raw bytes):" << endl
+       << "  pack    table " << packTable << " s, bitwise " << packBitwise << " s" << endl
+       << "  unpack  table " << unpackTable << " s, bitwise " << unpackBitwise << " s" << endl;
+}
+///////////////////////////////////////////////////////////////
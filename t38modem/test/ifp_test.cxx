@@ -0,0 +1,289 @@
+/*
+ * ifp_test.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: ifp_test.cxx,v $
+ *
+ */
+
+/*
+ * Round-trip differential test of IFPCodec against the generic PASN code
+ * (built as ifp_test for the pre-corrigendum variant and as ifp_test_corr
+ * with OPTIMIZE_CORRIGENDUM_IFP):
+ *   - random IFP packets (with extended enumerations, absent field data,
+ *     up to 6 fields and long field data) are encoded by PASN, if IFPCodec
+ *     encodes them then the output must be byte identical;
+ *   - if IFPCodec decodes the PASN output (or a corrupted or truncated
+ *     copy of it) then PASN must decode it too, the packet put to a new
+ *     T38_IFP must be equal to the PASN one and the packet put to a reused
+ *     T38_IFP must encode identically;
+ *   - the time of fast and PASN encode plus decode is reported.
+ *
+ * Usage: ifp_test [-q] [iterations]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <opal/buildopts.h>
+#include <asn/t38.h>
+#include "ifpcodec.h"
+
+///////////////////////////////////////////////////////////////
+#ifdef OPTIMIZE_CORRIGENDUM_IFP
+  #define VARIANT "corrigendum"
+  #define MAX_FIELD_TYPE 10     // extensions
+#else
+  #define VARIANT "pre-corrigendum"
+  #define MAX_FIELD_TYPE 7
+#endif
+
+static DWORD seed = 1234;
+
+static unsigned Random(unsigned n)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % n;
+}
+
+static void RandomIFP(T38_IFP &ifp)
+{
+  unsigned tag = Random(2);
+
+  ifp.m_type_of_msg.SetTag(tag);
+
+  // a few percent of the values are extensions
+  unsigned maxType = (tag == T38_Type_of_msg::e_t30_indicator) ? 15 : 8;
+  unsigned type = Random(100) < 3 ? maxType + 1 + Random(6) : Random(maxType + 1);
+
+  ((PASN_Enumeration &)ifp.m_type_of_msg.GetObject()).SetValue(type);
+
+  if (Random(4) == 0) {
+    ifp.RemoveOptionalField(T38_IFP::e_data_field);
+    return;
+  }
+
+  ifp.IncludeOptionalField(T38_IFP::e_data_field);
+
+  PINDEX count = Random(100) < 5 ? 5 + Random(2) : Random(5);
+
+  ifp.m_data_field.SetSize(count);
+
+  for (PINDEX i = 0 ; i < count ; i++) {
+    T38_DATA_FIELD &field = ifp.m_data_field[i];
+
+    field.m_field_type = Random(100) < 3 ? Random(MAX_FIELD_TYPE + 1) : Random(8);
+
+    if (Random(5) == 0) {
+      field.RemoveOptionalField(T38_DATA_FIELD::e_field_data);
+      continue;
+    }
+
+    field.IncludeOptionalField(T38_DATA_FIELD::e_field_data);
+
+    // PASN drops the bytes after 16K (MaximumStringSize), so the long ones
+    // are not too long
+    PINDEX len = Random(100) < 2 ? 256 + Random(4000) : 1 + Random(64);
+    PBYTEArray data(len);
+
+    for (PINDEX j = 0 ; j < len ; j++)
+      data[j] = BYTE(Random(256));
+
+    field.m_field_data = data;
+  }
+}
+
+static PBYTEArray PasnEncode(const T38_IFP &ifp)
+{
+  PPER_Stream strm;
+
+  ifp.Encode(strm);
+  strm.CompleteEncoding();
+
+  return strm;
+}
+///////////////////////////////////////////////////////////////
+class IfpTest : public PProcess
+{
+    PCLASSINFO(IfpTest, PProcess);
+  public:
+    IfpTest() : PProcess("t38modem", "ifp_test") {}
+    void Main();
+
+  protected:
+    void Fail(const char *msg, unsigned iteration) {
+      cout << "FAIL: " VARIANT ": " << msg << " at iteration " << iteration << endl;
+      SetTerminationValue(1);
+    }
+
+    PBoolean CheckDecode(const BYTE *pBuf, PINDEX size, T38_IFP &fastIfp, unsigned iteration);
+};
+
+PCREATE_PROCESS(IfpTest);
+
+PBoolean IfpTest::CheckDecode(const BYTE *pBuf, PINDEX size, T38_IFP &fastIfp, unsigned iteration)
+{
+  IFPFlat flat;
+
+  if (!IFPCodec::Decode(flat, pBuf, size))
+    return FALSE;
+
+  T38_IFP pasnIfp;
+  PPER_Stream strm(pBuf, size);
+
+  if (!pasnIfp.Decode(strm)) {
+    Fail("fast decoded but PASN not", iteration);
+    return TRUE;
+  }
+
+  T38_IFP freshIfp;
+
+  IFPCodec::Put(freshIfp, flat);
+
+  if (freshIfp.Compare(pasnIfp) != PObject::EqualTo)
+    Fail("fast decode differs from PASN", iteration);
+
+  // the absent fields of a reused T38_IFP keep the old values (as with the
+  // PASN decoder), so it's compared by the encoded form
+
+  IFPCodec::Put(fastIfp, flat);
+
+  if (PasnEncode(fastIfp) != PasnEncode(pasnIfp))
+    Fail("fast decode to reused T38_IFP differs from PASN", iteration);
+
+  return TRUE;
+}
+
+void IfpTest::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick.");
+
+  unsigned iterations = args.HasOption('q') ? 20000 : 200000;
+
+  if (args.GetCount() > 0)
+    iterations = args[0].AsUnsigned();
+
+  unsigned fastEncoded = 0, fastDecoded = 0, fuzzDecoded = 0;
+  T38_IFP fastIfp;    // reused like the pooled one in T38ModemMediaStream
+
+  for (unsigned n = 0 ; n < iterations ; n++) {
+    T38_IFP ifp;
+
+    RandomIFP(ifp);
+
+    PBYTEArray pasn = PasnEncode(ifp);
+    IFPFlat flat;
+
+    if (IFPCodec::Get(flat, ifp)) {
+      PBYTEArray fast(pasn.GetSize() + 16);
+      PINDEX size = IFPCodec::Encode(flat, fast.GetPointer(), fast.GetSize());
+
+      if (size > 0) {
+        fastEncoded++;
+
+        if (size != pasn.GetSize() || memcmp(fast, pasn, size) != 0)
+          Fail("fast encode differs from PASN", n);
+
+        // a too small buffer is declined
+        if (IFPCodec::Encode(flat, fast.GetPointer(), size - 1) != 0)
+          Fail("fast encode overflow", n);
+      }
+    }
+
+    if (CheckDecode(pasn, pasn.GetSize(), fastIfp, n))
+      fastDecoded++;
+
+    // corrupted or truncated copy, in an exactly sized buffer
+
+    PINDEX size = pasn.GetSize();
+
+    if (Random(2))
+      size = Random(size + 1);
+
+    BYTE *pBuf = new BYTE[size > 0 ? size : 1];
+
+    memcpy(pBuf, pasn, size);
+
+    for (unsigned flips = Random(4) ; flips && size > 0 ; flips--)
+      pBuf[Random(size)] ^= BYTE(1 << Random(8));
+
+    if (CheckDecode(pBuf, size, fastIfp, n))
+      fuzzDecoded++;
+
+    delete [] pBuf;
+
+    if (GetTerminationValue() != 0)
+      return;
+  }
+
+  cout << "OK: " VARIANT ": " << iterations << " packets, "
+       << fastEncoded << " fast encoded, " << fastDecoded << " fast decoded, "
+       << fuzzDecoded << " corrupted fast decoded, all identical to PASN" << endl;
+
+  // timing of a typical HDLC data packet
+
+  T38_IFP ifp;
+
+  ifp.m_type_of_msg.SetTag(T38_Type_of_msg::e_data);
+  ((PASN_Enumeration &)ifp.m_type_of_msg.GetObject()).SetValue(T38_Type_of_msg_data::e_v21);
+  ifp.IncludeOptionalField(T38_IFP::e_data_field);
+  ifp.m_data_field.SetSize(1);
+  ifp.m_data_field[0].m_field_type = T38_Data_Field_subtype_field_type::e_hdlc_data;
+  ifp.m_data_field[0].IncludeOptionalField(T38_DATA_FIELD::e_field_data);
+  ifp.m_data_field[0].m_field_data = PBYTEArray(32);
+
+  const unsigned loops = args.HasOption('q') ? 20000 : 200000;
+  BYTE buf[64];
+
+  PTimeInterval start = PTimer::Tick();
+
+  for (unsigned i = 0 ; i < loops ; i++) {
+    IFPFlat flat;
+
+    IFPCodec::Get(flat, ifp);
+    PINDEX size = IFPCodec::Encode(flat, buf, sizeof(buf));
+    IFPCodec::Decode(flat, buf, size);
+    IFPCodec::Put(fastIfp, flat);
+  }
+
+  PTimeInterval fast = PTimer::Tick() - start;
+
+  start = PTimer::Tick();
+
+  for (unsigned i = 0 ; i < loops ; i++) {
+    PPER_Stream strm;
+
+    ifp.Encode(strm);
+    strm.CompleteEncoding();
+    strm.ResetDecoder();
+    fastIfp.Decode(strm);
+  }
+
+  PTimeInterval pasn = PTimer::Tick() - start;
+
+  cout << "  encode+decode: fast " << fast.GetMilliSeconds() * 1000.0 / loops
+       << " us, PASN " << pasn.GetMilliSeconds() * 1000.0 / loops << " us per packet" << endl;
+}
+///////////////////////////////////////////////////////////////
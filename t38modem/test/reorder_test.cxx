@@ -0,0 +1,168 @@
+/*
+ * reorder_test.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: reorder_test.cxx,v $
+ *
+ */
+
+/*
+ * Test of the reorder window for the received IFP packets:
+ *   - the sequences of received packets give the expected sequences of
+ *     delivered (i), lost (l) and ignored (x) ones;
+ *   - with FEC a gap is not waited for after the later packets could
+ *     not repair it;
+ *   - a packet held after a gap is released by the timer if nothing
+ *     is received after it.
+ *
+ * Usage: reorder_test
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include "ifpreorder.h"
+
+///////////////////////////////////////////////////////////////
+class Recorder : public IFPReorder
+{
+    PCLASSINFO(Recorder, IFPReorder);
+  public:
+    Recorder(PMutex &_mutex) : IFPReorder(_mutex) {}
+
+    PString events;
+
+  protected:
+    void Add(char c, long n) {
+      if (!events.IsEmpty())
+        events += " ";
+      events += c + PString(n);
+    }
+
+    virtual PBoolean OnIFP(long sequenceNumber, const BYTE *, PINDEX) { Add('i', sequenceNumber); return TRUE; }
+    virtual PBoolean OnLost(long lost) { Add('l', lost); return TRUE; }
+    virtual void OnIgnored(long sequenceNumber, long, PINDEX) { Add('x', sequenceNumber); }
+};
+///////////////////////////////////////////////////////////////
+class ReorderTest : public PProcess
+{
+    PCLASSINFO(ReorderTest, PProcess);
+  public:
+    ReorderTest() : PProcess("t38modem", "reorder_test") {}
+    void Main();
+
+  protected:
+    void Check(const char *name, unsigned holdTime, const char *received, const char *expected,
+               PBoolean flush = FALSE, unsigned repairSpan = 0);
+};
+
+PCREATE_PROCESS(ReorderTest);
+
+void ReorderTest::Check(const char *name, unsigned holdTime, const char *received, const char *expected,
+                        PBoolean flush, unsigned repairSpan)
+{
+  PMutex mutex;
+  Recorder reorder(mutex);
+  PStringArray seqs = PString(received).Tokenise(" ", FALSE);
+
+  {
+    PWaitAndSignal mutexWait(mutex);
+
+    reorder.Reset();
+    reorder.SetHoldTime(holdTime);
+    reorder.SetRepairSpan(repairSpan);
+
+    for (PINDEX i = 0 ; i < seqs.GetSize() ; i++) {
+      BYTE data = 0;
+      reorder.Put(WORD(seqs[i].AsUnsigned()), &data, seqs[i].Find('f') == P_MAX_INDEX ? 1 : 0);
+    }
+
+    if (flush)
+      reorder.Flush();
+  }
+
+  reorder.Stop();
+
+  if (reorder.events != expected) {
+    cout << "FAIL: " << name << ": got \"" << reorder.events << "\" expected \"" << expected << "\"" << endl;
+    SetTerminationValue(1);
+  }
+}
+
+void ReorderTest::Main()
+{
+  Check("in order",     5, "0 1 2",              "i0 i1 i2");
+  Check("reordered",    5, "0 2 1 3",            "i0 i1 i2 i3");
+  Check("repeated",     5, "0 1 1 0 2",          "i0 i1 x1 x0 i2");
+  Check("fake",         5, "0 0f 1f 1",          "i0 x0 x1 i1");
+  Check("held repeated", 10000, "0 2 2 1",       "i0 x2 i1 i2");
+  Check("no holding",   0, "0 2 1 3",            "i0 l1 i2 x1 i3");
+  Check("large gap", 10000, "0 2 100",           "i0 l1 i2 l97 i100");
+  Check("flush",    10000, "0 2 3 5",            "i0 l1 i2 i3 l1 i5", TRUE);
+  Check("FEC repaired", 10000, "0 2 3 1 4",       "i0 i1 i2 i3 i4", FALSE, 3);
+  Check("FEC span",   10000, "0 2 3 4 5 7 6",   "i0 l1 i2 i3 i4 i5 i6 i7", FALSE, 3);
+  Check("wrap",     10000, "0 30000 60000 65535 1 0 2",
+        "i0 l29999 i30000 l29999 i60000 l5534 i65535 i65536 i65537 i65538");
+
+  // a held packet followed by silence should be released by the timer
+
+  PMutex mutex;
+  Recorder reorder(mutex);
+  BYTE data = 0;
+
+  reorder.SetHoldTime(5);
+
+  {
+    PWaitAndSignal mutexWait(mutex);
+
+    reorder.Reset();
+    reorder.Put(0, &data, 1);
+    reorder.Put(2, &data, 1);
+  }
+
+  PTimeInterval start = PTimer::Tick();
+  PString events;
+  int numHeld;
+
+  do {
+    PThread::Sleep(1);
+
+    PWaitAndSignal mutexWait(mutex);
+
+    events = reorder.events;
+    numHeld = reorder.GetNumHeld();
+  } while (numHeld > 0 && PTimer::Tick() - start < 1000);
+
+  PTimeInterval released = PTimer::Tick() - start;
+
+  reorder.Stop();
+
+  if (events != "i0 l1 i2" || released >= 1000) {
+    cout << "FAIL: silence: got \"" << events << "\" after " << released.GetMilliSeconds() << " ms" << endl;
+    SetTerminationValue(1);
+  } else {
+    cout << "OK: held packet released by the timer after " << released.GetMilliSeconds() << " ms (hold time 5 ms)" << endl;
+  }
+}
+///////////////////////////////////////////////////////////////
+
@@ -0,0 +1,436 @@
+/*
+ * udptl_loss.cxx
+ *
+ * T38FAX Pseudo Modem
+ *
+ * Copyright (c) 2011 Vyacheslav Frolov
+ *
+ * t38modem Project
+ *
+ * The contents of this file are subject to the Mozilla Public License
+ * Version 1.0 (the "License"); you may not use this file except in
+ * compliance with the License. You may obtain a copy of the License at
+ * http://www.mozilla.org/MPL/
+ *
+ * Software distributed under the License is distributed on an "AS IS"
+ * basis, WITHOUT WARRANTY OF ANY KIND, either express or implied. See
+ * the License for the specific language governing rights and limitations
+ * under the License.
+ *
+ * The Original Code is t38modem.
+ *
+ * The Initial Developer of the Original Code is Vyacheslav Frolov
+ *
+ * Contributor(s):
+ *
+ * $Log: udptl_loss.cxx,v $
+ *
+ */
+
+/*
+ * Lossy loopback for the UDPTL error recovery of OPAL:
+ *   - two RTP_UDP "udptl" sessions are connected through a relay that
+ *     drops the datagrams at random (with a fixed seed);
+ *   - the IFP packets of 4..44 bytes are sent with the secondary IFP
+ *     packets or FEC error recovery, starting near the 16-bit sequence
+ *     number wrap;
+ *   - every delivered IFP must match the sent one (the FEC repaired ones
+ *     may be padded with zeros), the lost-on-wire but delivered packets
+ *     and the late ones (passed after a later packet) are counted;
+ *   - the delivered IFPs are passed to T38Engine through the reorder
+ *     window as T38ModemMediaStream does, and w/o holding, all delivered
+ *     IFPs must reach the engine through the window;
+ *   - the delivered part, the part that reaches the engine and the bytes
+ *     on the wire per IFP are reported.
+ *
+ * Usage: udptl_loss [-q] [-l loss%] [-n count]
+ */
+
+#include <ptlib.h>
+#include <ptlib/pprocess.h>
+#include <ptlib/sockets.h>
+#include <opal/buildopts.h>
+#include <rtp/rtp.h>
+#include "ifpreorder.h"
+
+#include <vector>
+
+// the same as in opal/modemstrm.cxx
+static const unsigned DEFAULT_REORDER_HOLD_TIME = 5;
+static const unsigned FEC_REORDER_HOLD_TIME = 500;
+
+///////////////////////////////////////////////////////////////
+static PINDEX IfpSize(unsigned index)
+{
+  return 4 + (index * 2654435761U >> 24) % 41;
+}
+
+static BYTE IfpByte(unsigned index, PINDEX i)
+{
+  return BYTE(index * 31 + i * 7 + 1);
+}
+///////////////////////////////////////////////////////////////
+/*
+ * Forwards the datagrams from one port to other one and drops some of them.
+ */
+class LossyRelay : public PThread
+{
+    PCLASSINFO(LossyRelay, PThread);
+  public:
+    LossyRelay(WORD _toPort, unsigned _lossPerMille)
+      : PThread(10000, NoAutoDeleteThread)
+      , toPort(_toPort)
+      , lossPerMille(_lossPerMille)
+      , seed(4321)
+      , stop(FALSE)
+      , datagrams(0)
+      , dropped(0)
+      , bytes(0)
+    {
+      socket.Listen(PIPSocket::Address("127.0.0.1"), 0, 0);
+      socket.SetReadTimeout(100);
+      Resume();
+    }
+
+    WORD GetPort() const { return socket.GetPort(); }
+
+    void Stop()
+    {
+      stop = TRUE;
+      WaitForTermination();
+    }
+
+    void Main()
+    {
+      BYTE buf[2048];
+
+      while (!stop) {
+        PIPSocket::Address addr;
+        WORD port;
+
+        if (!socket.ReadFrom(buf, sizeof(buf), addr, port))
+          continue;
+
+        PINDEX len = socket.GetLastReadCount();
+
+        datagrams++;
+        bytes += len;
+
+        seed = seed * 1103515245 + 12345;
+
+        if ((seed >> 16) % 1000 < lossPerMille) {
+          dropped++;
+          continue;
+        }
+
+        socket.WriteTo(buf, len, PIPSocket::Address("127.0.0.1"), toPort);
+      }
+    }
+
+    PUDPSocket socket;
+    WORD toPort;
+    unsigned lossPerMille;
+    DWORD seed;
+    volatile PBoolean stop;
+    unsigned datagrams;
+    unsigned dropped;
+    PUInt64 bytes;
+};
+///////////////////////////////////////////////////////////////
+/*
+ * Counts the IFPs passed to T38Engine by the reorder window.
+ */
+class EngineCounter : public IFPReorder
+{
+    PCLASSINFO(EngineCounter, IFPReorder);
+  public:
+    EngineCounter(PMutex &_mutex, unsigned count, unsigned _firstSeq, unsigned _holdTime)
+      : IFPReorder(_mutex)
+      , got(count, 0)
+      , firstSeq(_firstSeq)
+      , holdTime(_holdTime)
+      , delivered(0)
+    {
+      Reset();
+      SetHoldTime(holdTime);
+    }
+
+    void SetStatistics(const RTP_Encoding::ErrorRecoveryStatistics &stats)
+    {
+      // as T38ModemMediaStream::UpdateUdptlStats() does, the counter w/o
+      // holding shows what reaches the engine if nothing waits for FEC
+      if (holdTime == 0 || GetRepairSpan() == stats.m_repairSpan)
+        return;
+
+      SetRepairSpan(stats.m_repairSpan);
+      SetHoldTime(stats.m_repairSpan > 0 && holdTime < FEC_REORDER_HOLD_TIME ? FEC_REORDER_HOLD_TIME : holdTime);
+    }
+
+    unsigned GetDelivered() const { return delivered; }
+
+  protected:
+    virtual PBoolean OnIFP(long sequenceNumber, const BYTE *, PINDEX)
+    {
+      unsigned i = WORD(sequenceNumber - firstSeq);
+
+      if (i < got.size() && !got[i]++)
+        delivered++;
+
+      return TRUE;
+    }
+
+    virtual PBoolean OnLost(long) { return TRUE; }
+
+    std::vector<int> got;
+    unsigned firstSeq;
+    unsigned holdTime;
+    unsigned delivered;
+};
+///////////////////////////////////////////////////////////////
+struct Result
+{
+  Result() : sent(0), delivered(0), engine(0), engineNoHold(0), late(0), padded(0), mismatched(0), duplicated(0), bytes(0) {}
+
+  unsigned sent;
+  unsigned delivered;
+  unsigned engine;
+  unsigned engineNoHold;
+  unsigned late;
+  unsigned padded;
+  unsigned mismatched;
+  unsigned duplicated;
+  PUInt64 bytes;
+};
+
+static RTP_UDP * OpenSession(unsigned id)
+{
+  RTP_Session::Params params;
+
+  params.id = id;
+  params.encoding = "udptl";
+
+  RTP_UDP * session = new RTP_UDP(params);
+
+  if (!session->Open(PIPSocket::Address("127.0.0.1"), 30000, 39999, 0)) {
+    delete session;
+    return NULL;
+  }
+
+  return session;
+}
+
+static PBoolean Run(const PString & redundancy, const PString & fec, unsigned lossPerMille, unsigned count, Result & result)
+{
+  RTP_UDP * tx = OpenSession(1);
+  RTP_UDP * rx = OpenSession(2);
+
+  if (tx == NULL || rx == NULL) {
+    delete tx;
+    delete rx;
+    return FALSE;
+  }
+
+  LossyRelay * relay = new LossyRelay(rx->GetLocalDataPort(), lossPerMille);
+
+  tx->SetRemoteSocketInfo(PIPSocket::Address("127.0.0.1"), relay->GetPort(), TRUE);
+
+  PStringToString options;
+
+  options.SetAt("T38-UDPTL-Redundancy", redundancy);
+  options.SetAt("T38-UDPTL-Redundancy-Interval", "0");  // no resends on idle, the loss is repeatable
+  options.SetAt("T38-UDPTL-Keep-Alive-Interval", "0");
+  options.SetAt("T38-UDPTL-Optimise-On-Retransmit", "true");
+  options.SetAt("T38-UDPTL-FEC", fec);
+
+  RTP_Session::EncodingLock(*tx)->ApplyStringOptions(options);
+
+  const unsigned firstSeq = 0x10000 - count/2;   // cross the wrap
+
+  tx->SetNextSentSequenceNumber(WORD(firstSeq));
+
+  std::vector<int> got(count, 0);
+  RTP_DataFrame frame;
+  unsigned maxIndex = 0;
+
+  PMutex mutex;
+  EngineCounter engine(mutex, count, firstSeq, DEFAULT_REORDER_HOLD_TIME);
+  EngineCounter engineNoHold(mutex, count, firstSeq, 0);
+
+  for (unsigned index = 0 ; index <= count ; index++) {
+    if (index < count) {
+      RTP_DataFrame ifp;
+      PINDEX size = IfpSize(index);
+
+      ifp.SetPayloadSize(size);
+
+      for (PINDEX i = 0 ; i < size ; i++)
+        ifp.GetPayloadPtr()[i] = IfpByte(index, i);
+
+      tx->WriteData(ifp);
+    }
+
+    // read all delivered, the last time wait for the read timeout
+
+    while (index == count || rx->HasPendingData() ||
+           PSocket::Select(rx->GetDataSocket(), rx->GetControlSocket(), 5) < 0)
+    {
+      if (!rx->ReadData(frame, TRUE) || frame.GetPayloadSize() == 0)
+        break;
+
+      {
+        RTP_Encoding::ErrorRecoveryStatistics stats;
+
+        RTP_Session::EncodingLock(*rx)->GetErrorRecoveryStatistics(stats);
+
+        PWaitAndSignal mutexWait(mutex);
+
+        engine.SetStatistics(stats);
+        engine.Put(frame.GetSequenceNumber(), frame.GetPayloadPtr(), frame.GetPayloadSize());
+        engineNoHold.Put(frame.GetSequenceNumber(), frame.GetPayloadPtr(), frame.GetPayloadSize());
+      }
+
+      unsigned i = WORD(frame.GetSequenceNumber() - firstSeq);
+
+      if (i >= count) {
+        result.mismatched++;
+        continue;
+      }
+
+      if (got[i]++) {
+        result.duplicated++;
+        continue;
+      }
+
+      result.delivered++;
+
+      if (result.delivered > 1 && i < maxIndex)
+        result.late++;
+
+      if (maxIndex < i)
+        maxIndex = i;
+
+      PINDEX size = IfpSize(i);
+      const BYTE * p = frame.GetPayloadPtr();
+
+      if (frame.GetPayloadSize() < size) {
+        result.mismatched++;
+        continue;
+      }
+
+      PBoolean ok = TRUE;
+
+      for (PINDEX j = 0 ; j < frame.GetPayloadSize() ; j++) {
+        if (p[j] != (j < size ? IfpByte(i, j) : 0))
+          ok = FALSE;
+      }
+
+      if (!ok)
+        result.mismatched++;
+      else
+      if (frame.GetPayloadSize() > size)
+        result.padded++;
+    }
+  }
+
+  {
+    PWaitAndSignal mutexWait(mutex);
+
+    engine.Flush();
+    engineNoHold.Flush();
+  }
+
+  engine.Stop();
+  engineNoHold.Stop();
+
+  relay->Stop();
+
+  result.sent = count;
+  result.engine = engine.GetDelivered();
+  result.engineNoHold = engineNoHold.GetDelivered();
+  result.bytes = relay->bytes;
+
+  delete relay;
+  delete tx;
+  delete rx;
+
+  return TRUE;
+}
+///////////////////////////////////////////////////////////////
+class UdptlLoss : public PProcess
+{
+    PCLASSINFO(UdptlLoss, PProcess);
+  public:
+    UdptlLoss() : PProcess("t38modem", "udptl_loss") {}
+    void Main();
+};
+
+PCREATE_PROCESS(UdptlLoss);
+
+void UdptlLoss::Main()
+{
+  PArgList &args = GetArguments();
+
+  args.Parse("q-quick."
+             "l-loss:"
+             "n-count:");
+
+  unsigned count = args.HasOption('q') ? 500 : 2000;
+  unsigned loss = 20;
+
+  if (args.HasOption('n'))
+    count = args.GetOptionString('n').AsUnsigned();
+
+  if (args.HasOption('l'))
+    loss = args.GetOptionString('l').AsUnsigned();
+
+  static const struct {
+    const char * name;
+    const char * redundancy;
+    const char * fec;
+  } configs[] = {
+    { "no redundancy", "",        "0"   },
+    { "redundancy 1",  "32767:1", "0"   },
+    { "redundancy 2",  "32767:2", "0"   },
+    { "FEC 1:1",       "",        "1:1" },
+    { "FEC 3:2",       "",        "3:2" },
+    { "FEC 3:3",       "",        "3:3" },
+  };
+
+  PBoolean failed = FALSE;
+
+  for (unsigned l = 0 ; l <= loss ; l += loss > 0 ? loss : 1) {
+    cout << count << " IFPs at " << l << "% loss:" << endl;
+
+    for (PINDEX c = 0 ; c < PINDEX(PARRAYSIZE(configs)) ; c++) {
+      Result result;
+
+      if (!Run(configs[c].redundancy, configs[c].fec, l*10, count, result)) {
+        cout << "FAIL: can't open UDPTL sessions" << endl;
+        SetTerminationValue(1);
+        return;
+      }
+
+      cout << "  " << setw(13) << configs[c].name << ": "
+           << setprecision(1) << setiosflags(ios::fixed)
+           << setw(5) << 100.0 * result.delivered / result.sent << "% delivered, "
+           << setw(5) << 100.0 * result.engine / result.sent << "% to engine"
+           << " (" << setw(5) << 100.0 * result.engineNoHold / result.sent << "% w/o holding), "
+           << setw(5) << double(result.bytes) / result.sent << " B/IFP, "
+           << result.late << " late, "
+           << result.padded << " padded";
+
+      if (result.mismatched > 0 || result.duplicated > 0 || result.engine != result.delivered ||
+          (l == 0 && result.delivered != result.sent)) {
+        cout << ", FAIL: " << result.mismatched << " mismatched, " << result.duplicated << " duplicated, "
+             << result.delivered - result.engine << " not passed to engine";
+        failed = TRUE;
+      }
+
+      cout << resetiosflags(ios::fixed) << endl;
+    }
+  }
+
+  if (failed)
+    SetTerminationValue(1);
+}
+///////////////////////////////////////////////////////////////
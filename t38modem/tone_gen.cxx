@@ -30,6 +30,7 @@
  */
 
 #include <ptlib.h>
+#include <ptclib/dtmf.h>
 #include <math.h>
 #include "pmutils.h"
 #include "tone_gen.h"
@@ -178,4 +179,96 @@ void ToneGenerator::Read(void * buffer, PINDEX amount)
   }
 }
 ///////////////////////////////////////////////////////////////
+static const char dtmfDigits[] = "0123456789ABCD*#";
 
+#define DTMF_DIGITS               (sizeof(dtmfDigits) - 1)
+#define DTMF_SIMPLES              SIMPLES_PER_SEC
+
+static SIMPLE_TYPE dtmfTones[DTMF_DIGITS][DTMF_SIMPLES];
+static unsigned dtmfFrequencies[DTMF_DIGITS][2];
+
+PBoolean DTMFEncoder::InitTones(const void *)
+{
+  for (PINDEX i = 0 ; i < PINDEX(DTMF_DIGITS) ; i++) {
+    DTMFEncoder tone;
+
+    tone.PDTMFEncoder::AddTone(dtmfDigits[i], 1000);
+
+    PINDEX size = tone.GetSize();
+
+    if (size > DTMF_SIMPLES)
+      size = DTMF_SIMPLES;
+
+    memcpy(dtmfTones[i], (const short *)tone, size*BYTES_PER_SIMPLE);
+    dtmfFrequencies[i][0] = tone.m_lastFrequency1;
+    dtmfFrequencies[i][1] = tone.m_lastFrequency2;
+  }
+
+  return TRUE;
+}
+
+void DTMFEncoder::AddTone(char digit, unsigned milliseconds)
+{
+  const char *pDigit = digit ? strchr(dtmfDigits, toupper(digit)) : NULL;
+
+  if (pDigit == NULL) {
+    // not a DTMF digit (CNG, CED, ...)
+    PDTMFEncoder::AddTone(digit, milliseconds);
+    return;
+  }
+
+  static const PBoolean initTones = InitTones(&initTones);
+
+  PINDEX i = PINDEX(pDigit - dtmfDigits);
+  unsigned f1 = dtmfFrequencies[i][0];
+  unsigned f2 = dtmfFrequencies[i][1];
+  PINDEX offset = 0;
+
+  if (m_lastOperation == '+' && m_lastFrequency1 == f1 && m_lastFrequency2 == f2) {
+    // continue the phase as PTones::Generate() does for a repeated tone
+    while (offset < PINDEX(DTMF_SIMPLES) &&
+           (int(offset*f1 % DTMF_SIMPLES) != m_angle1 || int(offset*f2 % DTMF_SIMPLES) != m_angle2))
+      offset++;
+
+    if (offset == PINDEX(DTMF_SIMPLES))
+      offset = 0;
+  } else {
+    m_lastOperation = '+';
+    m_lastFrequency1 = f1;
+    m_lastFrequency2 = f2;
+  }
+
+  const SIMPLE_TYPE *pTone = dtmfTones[i];
+  PINDEX count = PINDEX(milliseconds*DTMF_SIMPLES/1000);
+  PINDEX size = GetSize();
+  short *pBuf = GetPointer(size + count) + size;
+
+  while (count) {
+    PINDEX len = PINDEX(DTMF_SIMPLES) - offset;
+
+    if (len > count)
+      len = count;
+
+    memcpy(pBuf, pTone + offset, len*BYTES_PER_SIMPLE);
+
+    pBuf += len;
+    count -= len;
+    offset = (offset + len) % DTMF_SIMPLES;
+  }
+
+  m_angle1 = int(offset*f1 % DTMF_SIMPLES);
+  m_angle2 = int(offset*f2 % DTMF_SIMPLES);
+}
+
+void DTMFEncoder::AddSilence(unsigned milliseconds)
+{
+  m_lastOperation = ' ';
+  m_lastFrequency1 = 0;
+  m_lastFrequency2 = 0;
+  m_angle1 = 0;
+  m_angle2 = 0;
+
+  // the new elements are filled by zeros
+  SetSize(GetSize() + PINDEX(milliseconds*m_sampleRate/1000));
+}
+///////////////////////////////////////////////////////////////
@@ -32,6 +32,8 @@
 #ifndef _TONE_GEN_H
 #define _TONE_GEN_H
 
+#include <ptclib/dtmf.h>
+
 ///////////////////////////////////////////////////////////////
 class ToneGenerator : public PObject
 {
@@ -60,6 +62,30 @@ class ToneGenerator : public PObject
     PINDEX index;
 };
 ///////////////////////////////////////////////////////////////
+/*
+ * PDTMFEncoder with pre-rendered DTMF digits.
+ *
+ * Each digit is rendered by PDTMFEncoder only once per process for one
+ * second, which is a whole period of the integer DTMF frequencies at
+ * 8000 Hz. AddTone() then copies slices of that period, so it does not
+ * compute sines or grow the buffer sample by sample. It starts the slice
+ * at the phase PDTMFEncoder would continue from, so the output is the
+ * same as of PDTMFEncoder::AddTone() and Generate(' ', 0, 0, ms).
+ */
+class DTMFEncoder : public PDTMFEncoder
+{
+  PCLASSINFO(DTMFEncoder, PDTMFEncoder);
+
+  public:
+
+    using PDTMFEncoder::AddTone;
+    void AddTone(char digit, unsigned milliseconds);
+    void AddSilence(unsigned milliseconds);
+
+  protected:
+    static PBoolean InitTones(const void *);
+};
+///////////////////////////////////////////////////////////////
 
 #endif  // _TONE_GEN_H
 